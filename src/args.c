@@ -1,6 +1,9 @@
 #include "args.h"
 #include "errors.h"
 #include "util.h"
+#include "profile.h"
+#include "order.h"
+#include "trace.h"
 
 #include <stdlib.h>
 #include <string.h>
@@ -13,6 +16,7 @@ struct Args *args_parse(int argc, char **argv)
     args->sources = 0;
     args->nsources = 0;
     args->keep_assembly = false;
+    args->debug = false;
 
     args->warnings[WARNING_DEAD_CODE] = true;
     args->warnings[WARNING_UNUSED_VARIABLE] = true;
@@ -36,19 +40,52 @@ struct Args *args_parse(int argc, char **argv)
 
 #ifdef DEBUG
     args->libdirs[0] = "lib";
+    args->stdlib_dir = "lib/";
 #else
     args->libdirs[0] = "/usr/share/crust/lib";
+    args->stdlib_dir = "/usr/share/crust/lib/";
 #endif
 
     args->link_objs = true;
 
+    args->target = TARGET_I386;
+
+    args->optimize = 1;
+    args->print_stats = false;
+    // Roughly what a call costs: pushes, call, prologue, epilogue, result copy
+    args->inline_limit = 8;
+    args->unroll_loops = false;
+    args->lto = false;
+    args->profile_generate = false;
+    args->profile_use = 0;
+    args->order_generate = 0;
+    args->perf_script = 0;
+    args->function_order = 0;
+    args->instrument_functions = false;
+    args->trace_report = 0;
+
     for (int i = 1; i < argc; ++i)
     {
         if (strcmp(argv[i], "--help") == 0)
         {
             printf( "Crust command line help\n"
                     "-o [output file]: Specify output executable name\n"
-                    "-S: Keep assembly output\n");
+                    "-S: Keep assembly output\n"
+                    "-g: Emit line tables, unwind info and symbol sizes\n"
+                    "-O[level]: Optimization level, -O0 disables optimizations\n"
+                    "--stats: Print optimization stats\n"
+                    "--target=[i386|x86_64]: Architecture to compile for, default i386\n"
+                    "-finline-limit=[n]: Inline functions estimated at up to n instructions\n"
+                    "-funroll-loops: Unroll for loops with a small constant trip count\n"
+                    "-flto: Compile all sources and the stdlib into one program\n"
+                    "-fprofile-generate: Count what runs, written to " PROFILE_FILE " when main returns\n"
+                    "-fprofile-use[=file]: Optimize for a profile, default " PROFILE_FILE "\n"
+                    "-ffunction-order-generate[=file]: Write a function order for the profile or perf\n"
+                    "    script output, default " ORDER_FILE "\n"
+                    "-fperf-script=[file]: perf script output of a run recorded with perf record -g\n"
+                    "-ffunction-order=[file]: Link functions in the order listed in file\n"
+                    "-finstrument-functions: Time function calls, written to " TRACE_FILE " when main returns\n"
+                    "--trace-report[=file]: Print the calls and cycles of a trace, default " TRACE_FILE "\n");
             exit(0);
         }
         else if (strcmp(argv[i], "-o") == 0)
@@ -60,6 +97,10 @@ struct Args *args_parse(int argc, char **argv)
         {
             args->keep_assembly = true;
         }
+        else if (strcmp(argv[i], "-g") == 0)
+        {
+            args->debug = true;
+        }
         else if (strncmp(argv[i], "-W", 2) == 0)
         {
             char *warning = args_value_from_opt(argc, argv, &i);
@@ -72,6 +113,61 @@ struct Args *args_parse(int argc, char **argv)
             else
                 args->warnings[idx] = enabled;
         }
+        else if (strncmp(argv[i], "-O", 2) == 0)
+        {
+            args->optimize = argv[i][2] ? atoi(&argv[i][2]) : 1;
+        }
+        else if (strncmp(argv[i], "-finline-limit=", 15) == 0)
+        {
+            args->inline_limit = atoi(&argv[i][15]);
+        }
+        else if (strcmp(argv[i], "-funroll-loops") == 0)
+        {
+            args->unroll_loops = true;
+        }
+        else if (strcmp(argv[i], "-flto") == 0)
+        {
+            args->lto = true;
+        }
+        else if (strcmp(argv[i], "-fprofile-generate") == 0)
+        {
+            args->profile_generate = true;
+        }
+        else if (strncmp(argv[i], "-fprofile-use", 13) == 0)
+        {
+            args->profile_use = argv[i][13] == '=' ? &argv[i][14] : PROFILE_FILE;
+        }
+        else if (strncmp(argv[i], "-ffunction-order-generate", 25) == 0)
+        {
+            args->order_generate = argv[i][25] == '=' ? &argv[i][26] : ORDER_FILE;
+        }
+        else if (strncmp(argv[i], "-ffunction-order=", 17) == 0)
+        {
+            args->function_order = &argv[i][17];
+        }
+        else if (strncmp(argv[i], "-fperf-script=", 14) == 0)
+        {
+            args->perf_script = &argv[i][14];
+        }
+        else if (strcmp(argv[i], "-finstrument-functions") == 0)
+        {
+            args->instrument_functions = true;
+        }
+        else if (strncmp(argv[i], "--trace-report", 14) == 0)
+        {
+            args->trace_report = argv[i][14] == '=' ? &argv[i][15] : TRACE_FILE;
+        }
+        else if (strncmp(argv[i], "--target=", 9) == 0)
+        {
+            args->target = args_target_from_str(&argv[i][9]);
+
+            if (args->target == -1)
+                errors_args_nonexistent_target(&argv[i][9]);
+        }
+        else if (strcmp(argv[i], "--stats") == 0)
+        {
+            args->print_stats = true;
+        }
         else if (strcmp(argv[i], "--obj") == 0)
         {
             args->link_objs = false;
@@ -99,6 +195,8 @@ struct Args *args_parse(int argc, char **argv)
         }
     }
 
+    args_target_dirs(args);
+
     return args;
 }
 
@@ -131,6 +229,33 @@ int args_index_from_warning(char *warning, bool *enabled)
 }
 
 
+int args_target_from_str(char *target)
+{
+    if (strcmp(target, "i386") == 0) return TARGET_I386;
+    if (strcmp(target, "x86_64") == 0) return TARGET_X86_64;
+
+    return -1;
+}
+
+
+void args_target_dirs(struct Args *args)
+{
+    if (args->target != TARGET_X86_64)
+        return;
+
+    args->include_dirs = realloc(args->include_dirs, sizeof(char*) * ++args->include_dirs_len);
+    memmove(&args->include_dirs[1], args->include_dirs, sizeof(char*) * (args->include_dirs_len - 1));
+
+#ifdef DEBUG
+    args->include_dirs[0] = "lib/include/x86_64/";
+    args->libdirs[0] = "lib/x86_64";
+#else
+    args->include_dirs[0] = "/usr/share/crust/lib/include/x86_64/";
+    args->libdirs[0] = "/usr/share/crust/lib/x86_64";
+#endif
+}
+
+
 char *args_value_from_opt(int argc, char **argv, int *idx)
 {
     if (strlen(argv[*idx]) != 2)
@@ -4,6 +4,12 @@
 #include <stdio.h>
 #include <stdbool.h>
 
+enum
+{
+    TARGET_I386,
+    TARGET_X86_64
+};
+
 enum
 {
     WARNING_DEAD_CODE,
@@ -19,6 +25,8 @@ struct Args
     char *out_filename;
 
     bool keep_assembly;
+    // Line tables, unwind info and symbol types for debuggers and profilers
+    bool debug;
 
     bool warnings[3];
 
@@ -31,13 +39,49 @@ struct Args
     char **libdirs;
     size_t nlibdirs;
 
+    // Where the stdlib's own sources are, compiled into the program with -flto
+    char *stdlib_dir;
+
     bool link_objs;
+
+    // -O level, 0 disables optimization passes
+    int optimize;
+    bool print_stats;
+
+    int target;
+
+    // Largest estimated instruction count of a function inlined without the inline keyword
+    size_t inline_limit;
+    // Copy the body of for loops with a small constant trip count
+    bool unroll_loops;
+    // Compile the sources and the stdlib as one unit
+    bool lto;
+
+    // Count how often functions and ifs run, written to PROFILE_FILE at exit
+    bool profile_generate;
+    // Profile read back to lay out code and guide inlining, 0 if there's none
+    char *profile_use;
+
+    // File the clustered function order is written to, from the profile or perf_script
+    char *order_generate;
+    // Output of perf script for a program recorded with perf record -g
+    char *perf_script;
+    // Order the linker lays functions out in, 0 to keep the input order
+    char *function_order;
+
+    // Timestamp function entries and exits, written to TRACE_FILE at exit
+    bool instrument_functions;
+    // Trace to print a report of, 0 if there's none
+    char *trace_report;
 };
 
 struct Args *args_parse(int argc, char **argv);
 void args_free(struct Args *args);
 
 int args_index_from_warning(char *warning, bool *enabled);
+int args_target_from_str(char *target);
+// Puts the target's own headers and libraries in front of the shared ones
+void args_target_dirs(struct Args *args);
 char *args_value_from_opt(int argc, char **argv, int *idx);
 
 char *args_advance(int argc, char **argv, int *idx);
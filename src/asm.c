@@ -1,47 +1,77 @@
 #include "asm.h"
+#include "asm64.h"
 #include "util.h"
 #include "errors.h"
 #include "crust.h"
 #include "parser.h"
+#include "peephole.h"
+#include "loop.h"
+#include "stats.h"
+#include "profile.h"
+#include "trace.h"
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <math.h>
 #include <ctype.h>
+#include <limits.h>
 
-#define MAX_INT_LEN 10
-#define MEMORY_REF(x) (isdigit(x[0]) || x[0] == '-')
+const char *g_asm_fastcall_regs[ASM_NREGARGS] = { "%ecx", "%edx" };
 
 struct Asm *asm_alloc(struct Args *args, bool main)
 {
     struct Asm *as = malloc(sizeof(struct Asm));
 
-    const char *data_template = ".section .data\n";
-    as->data = calloc(strlen(data_template) + 1, sizeof(char));
-    strcpy(as->data, data_template);
+    // Read-only and merged with identical strings of every object by the linker
+    as->data = util_strcpy(".section .rodata.str1.1,\"aMS\",@progbits,1\n");
+
+    as->rodata = util_strcpy(".section .rodata\n");
 
     as->root = calloc(1, sizeof(char));
     util_strcat(&as->root, ".section .text\n");
 
+    as->cold = calloc(1, sizeof(char));
+    as->in_cold = false;
+
+    as->args = args;
+
     if (main)
     {
-        const char *begin = ".globl _start\n"
-                            "_start:\n"
-                            "call main\n"
-                            "movl $1, %eax\n"
-                            "int $0x80\n";
+        util_strcat(&as->root, ".globl _start\n"
+                               "_start:\n"
+                               "call main\n");
 
-        util_strcat(&as->root, begin);
+        if (args->profile_generate)
+            asm_gen_profile_writer(as);
+
+        if (args->instrument_functions)
+            asm_gen_trace_writer(as);
+
+        util_strcat(&as->root, "movl %eax, %ebx\n"
+                               "movl $1, %eax\n"
+                               "int $0x80\n");
+
+        // Nothing runs into them past the exit
+        if (args->instrument_functions)
+            asm_gen_trace_hooks(as);
     }
 
     as->scope = scope_alloc();
     // Global scope
     scope_push_layer(as->scope);
 
-    as->args = args;
-
     as->func_label = 1;
+    as->rodata_label = 0;
+    as->profile_label = 0;
+
+    as->inline_copies = 0;
+    as->ninline_copies = 0;
+
+    as->debug_files = 0;
+    as->ndebug_files = 0;
+    as->debug_file = 0;
+    as->debug_line = 0;
 
     return as;
 }
@@ -50,7 +80,15 @@ struct Asm *asm_alloc(struct Args *args, bool main)
 void asm_free(struct Asm *as)
 {
     free(as->data);
+    free(as->rodata);
     free(as->root);
+    free(as->cold);
+
+    for (size_t i = 0; i < as->ndebug_files; ++i)
+        free(as->debug_files[i]);
+
+    free(as->debug_files);
+    free(as->inline_copies);
     scope_free(as->scope);
     free(as);
 }
@@ -62,12 +100,21 @@ void asm_gen_expr(struct Asm *as, struct Node *node)
     {
     case NODE_COMPOUND:
         for (size_t i = 0; i < node->compound_size; ++i)
+        {
+            asm_gen_debug_line(as, node->compound_nodes[i]);
             asm_gen_expr(as, node->compound_nodes[i]);
+        }
         break;
 
     case NODE_FUNCTION_DEF:
         if (node->function_def_is_decl)
         {
+            struct Node *def = scope_find_function_def(as->scope, node->function_def_name, -1);
+
+            // Declaring an inline function from an include emits its out-of-line copy
+            if (def && def->function_def_is_inline && !asm_check_function_defined(as, def->function_def_name))
+                asm_gen_function_def(as, def);
+
             scope_add_function_def(as->scope, node);
             return;
         }
@@ -123,6 +170,14 @@ void asm_gen_expr(struct Asm *as, struct Node *node)
         asm_gen_if_statement(as, node);
         break;
 
+    case NODE_WHILE:
+        asm_gen_while(as, node);
+        break;
+
+    case NODE_FOR:
+        asm_gen_for(as, node);
+        break;
+
     default: break;
     }
 }
@@ -130,19 +185,78 @@ void asm_gen_expr(struct Asm *as, struct Node *node)
 
 void asm_gen_function_def(struct Asm *as, struct Node *node)
 {
-    const char *template =  "# Function def\n"
-                            ".globl %s\n"
-                            "%s:\n"
-                            "pushl %%ebp\n"
-                            "movl %%esp, %%ebp\n";
+    size_t start = strlen(as->root);
+    asm_gen_function_label(as, node);
 
-    size_t len = strlen(template) + strlen(node->function_def_name) * 2;
-    char *s = calloc(len + 1, sizeof(char));
-    sprintf(s, template, node->function_def_name, node->function_def_name);
-    s = realloc(s, sizeof(char) * (strlen(s) + 1));
+    util_strcat(&as->root, "pushl %ebp\n");
 
-    util_strcat(&as->root, s);
-    free(s);
+    if (as->args->debug)
+        util_strcat(&as->root, ".cfi_def_cfa_offset 8\n"
+                               ".cfi_offset %ebp, -8\n");
+
+    util_strcat(&as->root, "movl %esp, %ebp\n");
+
+    if (as->args->debug)
+        util_strcat(&as->root, ".cfi_def_cfa_register %ebp\n");
+
+    char *s;
+
+    as->curr_func = node;
+    as->tail_label = 0;
+
+    // Whole frame is reserved here, 16 byte aligned
+    size_t frame = (node->function_def_stack_size + 15) & ~(size_t)15;
+
+    if (frame)
+    {
+        const char *reserve = "subl $%zu, %%esp\n";
+        s = calloc(strlen(reserve) + MAX_INT_LEN + 1, sizeof(char));
+        sprintf(s, reserve, frame);
+        util_strcat(&as->root, s);
+        free(s);
+    }
+
+    // C callers expect %ebx to survive the call
+    if (node->function_def_conv == CONV_CDECL)
+        util_strcat(&as->root, "movl %ebx, -4(%ebp)\n");
+
+    // Before the self tail call label, which isn't a new entry
+    if (as->args->profile_generate && node->profile_key)
+        asm_gen_profile_counter(as, node->profile_key);
+
+    if (as->args->instrument_functions)
+        asm_gen_trace_enter(as, node);
+
+    if (as->args->optimize && asm_find_self_tail_call(node->function_def_body, node->function_def_name))
+    {
+        // Self tail calls leave %esp where it is, only the register args are spilled again
+        as->tail_label = as->func_label++;
+
+        s = calloc(MAX_INT_LEN + 5, sizeof(char));
+        sprintf(s, ".L%zu:\n", as->tail_label);
+        util_strcat(&as->root, s);
+        free(s);
+    }
+
+    size_t nregs = node_conv_nregs(node->function_def_conv, as->args->target);
+
+    for (size_t i = 0; i < node->function_def_params_size && i < nregs; ++i)
+    {
+        const char *spill = "movl %s, %d(%%ebp)\n";
+        s = calloc(strlen(spill) + MAX_INT_LEN + 5, sizeof(char));
+        sprintf(s, spill, g_asm_fastcall_regs[i], node->function_def_params[i]->variable_stack_offset);
+        util_strcat(&as->root, s);
+        free(s);
+    }
+
+    if (node->function_def_return_type.type == NODE_STRUCT)
+    {
+        const char *spill = "movl %%eax, %d(%%ebp)\n";
+        s = calloc(strlen(spill) + MAX_INT_LEN + 1, sizeof(char));
+        sprintf(s, spill, node->function_def_return_ptr_stack_offset);
+        util_strcat(&as->root, s);
+        free(s);
+    }
 
     scope_push_layer(as->scope);
 
@@ -152,26 +266,114 @@ void asm_gen_function_def(struct Asm *as, struct Node *node)
     asm_gen_expr(as, node->function_def_body);
 
     if (node->function_def_return_type.type == NODE_NOOP)
-        util_strcat(&as->root, "movl $0, %ebx\nleave\nret\n");
+    {
+        util_strcat(&as->root, "movl $0, %eax\n");
+        asm_gen_epilogue(as);
+        asm_gen_ret(as);
+    }
+
+    asm_gen_function_end(as, node);
 
     errors_asm_check_function_return(as->scope, node);
 
-    if (as->args->warnings[WARNING_UNUSED_VARIABLE])
+    if (as->args->warnings[WARNING_UNUSED_VARIABLE] && !node->function_def_is_stdlib)
         errors_warn_unused_variable(as->scope, node);
 
     scope_pop_layer(as->scope);
 
-    if (as->args->warnings[WARNING_DEAD_CODE])
+    if (as->args->warnings[WARNING_DEAD_CODE] && !node->function_def_is_stdlib)
         errors_warn_dead_code(node);
+
+    // Checked like any other function, then dropped
+    if (node->function_def_is_dead)
+    {
+        as->root[start] = '\0';
+        return;
+    }
+
+    if (as->args->optimize)
+        g_stats.peephole_removed += peephole_optimize(&as->root, start);
+}
+
+
+void asm_gen_function_label(struct Asm *as, struct Node *node)
+{
+    util_strcat(&as->root, "# Function def\n");
+
+    int heat = as->args->profile_use ? profile_function_heat(node) : PROFILE_UNKNOWN;
+    as->in_cold = node->function_def_is_cold || heat == PROFILE_COLD;
+
+    // A section per function lets the linker drop the ones nothing calls.
+    // The linker groups the hot ones and the cold or never run ones.
+    if (as->args->optimize)
+    {
+        const char *section = ".section .text.%s%s,\"ax\",@progbits\n";
+        const char *prefix = as->in_cold ? "unlikely." : heat == PROFILE_HOT ? "hot." : "";
+
+        char *s = calloc(strlen(section) + strlen(prefix) + strlen(node->function_def_name) + 1, sizeof(char));
+        sprintf(s, section, prefix, node->function_def_name);
+        util_strcat(&as->root, s);
+        free(s);
+
+        // Cold code is packed instead
+        if (!as->in_cold)
+            util_strcat(&as->root, ".p2align 4\n");
+    }
+
+    const char *template = node->function_def_is_static ? "%s:\n" : ".globl %s\n%s:\n";
+    char *s = calloc(strlen(template) + strlen(node->function_def_name) * 2 + 1, sizeof(char));
+    sprintf(s, template, node->function_def_name, node->function_def_name);
+    util_strcat(&as->root, s);
+    free(s);
+
+    if (as->args->debug)
+    {
+        const char *type = ".type %s, @function\n"
+                           ".cfi_startproc\n";
+        s = calloc(strlen(type) + strlen(node->function_def_name) + 1, sizeof(char));
+        sprintf(s, type, node->function_def_name);
+        util_strcat(&as->root, s);
+        free(s);
+
+        asm_gen_debug_file(as, node->function_def_file);
+        asm_gen_debug_loc(as, node->error_line);
+    }
+}
+
+
+void asm_gen_function_end(struct Asm *as, struct Node *node)
+{
+    if (as->args->debug)
+    {
+        const char *end = ".cfi_endproc\n"
+                          ".size %s, .-%s\n";
+        char *s = calloc(strlen(end) + strlen(node->function_def_name) * 2 + 1, sizeof(char));
+        sprintf(s, end, node->function_def_name, node->function_def_name);
+        util_strcat(&as->root, s);
+        free(s);
+    }
+
+    asm_gen_cold_blocks(as, node);
 }
 
 
 void asm_gen_return(struct Asm *as, struct Node *node)
 {
+    if (node->return_value->type == NODE_FUNCTION_CALL && !node->return_value->function_call_inlined &&
+        asm_check_tail_call(as, node->return_value))
+    {
+        asm_gen_tail_call(as, node->return_value);
+        return;
+    }
+
+    if (as->curr_func->function_def_return_type.type == NODE_STRUCT)
+    {
+        asm_gen_return_struct(as, node);
+        return;
+    }
+
     const char *template =  "# Return\n"
-                            "movl %s, %%ebx\n"
-                            "leave\n"
-                            "ret\n";
+                            "movl %s, %%eax\n";
 
     asm_gen_expr(as, node->return_value);
     char *ret = asm_str_from_node(as, node->return_value);
@@ -185,11 +387,255 @@ void asm_gen_return(struct Asm *as, struct Node *node)
 
     free(s);
     free(ret);
+
+    asm_gen_epilogue(as);
+    asm_gen_ret(as);
+}
+
+
+void asm_gen_return_struct(struct Asm *as, struct Node *node)
+{
+    struct Node *value = node->return_value;
+
+    if (value->type == NODE_INIT_LIST)
+        asm_gen_return_init_list(as, value, 0);
+    else
+    {
+        asm_gen_expr(as, value);
+
+        // The callee wrote through our pointer and handed it back in %eax
+        if (value->type == NODE_FUNCTION_CALL && value->function_call_return_ptr_stack_offset)
+        {
+            asm_gen_epilogue(as);
+            asm_gen_ret(as);
+            return;
+        }
+
+        util_strcat(&as->root, "# Return struct into the caller's result\n");
+        asm_gen_load_return_ptr(as, "%edx");
+        asm_gen_copy_struct(as, value, "%edx", 0);
+    }
+
+    // The pointer is handed back in %eax like C does
+    asm_gen_load_return_ptr(as, "%eax");
+
+    asm_gen_epilogue(as);
+    asm_gen_ret(as);
+}
+
+
+void asm_gen_return_init_list(struct Asm *as, struct Node *node, int offset)
+{
+    errors_asm_check_init_list(as->scope, node);
+
+    if (asm_check_init_list_rodata(as, node))
+    {
+        asm_gen_load_return_ptr(as, "%edx");
+        asm_gen_init_list_rodata(as, node, "%edx", offset);
+        return;
+    }
+
+    for (size_t i = 0; i < node->init_list_len; ++i)
+    {
+        struct Node *value = node->init_list_values[i];
+        int dst = offset - 4 * (int)i;
+
+        if (value->type == NODE_INIT_LIST)
+        {
+            asm_gen_return_init_list(as, value, dst);
+            continue;
+        }
+
+        asm_gen_expr(as, value);
+
+        // Calls in the members clobber %edx, so the pointer is loaded for every store
+        if (node_type_from_node(value, as->scope).type == NODE_STRUCT)
+        {
+            asm_gen_load_return_ptr(as, "%edx");
+            asm_gen_copy_struct(as, value, "%edx", dst);
+            continue;
+        }
+
+        char *src = asm_str_from_node(as, value);
+
+        if (MEMORY_REF(src))
+        {
+            char *s = calloc(strlen(src) + 20, sizeof(char));
+            sprintf(s, "movl %s, %%eax\n", src);
+            util_strcat(&as->root, s);
+
+            free(src);
+            free(s);
+
+            src = util_strcpy("%eax");
+        }
+
+        asm_gen_load_return_ptr(as, "%edx");
+
+        const char *template = "# Store member into the caller's result\n"
+                               "movl %s, %d(%%edx)\n";
+        char *s = calloc(strlen(template) + strlen(src) + MAX_INT_LEN + 1, sizeof(char));
+        sprintf(s, template, src, dst);
+        util_strcat(&as->root, s);
+
+        free(src);
+        free(s);
+    }
+}
+
+
+void asm_gen_load_return_ptr(struct Asm *as, const char *reg)
+{
+    const char *template = "movl %d(%%ebp), %s\n";
+    char *s = calloc(strlen(template) + strlen(reg) + MAX_INT_LEN + 1, sizeof(char));
+    sprintf(s, template, as->curr_func->function_def_return_ptr_stack_offset, reg);
+    util_strcat(&as->root, s);
+    free(s);
+}
+
+
+void asm_gen_epilogue(struct Asm *as)
+{
+    if (as->args->instrument_functions)
+        asm_gen_trace_call(as, "crust_trace_exit");
+
+    if (as->args->debug)
+        util_strcat(&as->root, ".cfi_remember_state\n");
+
+    if (as->curr_func->function_def_conv == CONV_CDECL)
+        util_strcat(&as->root, "movl -4(%ebp), %ebx\n");
+
+    util_strcat(&as->root, "leave\n");
+
+    if (as->args->debug)
+        util_strcat(&as->root, ".cfi_def_cfa %esp, 4\n");
+}
+
+
+void asm_gen_ret(struct Asm *as)
+{
+    util_strcat(&as->root, "ret\n");
+
+    if (as->args->debug)
+        util_strcat(&as->root, ".cfi_restore_state\n");
+}
+
+
+void asm_gen_tail_call(struct Asm *as, struct Node *node)
+{
+    struct Node *func = scope_find_function(as->scope, node->function_call_name, node->error_line);
+    errors_asm_check_function_call(as->scope, func, node);
+    asm_add_inline_copy(as, node->function_call_name);
+
+    // All args are evaluated before any of ours are overwritten
+    asm_gen_push_args(as, node);
+    util_strcat(&as->root, "# Tail call: move args into registers and over our own\n");
+
+    size_t nregs = node_conv_nregs(func->function_def_conv, as->args->target);
+
+    for (size_t i = 0; i < node->function_call_args_size; ++i)
+    {
+        char *s = calloc(MAX_INT_LEN + 20, sizeof(char));
+
+        if (i < nregs)
+            sprintf(s, "popl %s\n", g_asm_fastcall_regs[i]);
+        else
+            sprintf(s, "popl %zu(%%ebp)\n", 8 + (i - nregs) * 4);
+
+        util_strcat(&as->root, s);
+        free(s);
+    }
+
+    bool self = strcmp(node->function_call_name, as->curr_func->function_def_name) == 0;
+
+    const char *template;
+    char *s;
+
+    if (self)
+    {
+        template = "jmp .L%zu\n";
+        s = calloc(strlen(template) + MAX_INT_LEN + 1, sizeof(char));
+        sprintf(s, template, as->tail_label);
+    }
+    else
+    {
+        asm_gen_epilogue(as);
+
+        template = "jmp %s\n";
+        s = calloc(strlen(template) + strlen(node->function_call_name) + 1, sizeof(char));
+        sprintf(s, template, node->function_call_name);
+    }
+
+    util_strcat(&as->root, s);
+    free(s);
+
+    // Same as after a ret
+    if (!self && as->args->debug)
+        util_strcat(&as->root, ".cfi_restore_state\n");
+
+    stats_add_tail_call(as->curr_func->function_def_name, node->function_call_name, self);
+}
+
+
+void asm_add_inline_copy(struct Asm *as, char *name)
+{
+    struct Node *def = scope_find_function_def(as->scope, name, -1);
+
+    if (!def || !def->function_def_is_inline)
+        return;
+
+    for (size_t i = 0; i < as->ninline_copies; ++i)
+    {
+        if (as->inline_copies[i] == def)
+            return;
+    }
+
+    as->inline_copies = realloc(as->inline_copies, sizeof(struct Node*) * ++as->ninline_copies);
+    as->inline_copies[as->ninline_copies - 1] = def;
+}
+
+
+void asm_gen_inline_copies(struct Asm *as)
+{
+    // Copies can call other inline functions, adding to the list
+    for (size_t i = 0; i < as->ninline_copies; ++i)
+    {
+        struct Node *def = as->inline_copies[i];
+
+        if (asm_check_function_defined(as, def->function_def_name))
+            continue;
+
+        // Local like a C static inline, so copies in other units don't clash
+        bool is_static = def->function_def_is_static;
+        def->function_def_is_static = true;
+
+        if (as->args->target == TARGET_X86_64)
+            asm64_gen_function_def(as, def);
+        else
+            asm_gen_function_def(as, def);
+
+        def->function_def_is_static = is_static;
+    }
 }
 
 
 void asm_gen_variable_def(struct Asm *as, struct Node *node)
 {
+    if (node->variable_def_is_dead)
+    {
+        errors_asm_check_variable_def(as->scope, node);
+        return;
+    }
+
+    if (node->variable_def_type.type == NODE_STRUCT && node->variable_def_value->type != NODE_INIT_LIST)
+    {
+        asm_gen_expr(as, node->variable_def_value);
+        errors_asm_check_variable_def(as->scope, node);
+
+        asm_gen_copy_struct(as, node->variable_def_value, "%ebp", node->variable_def_stack_offset);
+        return;
+    }
+
     struct Node *literal = node_strip_to_literal(node, as->scope);
     asm_gen_expr(as, node->variable_def_value);
 
@@ -204,16 +650,32 @@ void asm_gen_add_to_stack(struct Asm *as, struct Node *node, int stack_offset)
     {
         errors_asm_check_init_list(as->scope, node);
 
+        if (asm_check_init_list_rodata(as, node))
+        {
+            asm_gen_init_list_rodata(as, node, "%ebp", stack_offset);
+            return;
+        }
+
         for (size_t i = 0; i < node->init_list_len; ++i)
+        {
+            if (node->init_list_values[i]->type != NODE_INIT_LIST)
+                asm_gen_expr(as, node->init_list_values[i]);
+
             asm_gen_add_to_stack(as, node->init_list_values[i], stack_offset - 4 * i);
+        }
 
         return;
     }
 
-    asm_gen_expr(as, node);
+    // Callers generate the value; generating it again here would repeat calls
+
+    if (node_type_from_node(node, as->scope).type == NODE_STRUCT)
+    {
+        asm_gen_copy_struct(as, node, "%ebp", stack_offset);
+        return;
+    }
 
     const char *template =  "# Add value to stack\n"
-                            "subl $4, %%esp\n"
                             "movl %s, %d(%%ebp)\n";
 
     char *left = asm_str_from_node(as, node);
@@ -222,7 +684,7 @@ void asm_gen_add_to_stack(struct Asm *as, struct Node *node, int stack_offset)
     {
         const char *tmp = "# Avoid too many memory references\n"
                           "movl %s, %%eax\n";
-        char *s = calloc(strlen(template) + strlen(left) + 1, sizeof(char));
+        char *s = calloc(strlen(tmp) + strlen(left) + 1, sizeof(char));
         sprintf(s, tmp, left);
         util_strcat(&as->root, s);
 
@@ -262,44 +724,233 @@ void asm_gen_store_string(struct Asm *as, struct Node *node)
 }
 
 
-void asm_gen_function_call(struct Asm *as, struct Node *node)
+void asm_gen_init_list_rodata(struct Asm *as, struct Node *node, const char *dst_base, int dst_offset)
 {
-    struct Node *func = scope_find_function(as->scope, node->function_call_name, node->error_line);
-
-    errors_asm_check_function_call(as->scope, func, node);
-
-    asm_gen_push_args(as, node);
-
-    const char *template = "# Function call\n"
-                           "call %s\n"
-                           "subl $4, %%esp\n"
-                           "movl %%ebx, %d(%%ebp)\n";
-
-    size_t len = strlen(template) + strlen(node->function_call_name) + MAX_INT_LEN;
-    char *s = calloc(len + 1, sizeof(char));
-    sprintf(s, template, node->function_call_name, node->function_call_return_stack_offset);
-    s = realloc(s, sizeof(char) * (strlen(s) + 1));
+    char *src = asm_gen_rodata(as, node);
 
+    const char *template = "# Init list from .rodata\n"
+                           "leal %s, %%ecx\n";
+    char *s = calloc(strlen(template) + strlen(src) + 1, sizeof(char));
+    sprintf(s, template, src);
     util_strcat(&as->root, s);
+
     free(s);
+    free(src);
+
+    asm_gen_copy(as, "%ecx", 0, dst_base, dst_offset, node_sizeof_dtype(node));
 }
 
 
-void asm_gen_push_args(struct Asm *as, struct Node *node)
+char *asm_gen_rodata(struct Asm *as, struct Node *node)
 {
-    util_strcat(&as->root, "# Push function call args\n");
+    size_t nwords = node_sizeof_dtype(node) / 4;
+    char **words = calloc(nwords, sizeof(char*));
 
-    // Push args on stack backwards so they're in order
-    for (int i = node->function_call_args_size - 1; i >= 0; --i)
+    asm_gen_rodata_words(as, node, words, 0);
+
+    const char *template = ".section .rodata.LR%zu,\"a\"\n"
+                           ".p2align 2\n"
+                           ".LR%zu:\n";
+    char *s = calloc(strlen(template) + MAX_INT_LEN * 2 + 1, sizeof(char));
+    sprintf(s, template, as->rodata_label, as->rodata_label);
+    util_strcat(&as->rodata, s);
+    free(s);
+
+    // Members go down from the first word, so the last one comes first
+    for (size_t i = nwords; i-- > 0;)
     {
-        asm_gen_expr(as, node->function_call_args[i]);
-        NodeDType type = node_type_from_node(node->function_call_args[i], as->scope);
+        const char *value = words[i] ? words[i] : "0";
+        s = calloc(strlen(value) + 8, sizeof(char));
+        sprintf(s, ".long %s\n", value);
+        util_strcat(&as->rodata, s);
 
-        if (type.type == NODE_STRUCT)
-            asm_gen_push_args_struct(as, node->function_call_args[i]);
+        free(s);
+        free(words[i]);
+    }
+
+    free(words);
+
+    s = calloc(MAX_INT_LEN * 2 + 6, sizeof(char));
+    sprintf(s, ".LR%zu+%zu", as->rodata_label++, (nwords - 1) * 4);
+    return s;
+}
+
+
+void asm_gen_rodata_words(struct Asm *as, struct Node *node, char **words, size_t first)
+{
+    // Filled in the order the members would be stored, nested lists spill into later members
+    for (size_t i = 0; i < node->init_list_len; ++i)
+    {
+        if (node->init_list_values[i]->type == NODE_INIT_LIST)
+        {
+            asm_gen_rodata_words(as, node->init_list_values[i], words, first + i);
+            continue;
+        }
+
+        struct Node *literal = node_strip_to_literal(node->init_list_values[i], as->scope);
+        free(words[first + i]);
+
+        if (literal->type == NODE_INT)
+            words[first + i] = util_int_to_str(literal->int_value);
         else
-            asm_gen_push_args_primitive(as, node->function_call_args[i]);
+        {
+            asm_gen_store_string(as, literal);
+            // Exclude the '$'
+            words[first + i] = util_strcpy(&literal->string_asm_id[1]);
+        }
+    }
+}
+
+
+void asm_gen_function_call(struct Asm *as, struct Node *node)
+{
+    struct Node *func = scope_find_function(as->scope, node->function_call_name, node->error_line);
+
+    errors_asm_check_function_call(as->scope, func, node);
+
+    if (node->function_call_inlined)
+    {
+        util_strcat(&as->root, "# Inlined call\n");
+
+        // Lines of the body are the callee's, in its own source
+        size_t file = as->debug_file;
+        asm_gen_debug_file(as, func->function_def_file);
+        asm_gen_debug_line(as, node->function_call_inlined);
+        asm_gen_expr(as, node->function_call_inlined);
+
+        as->debug_file = file;
+        as->debug_line = 0;
+        return;
     }
+
+    asm_add_inline_copy(as, node->function_call_name);
+
+    size_t nstack = asm_gen_args(as, node, node_conv_nregs(func->function_def_conv, as->args->target));
+    bool ret_struct = func->function_def_return_type.type == NODE_STRUCT;
+    char *s;
+
+    // Struct results are written straight into our frame, or into our caller's result
+    if (ret_struct && node->function_call_return_ptr_stack_offset)
+        asm_gen_load_return_ptr(as, "%eax");
+    else if (ret_struct)
+    {
+        const char *dst = "leal %d(%%ebp), %%eax\n";
+        s = calloc(strlen(dst) + MAX_INT_LEN + 1, sizeof(char));
+        sprintf(s, dst, node->function_call_return_stack_offset);
+        util_strcat(&as->root, s);
+        free(s);
+    }
+
+    const char *template = "# Function call\n"
+                           "call %s\n";
+
+    size_t len = strlen(template) + strlen(node->function_call_name);
+    s = calloc(len + 1, sizeof(char));
+    sprintf(s, template, node->function_call_name);
+    util_strcat(&as->root, s);
+    free(s);
+
+    // The caller pops the pushed args
+    if (nstack)
+    {
+        const char *cleanup = "addl $%zu, %%esp\n";
+        s = calloc(strlen(cleanup) + MAX_INT_LEN + 1, sizeof(char));
+        sprintf(s, cleanup, nstack * 4);
+        util_strcat(&as->root, s);
+        free(s);
+    }
+
+    if (ret_struct)
+        return;
+
+    const char *result = "movl %%eax, %d(%%ebp)\n";
+    s = calloc(strlen(result) + MAX_INT_LEN + 1, sizeof(char));
+    sprintf(s, result, node->function_call_return_stack_offset);
+    util_strcat(&as->root, s);
+    free(s);
+}
+
+
+size_t asm_gen_args(struct Asm *as, struct Node *node, size_t nregs)
+{
+    util_strcat(&as->root, "# Function call args\n");
+
+    size_t nargs = node->function_call_args_size;
+    size_t nstack = 0;
+
+    // Stack args and register args that need code of their own go through
+    // the stack first; the latter would clobber registers already loaded.
+    for (int i = nargs - 1; i >= 0; --i)
+    {
+        if (i < nregs && asm_check_arg_simple(node->function_call_args[i]))
+            continue;
+
+        asm_gen_push_arg(as, node->function_call_args[i]);
+
+        if (i >= nregs)
+            ++nstack;
+    }
+
+    for (size_t i = 0; i < nargs && i < nregs; ++i)
+    {
+        if (asm_check_arg_simple(node->function_call_args[i]))
+            continue;
+
+        char *s = calloc(strlen(g_asm_fastcall_regs[i]) + 7, sizeof(char));
+        sprintf(s, "popl %s\n", g_asm_fastcall_regs[i]);
+        util_strcat(&as->root, s);
+        free(s);
+    }
+
+    for (size_t i = 0; i < nargs && i < nregs; ++i)
+    {
+        if (asm_check_arg_simple(node->function_call_args[i]))
+            asm_gen_load_arg(as, node->function_call_args[i], g_asm_fastcall_regs[i]);
+    }
+
+    return nstack;
+}
+
+
+void asm_gen_load_arg(struct Asm *as, struct Node *node, const char *reg)
+{
+    asm_gen_expr(as, node);
+
+    const char *template = "movl %s, %s\n";
+    char *value = asm_str_from_node(as, node_strip_to_literal(node, as->scope));
+
+    // Structs are passed by pointer
+    if (node_type_from_node(node, as->scope).type == NODE_STRUCT && !asm_check_struct_param(as, node))
+        template = "leal %s, %s\n";
+
+    char *s = calloc(strlen(template) + strlen(value) + strlen(reg) + 1, sizeof(char));
+    sprintf(s, template, value, reg);
+    util_strcat(&as->root, s);
+
+    free(value);
+    free(s);
+}
+
+
+void asm_gen_push_args(struct Asm *as, struct Node *node)
+{
+    util_strcat(&as->root, "# Push function call args\n");
+
+    // Push args on stack backwards so they're in order
+    for (int i = node->function_call_args_size - 1; i >= 0; --i)
+        asm_gen_push_arg(as, node->function_call_args[i]);
+}
+
+
+void asm_gen_push_arg(struct Asm *as, struct Node *node)
+{
+    asm_gen_expr(as, node);
+    NodeDType type = node_type_from_node(node, as->scope);
+
+    if (type.type == NODE_STRUCT)
+        asm_gen_push_args_struct(as, node);
+    else
+        asm_gen_push_args_primitive(as, node);
 }
 
 
@@ -322,9 +973,19 @@ void asm_gen_push_args_primitive(struct Asm *as, struct Node *node)
 void asm_gen_push_args_struct(struct Asm *as, struct Node *node)
 {
     struct Node *list = node_strip_to_literal(node, as->scope);
+
+    // Lists written in the call are only stored here
+    if (node->type == NODE_INIT_LIST)
+        asm_gen_add_to_stack(as, node, node->init_list_stack_offset);
+
     char *value = asm_str_from_node(as, list);
 
-    const char *template = "# Push init list ptr into function call args\n"
+    // Struct params already hold a pointer, pass it on
+    const char *template = asm_check_struct_param(as, node) ?
+                           "# Push struct param ptr into function call args\n"
+                           "movl %s, %%eax\n"
+                           "pushl %%eax\n" :
+                           "# Push init list ptr into function call args\n"
                            "leal %s, %%eax\n"
                            "pushl %%eax\n";
     char *s = calloc(strlen(template) + strlen(value) + 1, sizeof(char));
@@ -339,9 +1000,27 @@ void asm_gen_push_args_struct(struct Asm *as, struct Node *node)
 
 void asm_gen_assignment(struct Asm *as, struct Node *node)
 {
+    // The call writes its result into dst itself, so the copy below is skipped
+    if (asm_check_rvo_assignment(as, node))
+    {
+        int offset;
+        char *base = asm_gen_struct_base(as, node->assignment_dst, "%edx", &offset);
+
+        if (strcmp(base, "%ebp") == 0)
+            node->assignment_src->function_call_return_stack_offset = offset;
+
+        free(base);
+    }
+
     asm_gen_expr(as, node->assignment_src);
     errors_asm_check_assignment(as->scope, node);
 
+    if (node_type_from_node(node->assignment_dst, as->scope).type == NODE_STRUCT)
+    {
+        asm_gen_assignment_struct(as, node);
+        return;
+    }
+
     char *src = asm_str_from_node(as, node->assignment_src);
     char *dst = asm_str_from_node(as, node->assignment_dst);
 
@@ -379,8 +1058,121 @@ void asm_gen_assignment(struct Asm *as, struct Node *node)
 }
 
 
+void asm_gen_assignment_struct(struct Asm *as, struct Node *node)
+{
+    struct Node *src = node->assignment_src;
+
+    if (src->type == NODE_INIT_LIST)
+        asm_gen_add_to_stack(as, src, src->init_list_stack_offset);
+
+    int offset;
+    char *base = asm_gen_struct_base(as, node->assignment_dst, "%edx", &offset);
+
+    asm_gen_copy_struct(as, src, base, offset);
+    free(base);
+}
+
+
+void asm_gen_copy_struct(struct Asm *as, struct Node *src, const char *dst_base, int dst_offset)
+{
+    NodeDType type = node_type_from_node(src, as->scope);
+    struct Node *def = scope_find_struct(as->scope, type.struct_type, src->error_line);
+
+    int src_offset;
+    char *src_base = asm_gen_struct_base(as, src, "%ecx", &src_offset);
+
+    asm_gen_copy(as, src_base, src_offset, dst_base, dst_offset, node_sizeof_struct(def, as->scope));
+    free(src_base);
+}
+
+
+char *asm_gen_struct_base(struct Asm *as, struct Node *node, char *reg, int *offset)
+{
+    *offset = 0;
+
+    if (node->type == NODE_INIT_LIST)
+    {
+        *offset = node->init_list_stack_offset;
+        return util_strcpy("%ebp");
+    }
+
+    if (node->type == NODE_FUNCTION_CALL && !node->function_call_inlined)
+    {
+        *offset = node->function_call_return_stack_offset;
+        return util_strcpy("%ebp");
+    }
+
+    char *value = asm_str_from_node(as, node);
+
+    // Our own locals are addressed from %ebp directly
+    if (!asm_check_struct_param(as, node) && strstr(value, "(%ebp)"))
+    {
+        *offset = atoi(value);
+        free(value);
+        return util_strcpy("%ebp");
+    }
+
+    // Struct params hold a pointer, members of them are addressed through one
+    const char *template = asm_check_struct_param(as, node) ? "movl %s, %s\n" : "leal %s, %s\n";
+    char *s = calloc(strlen(template) + strlen(value) + strlen(reg) + 1, sizeof(char));
+    sprintf(s, template, value, reg);
+    util_strcat(&as->root, s);
+
+    free(s);
+    free(value);
+
+    return util_strcpy(reg);
+}
+
+
+void asm_gen_copy(struct Asm *as, const char *src_base, int src_offset, const char *dst_base, int dst_offset, size_t size)
+{
+    // Results built in place by the callee
+    if (src_offset == dst_offset && strcmp(src_base, dst_base) == 0)
+        return;
+
+    util_strcat(&as->root, "# Copy struct\n");
+
+    if (size <= ASM_COPY_UNROLL_MAX)
+    {
+        for (size_t i = 0; i < size; i += 4)
+        {
+            const char *template = "movl %d(%s), %%eax\n"
+                                   "movl %%eax, %d(%s)\n";
+            char *s = calloc(strlen(template) + strlen(src_base) + strlen(dst_base) + MAX_INT_LEN * 2 + 1, sizeof(char));
+            sprintf(s, template, src_offset - (int)i, src_base, dst_offset - (int)i, dst_base);
+            util_strcat(&as->root, s);
+            free(s);
+        }
+
+        return;
+    }
+
+    // Members go down from the offset, rep movsl copies up from the lowest one.
+    // %esi and %edi belong to our caller.
+    const char *template = "pushl %%esi\n"
+                           "pushl %%edi\n"
+                           "leal %d(%s), %%esi\n"
+                           "leal %d(%s), %%edi\n"
+                           "movl $%zu, %%ecx\n"
+                           "rep movsl\n"
+                           "popl %%edi\n"
+                           "popl %%esi\n";
+    char *s = calloc(strlen(template) + strlen(src_base) + strlen(dst_base) + MAX_INT_LEN * 3 + 1, sizeof(char));
+    sprintf(s, template, src_offset - (int)size + 4, src_base, dst_offset - (int)size + 4, dst_base, size / 4);
+    util_strcat(&as->root, s);
+    free(s);
+}
+
+
 void asm_gen_binop(struct Asm *as, struct Node *node)
 {
+    if (as->args->optimize && asm_check_binop_const(node))
+    {
+        asm_gen_binop_const(as, node);
+        return;
+    }
+
     util_strcat(&as->root, "# Binop left\n");
     asm_gen_expr(as, node->op_l);
     asm_gen_add_to_stack(as, node->op_l, node->op_stack_offset);
@@ -406,83 +1198,811 @@ void asm_gen_binop(struct Asm *as, struct Node *node)
     case OP_MUL:
         util_strcat(&as->root, "imull %eax, %ecx\n"); break;
     case OP_DIV:
-        util_strcat(&as->root, "idivl %ecx\nmovl %eax, %ecx\n"); break;
+        util_strcat(&as->root, "cltd\nidivl %ecx\nmovl %eax, %ecx\n"); break;
+    case OP_MOD:
+        util_strcat(&as->root, "cltd\nidivl %ecx\nmovl %edx, %ecx\n"); break;
     case OP_CMP:
+    case OP_NE:
+    case OP_LT:
+    case OP_LE:
+    case OP_GT:
+    case OP_GE:
         asm_gen_binop_cmp(as, node);
     }
 }
 
 
-void asm_gen_binop_cmp(struct Asm *as, struct Node *node)
+void asm_gen_binop_const(struct Asm *as, struct Node *node)
+{
+    struct Node *value = node->op_l;
+    struct Node *k = node->op_r;
+
+    if (k->type != NODE_INT)
+    {
+        value = node->op_r;
+        k = node->op_l;
+    }
+
+    util_strcat(&as->root, "# Binop by constant\n");
+    asm_gen_expr(as, value);
+
+    char *src = asm_str_from_node(as, value);
+    const char *tmp = "movl %s, %%eax\n";
+    char *s = calloc(strlen(tmp) + strlen(src) + 1, sizeof(char));
+    sprintf(s, tmp, src);
+    util_strcat(&as->root, s);
+    free(s);
+    free(src);
+
+    s = asm_str_from_binop_const(node->op_type, k->int_value);
+    util_strcat(&as->root, s);
+    free(s);
+}
+
+void asm_gen_binop_cmp(struct Asm *as, struct Node *node)
+{
+    // Left operand in %eax, right in %ecx; no branches to mispredict
+    const char *tmp = "cmpl %%ecx, %%eax\n"
+                      "set%s %%cl\n"
+                      "movzbl %%cl, %%ecx\n";
+
+    const char *cc = asm_cc_from_op(node->op_type, false);
+    char *s = calloc(strlen(tmp) + strlen(cc) + 1, sizeof(char));
+    sprintf(s, tmp, cc);
+    util_strcat(&as->root, s);
+    free(s);
+}
+
+
+void asm_gen_inline_asm(struct Asm *as, struct Node *node)
+{
+    char *s = calloc(1, sizeof(char));
+
+    for (size_t i = 0; i < node->asm_nargs; ++i)
+    {
+        asm_gen_expr(as, node->asm_args[i]);
+        struct Node *literal = node_strip_to_literal(node->asm_args[i], as->scope);
+
+        char *tmp;
+
+        if (literal->type == NODE_STRING)
+            tmp = literal->string_value;
+        else
+            tmp = asm_str_from_node(as, literal);
+
+        util_strcat(&s, tmp);
+    }
+
+    // Markers keep the optimizer away from user assembly
+    util_strcat(&as->root, "#APP\n");
+    util_strcat(&as->root, s);
+    free(s);
+
+    util_strcat(&as->root, "\n#NO_APP\n");
+}
+
+
+void asm_gen_if_statement(struct Asm *as, struct Node *node)
+{
+    const char *label_template = ".L%zu";
+    size_t end = as->func_label++;
+    char *label = calloc(strlen(label_template) + MAX_INT_LEN + 1, sizeof(char));
+    sprintf(label, label_template, end);
+
+    char *str;
+
+    if (as->args->optimize && asm_check_select(as, node))
+    {
+        asm_gen_select(as, node);
+        free(label);
+        return;
+    }
+
+    if (as->args->profile_generate && node->profile_key)
+        asm_gen_profile_counter(as, node->profile_key);
+
+    // Cold bodies are branched to instead of over, so the hot path falls through
+    bool cold = asm_check_cold_if(as, node);
+    size_t body = end;
+
+    if (cold)
+    {
+        body = as->func_label++;
+        sprintf(label, label_template, body);
+    }
+
+    // Comparisons branch on their own flags instead of a materialized 0 or 1
+    if (asm_check_cmp(node->if_cond))
+    {
+        asm_gen_cmp(as, node->if_cond);
+
+        const char *tmp = "j%s %s\n";
+        const char *cc = asm_cc_from_op(node->if_cond->op_type, !cold);
+        str = calloc(strlen(tmp) + strlen(cc) + strlen(label) + 1, sizeof(char));
+        sprintf(str, tmp, cc, label);
+    }
+    else
+    {
+        asm_gen_expr(as, node->if_cond);
+        char *s = asm_str_from_node(as, node->if_cond);
+
+        const char *tmp = cold ? "cmpl $0, %s\n"
+                                 "jne %s\n"
+                               : "cmpl $0, %s\n"
+                                 "je %s\n";
+        str = calloc(strlen(tmp) + strlen(s) + strlen(label) + 1, sizeof(char));
+        sprintf(str, tmp, s, label);
+        free(s);
+    }
+
+    util_strcat(&as->root, str);
+
+    if (cold)
+        asm_gen_cold(as, node, body, end);
+    else
+    {
+        asm_gen_profile_taken(as, node);
+        asm_gen_expr(as, node->if_body);
+    }
+
+    sprintf(label, label_template, end);
+    util_strcat(&as->root, label);
+    util_strcat(&as->root, ":\n");
+
+    free(label);
+    free(str);
+}
+
+
+void asm_gen_cold(struct Asm *as, struct Node *node, size_t label, size_t end)
+{
+    char *root = as->root;
+    as->root = calloc(MAX_INT_LEN + 5, sizeof(char));
+    sprintf(as->root, ".L%zu:\n", label);
+
+    bool in_cold = as->in_cold;
+    as->in_cold = true;
+    // Its section starts with no line, even when the body is on the if's
+    as->debug_line = 0;
+
+    asm_gen_profile_taken(as, node);
+
+    if (as->args->target == TARGET_X86_64)
+        asm64_gen_expr(as, node->if_body);
+    else
+        asm_gen_expr(as, node->if_body);
+
+    as->in_cold = in_cold;
+    // The code this goes back to needs its line again
+    as->debug_line = 0;
+
+    const char *back = "jmp .L%zu\n";
+    char *s = calloc(strlen(back) + MAX_INT_LEN + 1, sizeof(char));
+    sprintf(s, back, end);
+    util_strcat(&as->root, s);
+    free(s);
+
+    // Nested cold bodies were already added, this one goes after them
+    util_strcat(&as->cold, as->root);
+    free(as->root);
+    as->root = root;
+
+    ++g_stats.cold_blocks;
+}
+
+
+void asm_gen_cold_blocks(struct Asm *as, struct Node *node)
+{
+    if (!as->cold[0])
+        return;
+
+    // Only hot code is left in the function's own section
+    if (as->args->optimize)
+    {
+        const char *section = ".section .text.unlikely.%s,\"ax\",@progbits\n";
+        char *s = calloc(strlen(section) + strlen(node->function_def_name) + 1, sizeof(char));
+        sprintf(s, section, node->function_def_name);
+        util_strcat(&as->root, s);
+        free(s);
+    }
+
+    if (!as->args->debug)
+    {
+        util_strcat(&as->root, as->cold);
+        as->cold[0] = '\0';
+        return;
+    }
+
+    // A symbol and unwind info of their own, entered with the frame set up
+    const char *start = ".type %s.cold, @function\n"
+                        "%s.cold:\n"
+                        ".cfi_startproc\n"
+                        "%s";
+    const char *cfa = as->args->target == TARGET_X86_64 ? ".cfi_def_cfa %rbp, 16\n"
+                                                          ".cfi_offset %rbp, -16\n"
+                                                        : ".cfi_def_cfa %ebp, 8\n"
+                                                          ".cfi_offset %ebp, -8\n";
+    char *name = node->function_def_name;
+
+    char *s = calloc(strlen(start) + strlen(name) * 2 + strlen(cfa) + 1, sizeof(char));
+    sprintf(s, start, name, name, cfa);
+    util_strcat(&as->root, s);
+    free(s);
+
+    util_strcat(&as->root, as->cold);
+    as->cold[0] = '\0';
+
+    const char *end = ".cfi_endproc\n"
+                      ".size %s.cold, .-%s.cold\n";
+    s = calloc(strlen(end) + strlen(name) * 2 + 1, sizeof(char));
+    sprintf(s, end, name, name);
+    util_strcat(&as->root, s);
+    free(s);
+}
+
+
+void asm_gen_cmp(struct Asm *as, struct Node *node)
+{
+    util_strcat(&as->root, "# Compare\n");
+    asm_gen_expr(as, node->op_l);
+
+    char *l;
+
+    if (asm_check_arg_simple(node->op_r))
+    {
+        l = asm_str_from_node(as, node->op_l);
+
+        // Only one operand can be in memory and the immediate has to be on the right
+        if (l[0] == '$' || (MEMORY_REF(l) && node->op_r->type == NODE_VARIABLE))
+        {
+            const char *tmp = "movl %s, %%eax\n";
+            char *s = calloc(strlen(tmp) + strlen(l) + 1, sizeof(char));
+            sprintf(s, tmp, l);
+            util_strcat(&as->root, s);
+            free(s);
+            free(l);
+
+            l = util_strcpy("%eax");
+        }
+    }
+    else
+    {
+        // The right operand's code would overwrite the left one's register
+        asm_gen_add_to_stack(as, node->op_l, node->op_stack_offset);
+
+        l = calloc(MAX_INT_LEN + 8, sizeof(char));
+        sprintf(l, "%d(%%ebp)", node->op_stack_offset);
+    }
+
+    asm_gen_expr(as, node->op_r);
+    char *r = asm_str_from_node(as, node->op_r);
+
+    if (MEMORY_REF(l) && MEMORY_REF(r))
+    {
+        const char *tmp = "movl %s, %%eax\n";
+        char *s = calloc(strlen(tmp) + strlen(r) + 1, sizeof(char));
+        sprintf(s, tmp, r);
+        util_strcat(&as->root, s);
+        free(s);
+        free(r);
+
+        r = util_strcpy("%eax");
+    }
+
+    const char *tmp = "cmpl %s, %s\n";
+    char *s = calloc(strlen(tmp) + strlen(l) + strlen(r) + 1, sizeof(char));
+    sprintf(s, tmp, r, l);
+    util_strcat(&as->root, s);
+
+    free(s);
+    free(l);
+    free(r);
+}
+
+
+void asm_gen_while(struct Asm *as, struct Node *node)
+{
+    size_t top = as->func_label++;
+    size_t cond = as->func_label++;
+    char *s;
+
+    struct Node *literal = node_strip_to_literal(node->while_cond, as->scope);
+
+    // Constant conditions don't need to be tested
+    if (literal->type == NODE_INT && !literal->int_value)
+        return;
+
+    if (literal->type != NODE_INT)
+    {
+        // The condition sits below the body, so each iteration only takes one branch
+        s = calloc(MAX_INT_LEN + 9, sizeof(char));
+        sprintf(s, "jmp .L%zu\n", cond);
+        util_strcat(&as->root, s);
+        free(s);
+    }
+
+    asm_gen_loop_top(as, top);
+
+    scope_push_block(as->scope);
+    asm_gen_expr(as, node->while_body);
+    scope_pop_layer(as->scope);
+
+    s = calloc(MAX_INT_LEN + 5, sizeof(char));
+    sprintf(s, ".L%zu:\n", cond);
+    util_strcat(&as->root, s);
+    free(s);
+
+    // Back on the while's line after the body's
+    as->debug_line = 0;
+    asm_gen_debug_loc(as, node->error_line);
+
+    if (literal->type == NODE_INT)
+    {
+        const char *template = "jmp .L%zu\n";
+        s = calloc(strlen(template) + MAX_INT_LEN + 1, sizeof(char));
+        sprintf(s, template, top);
+    }
+    else if (asm_check_cmp(node->while_cond))
+    {
+        asm_gen_cmp(as, node->while_cond);
+
+        const char *template = "j%s .L%zu\n";
+        const char *cc = asm_cc_from_op(node->while_cond->op_type, false);
+        s = calloc(strlen(template) + strlen(cc) + MAX_INT_LEN + 1, sizeof(char));
+        sprintf(s, template, cc, top);
+    }
+    else
+    {
+        asm_gen_expr(as, node->while_cond);
+        char *value = asm_str_from_node(as, node->while_cond);
+
+        const char *template = "cmpl $0, %s\n"
+                               "jne .L%zu\n";
+        s = calloc(strlen(template) + strlen(value) + MAX_INT_LEN + 1, sizeof(char));
+        sprintf(s, template, value, top);
+        free(value);
+    }
+
+    util_strcat(&as->root, s);
+    free(s);
+}
+
+
+void asm_gen_for(struct Asm *as, struct Node *node)
+{
+    scope_push_block(as->scope);
+
+    struct Node *var = node->for_var;
+    scope_add_variable_def(as->scope, var);
+    asm_gen_variable_def(as, var);
+
+    errors_asm_check_loop_range(as->scope, node);
+    asm_gen_expr(as, node->for_end);
+
+    char *end;
+
+    if (node->for_end->type == NODE_INT)
+        end = asm_str_from_node(as, node->for_end);
+    else
+    {
+        // The end is evaluated once, the body can't change it
+        asm_gen_add_to_stack(as, node->for_end, node->for_end_stack_offset);
+
+        end = calloc(MAX_INT_LEN + 8, sizeof(char));
+        sprintf(end, "%d(%%ebp)", node->for_end_stack_offset);
+    }
+
+    if (loop_check_unroll(node, as->args))
+    {
+        for (size_t i = 0; i < node->for_nivs; ++i)
+            scope_add_variable_def(as->scope, node->for_ivs[i]);
+
+        asm_gen_for_unrolled(as, node);
+
+        free(end);
+        scope_pop_layer(as->scope);
+        return;
+    }
+
+    for (size_t i = 0; i < node->for_nivs; ++i)
+    {
+        scope_add_variable_def(as->scope, node->for_ivs[i]);
+        asm_gen_variable_def(as, node->for_ivs[i]);
+    }
+
+    size_t top = as->func_label++;
+    size_t done = as->func_label++;
+
+    char *i = asm_str_from_var_def(as, var);
+    char *s;
+
+    struct Node *start = var->variable_def_value;
+
+    // Loops known to run at least once go straight into the body
+    bool guard = start->type != NODE_INT || node->for_end->type != NODE_INT ||
+                 start->int_value >= node->for_end->int_value;
+
+    if (guard)
+    {
+        const char *template = "# Loop guard\n"
+                               "movl %s, %%eax\n"
+                               "cmpl %s, %%eax\n"
+                               "jge .L%zu\n";
+        s = calloc(strlen(template) + strlen(i) + strlen(end) + MAX_INT_LEN + 1, sizeof(char));
+        sprintf(s, template, i, end, done);
+        util_strcat(&as->root, s);
+        free(s);
+    }
+
+    asm_gen_loop_top(as, top);
+    asm_gen_expr(as, node->for_body);
+
+    const char *step = "# Loop latch\n"
+                       "movl %s, %%eax\n"
+                       "addl $1, %%eax\n"
+                       "movl %%eax, %s\n";
+    s = calloc(strlen(step) + strlen(i) * 2 + 1, sizeof(char));
+    sprintf(s, step, i, i);
+    util_strcat(&as->root, s);
+    free(s);
+
+    // Derived variables are stepped along instead of multiplied every iteration
+    for (size_t j = 0; j < node->for_nivs; ++j)
+    {
+        struct Node *iv = node->for_ivs[j];
+
+        const char *template = "addl $%d, %d(%%ebp)\n";
+        s = calloc(strlen(template) + MAX_INT_LEN * 2 + 1, sizeof(char));
+        sprintf(s, template, iv->variable_def_value->op_r->int_value, iv->variable_def_stack_offset);
+        util_strcat(&as->root, s);
+        free(s);
+    }
+
+    const char *test = "cmpl %s, %%eax\n"
+                       "jl .L%zu\n";
+    s = calloc(strlen(test) + strlen(end) + MAX_INT_LEN + 1, sizeof(char));
+    sprintf(s, test, end, top);
+    util_strcat(&as->root, s);
+    free(s);
+
+    if (guard)
+    {
+        s = calloc(MAX_INT_LEN + 5, sizeof(char));
+        sprintf(s, ".L%zu:\n", done);
+        util_strcat(&as->root, s);
+        free(s);
+    }
+
+    free(i);
+    free(end);
+    scope_pop_layer(as->scope);
+}
+
+
+void asm_gen_for_unrolled(struct Asm *as, struct Node *node)
+{
+    struct Node *var = node->for_var;
+
+    for (int v = var->variable_def_value->int_value; v < node->for_end->int_value; ++v)
+    {
+        const char *template = "# Unrolled iteration\n"
+                               "movl $%d, %d(%%ebp)\n";
+        char *s = calloc(strlen(template) + MAX_INT_LEN * 2 + 1, sizeof(char));
+        sprintf(s, template, v, var->variable_def_stack_offset);
+        util_strcat(&as->root, s);
+        free(s);
+
+        for (size_t j = 0; j < node->for_nivs; ++j)
+        {
+            struct Node *iv = node->for_ivs[j];
+
+            const char *tmp = "movl $%d, %d(%%ebp)\n";
+            s = calloc(strlen(tmp) + MAX_INT_LEN * 2 + 1, sizeof(char));
+            sprintf(s, tmp, v * iv->variable_def_value->op_r->int_value, iv->variable_def_stack_offset);
+            util_strcat(&as->root, s);
+            free(s);
+        }
+
+        asm_gen_expr(as, node->for_body);
+    }
+}
+
+
+void asm_gen_loop_top(struct Asm *as, size_t label)
+{
+    // Keeps the loop's first instructions in one fetch block
+    if (as->args->optimize && !as->in_cold)
+        util_strcat(&as->root, ".p2align 4,,10\n");
+
+    char *s = calloc(MAX_INT_LEN + 5, sizeof(char));
+    sprintf(s, ".L%zu:\n", label);
+    util_strcat(&as->root, s);
+    free(s);
+}
+
+void asm_gen_select(struct Asm *as, struct Node *node)
+{
+    struct Node *assignment = node->if_body->compound_nodes[0];
+    errors_asm_check_assignment(as->scope, assignment);
+
+    asm_gen_cmp(as, node->if_cond);
+
+    // Moves leave the flags alone
+    const char *tmp = "# Select\n"
+                      "movl %s, %%eax\n"
+                      "movl %s, %%ecx\n"
+                      "cmov%s %%eax, %%ecx\n"
+                      "movl %%ecx, %s\n";
+
+    char *src = asm_str_from_node(as, assignment->assignment_src);
+    char *dst = asm_str_from_node(as, assignment->assignment_dst);
+    const char *cc = asm_cc_from_op(node->if_cond->op_type, false);
+
+    char *s = calloc(strlen(tmp) + strlen(src) + strlen(dst) * 2 + strlen(cc) + 1, sizeof(char));
+    sprintf(s, tmp, src, dst, cc, dst);
+    util_strcat(&as->root, s);
+
+    free(s);
+    free(src);
+    free(dst);
+}
+
+
+void asm_gen_profile_counter(struct Asm *as, char *key)
+{
+    // Zeroed like .bss, the names are only read by the writer
+    const char *counter = ".pushsection crust_prof,\"aw\",@nobits\n"
+                          ".LP%zu: .skip 4\n"
+                          ".section crust_prof_keys,\"a\"\n"
+                          ".asciz \"%s\"\n"
+                          ".popsection\n";
+    char *s = calloc(strlen(counter) + MAX_INT_LEN + strlen(key) + 1, sizeof(char));
+    sprintf(s, counter, as->profile_label, key);
+    util_strcat(&as->rodata, s);
+    free(s);
+
+    const char *inc = as->args->target == TARGET_X86_64 ? "incl .LP%zu(%%rip)\n" : "incl .LP%zu\n";
+    s = calloc(strlen(inc) + MAX_INT_LEN + 1, sizeof(char));
+    sprintf(s, inc, as->profile_label++);
+    util_strcat(&as->root, s);
+    free(s);
+}
+
+
+void asm_gen_profile_taken(struct Asm *as, struct Node *node)
+{
+    if (!as->args->profile_generate || !node->profile_key)
+        return;
+
+    char *key = calloc(strlen(node->profile_key) + 3, sizeof(char));
+    sprintf(key, "%s:t", node->profile_key);
+    asm_gen_profile_counter(as, key);
+    free(key);
+}
+
+
+void asm_gen_profile_writer(struct Asm *as)
+{
+    util_strcat(&as->data, ".LPF: .asciz \"" PROFILE_FILE "\"\n");
+
+    // open(PROFILE_FILE, O_WRONLY | O_CREAT | O_TRUNC, 0644), then the
+    // names' length, the names and the counts are written to it
+    util_strcat(&as->root, "# Write profile\n"
+                           "pushl %eax\n"
+                           "movl $5, %eax\n"
+                           "movl $.LPF, %ebx\n"
+                           "movl $577, %ecx\n"
+                           "movl $420, %edx\n"
+                           "int $0x80\n"
+                           "movl %eax, %ebx\n"
+                           "movl $__stop_crust_prof_keys, %eax\n"
+                           "subl $__start_crust_prof_keys, %eax\n"
+                           "pushl %eax\n"
+                           "movl $4, %eax\n"
+                           "movl %esp, %ecx\n"
+                           "movl $4, %edx\n"
+                           "int $0x80\n"
+                           "movl $4, %eax\n"
+                           "movl $__start_crust_prof_keys, %ecx\n"
+                           "movl (%esp), %edx\n"
+                           "int $0x80\n"
+                           "movl $4, %eax\n"
+                           "movl $__start_crust_prof, %ecx\n"
+                           "movl $__stop_crust_prof, %edx\n"
+                           "subl %ecx, %edx\n"
+                           "int $0x80\n"
+                           "movl $6, %eax\n"
+                           "int $0x80\n"
+                           "addl $4, %esp\n"
+                           "popl %eax\n");
+}
+
+
+void asm_gen_trace_enter(struct Asm *as, struct Node *node)
+{
+    // Dead functions are dropped once generated, but their entry couldn't be
+    if (!node->function_def_is_dead)
+    {
+        const char *entry = ".pushsection crust_trace_names,\"a\"\n"
+                            ".asciz \"%s\"\n"
+                            ".section crust_trace_addrs,\"a\"\n"
+                            ".p2align 2\n"
+                            ".long %s\n"
+                            ".popsection\n";
+        char *s = calloc(strlen(entry) + strlen(node->function_def_name) * 2 + 1, sizeof(char));
+        sprintf(s, entry, node->function_def_name, node->function_def_name);
+        util_strcat(&as->rodata, s);
+        free(s);
+    }
+
+    asm_gen_trace_call(as, "crust_trace_enter");
+}
+
+
+void asm_gen_trace_call(struct Asm *as, const char *hook)
 {
-    const char *tmp = "cmpl %%eax, %%ecx\n"
-                      "jne .L%zu\n" // label
-                      "movl $1, %%ecx\n"
-                      "jmp .L%zu\n" // label + 1
-                      ".L%zu:\n" // label
-                      "movl $0, %%ecx\n"
-                      ".L%zu:\n"; // label + 1
+    const char *call = as->args->target == TARGET_X86_64 ? "pushq $%s\n"
+                                                           "call %s\n"
+                                                           "addq $8, %%rsp\n"
+                                                         : "pushl $%s\n"
+                                                           "call %s\n"
+                                                           "addl $4, %%esp\n";
+    char *name = as->curr_func->function_def_name;
+
+    char *s = calloc(strlen(call) + strlen(name) + strlen(hook) + 1, sizeof(char));
+    sprintf(s, call, name, hook);
+    util_strcat(&as->root, s);
+    free(s);
+}
 
-    size_t len = strlen(tmp) + MAX_INT_LEN * 4;
-    char *s = calloc(len + 1, sizeof(char));
-    sprintf(s, tmp, as->func_label, as->func_label + 1, as->func_label, as->func_label + 1);
+
+void asm_gen_trace_hooks(struct Asm *as)
+{
+    const char *buffer = ".pushsection .bss\n"
+                         ".p2align 4\n"
+                         ".LTB: .skip %d\n"
+                         ".LTP: .skip 4\n"
+                         ".popsection\n";
+    char *s = calloc(strlen(buffer) + MAX_INT_LEN + 1, sizeof(char));
+    sprintf(s, buffer, TRACE_RECORDS * TRACE_RECORD_SIZE);
+    util_strcat(&as->rodata, s);
+    free(s);
+
+    // Called with the function's address pushed, and push their kind of
+    // event. The event index wraps around, shifted by the record size.
+    const char *hooks = "# Function trace hooks\n"
+                        ".globl crust_trace_enter\n"
+                        ".globl crust_trace_exit\n"
+                        "crust_trace_exit:\n"
+                        "pushl $%d\n"
+                        "jmp .LTH\n"
+                        "crust_trace_enter:\n"
+                        "pushl $%d\n"
+                        ".LTH:\n"
+                        "pushl %%eax\n"
+                        "pushl %%ecx\n"
+                        "pushl %%edx\n"
+                        "rdtsc\n"
+                        "movl .LTP, %%ecx\n"
+                        "andl $%d, %%ecx\n"
+                        "shll $4, %%ecx\n"
+                        "movl %%eax, .LTB(%%ecx)\n"
+                        "movl %%edx, .LTB+4(%%ecx)\n"
+                        "movl 20(%%esp), %%eax\n"
+                        "movl %%eax, .LTB+8(%%ecx)\n"
+                        "movl 12(%%esp), %%eax\n"
+                        "movl %%eax, .LTB+12(%%ecx)\n"
+                        "incl .LTP\n"
+                        "popl %%edx\n"
+                        "popl %%ecx\n"
+                        "popl %%eax\n"
+                        "addl $4, %%esp\n"
+                        "ret\n";
+    s = calloc(strlen(hooks) + MAX_INT_LEN * 3 + 1, sizeof(char));
+    sprintf(s, hooks, TRACE_EXIT, TRACE_ENTER, TRACE_RECORDS - 1);
     util_strcat(&as->root, s);
     free(s);
+}
+
 
-    as->func_label += 3;
+void asm_gen_trace_writer(struct Asm *as)
+{
+    util_strcat(&as->data, ".LTF: .asciz \"" TRACE_FILE "\"\n");
+
+    // Same as asm_gen_profile_writer, then the event count and the buffer
+    const char *writer = "# Write trace\n"
+                         "pushl %%eax\n"
+                         "movl $5, %%eax\n"
+                         "movl $.LTF, %%ebx\n"
+                         "movl $577, %%ecx\n"
+                         "movl $420, %%edx\n"
+                         "int $0x80\n"
+                         "movl %%eax, %%ebx\n"
+                         "movl $__stop_crust_trace_names, %%eax\n"
+                         "subl $__start_crust_trace_names, %%eax\n"
+                         "pushl %%eax\n"
+                         "movl $4, %%eax\n"
+                         "movl %%esp, %%ecx\n"
+                         "movl $4, %%edx\n"
+                         "int $0x80\n"
+                         "movl $4, %%eax\n"
+                         "movl $__start_crust_trace_names, %%ecx\n"
+                         "movl (%%esp), %%edx\n"
+                         "int $0x80\n"
+                         "movl $4, %%eax\n"
+                         "movl $__start_crust_trace_addrs, %%ecx\n"
+                         "movl $__stop_crust_trace_addrs, %%edx\n"
+                         "subl %%ecx, %%edx\n"
+                         "int $0x80\n"
+                         "movl $4, %%eax\n"
+                         "movl $.LTP, %%ecx\n"
+                         "movl $4, %%edx\n"
+                         "int $0x80\n"
+                         "movl $4, %%eax\n"
+                         "movl $.LTB, %%ecx\n"
+                         "movl $%d, %%edx\n"
+                         "int $0x80\n"
+                         "movl $6, %%eax\n"
+                         "int $0x80\n"
+                         "addl $4, %%esp\n"
+                         "popl %%eax\n";
+    char *s = calloc(strlen(writer) + MAX_INT_LEN + 1, sizeof(char));
+    sprintf(s, writer, TRACE_RECORDS * TRACE_RECORD_SIZE);
+    util_strcat(&as->root, s);
+    free(s);
 }
 
 
-void asm_gen_inline_asm(struct Asm *as, struct Node *node)
+void asm_gen_debug_file(struct Asm *as, char *path)
 {
-    char *s = calloc(1, sizeof(char));
+    if (!as->args->debug || !path)
+        return;
 
-    for (size_t i = 0; i < node->asm_nargs; ++i)
-    {
-        asm_gen_expr(as, node->asm_args[i]);
-        struct Node *literal = node_strip_to_literal(node->asm_args[i], as->scope);
+    size_t i = 0;
 
-        char *tmp;
+    while (i < as->ndebug_files && strcmp(as->debug_files[i], path) != 0)
+        ++i;
 
-        if (literal->type == NODE_STRING)
-            tmp = literal->string_value;
-        else
-            tmp = asm_str_from_node(as, literal);
+    // Numbered once for the whole unit, before any .loc can name it
+    if (i == as->ndebug_files)
+    {
+        as->debug_files = realloc(as->debug_files, sizeof(char*) * ++as->ndebug_files);
+        as->debug_files[i] = util_strcpy(path);
 
-        util_strcat(&s, tmp);
+        const char *file = ".file %zu \"%s\"\n";
+        char *s = calloc(strlen(file) + MAX_INT_LEN + strlen(path) + 1, sizeof(char));
+        sprintf(s, file, i + 1, path);
+        util_strcat(&as->data, s);
+        free(s);
     }
 
-    util_strcat(&as->root, s);
-    free(s);
-
-    util_strcat(&as->root, "\n");
+    as->debug_file = i + 1;
+    as->debug_line = 0;
 }
 
 
-void asm_gen_if_statement(struct Asm *as, struct Node *node)
+void asm_gen_debug_line(struct Asm *as, struct Node *node)
 {
-    asm_gen_expr(as, node->if_cond);
-    char *s = asm_str_from_node(as, node->if_cond);
-
-    const char *label_template = ".L%zu";
-    char *label = calloc(strlen(label_template) + MAX_INT_LEN + 1, sizeof(char));
-    sprintf(label, label_template, as->func_label);
-    ++as->func_label;
+    // These generate their code elsewhere, or none at all
+    if (node->type == NODE_FUNCTION_DEF || node->type == NODE_STRUCT || node->type == NODE_INCLUDE)
+        return;
 
-    const char *tmp = "cmpl $0, %s\n"
-                      "je %s\n";
-    char *str = calloc(strlen(tmp) + strlen(s) + strlen(label) + 1, sizeof(char));
-    sprintf(str, tmp, s, label);
-    util_strcat(&as->root, str);
+    asm_gen_debug_loc(as, node->error_line);
+}
 
-    asm_gen_expr(as, node->if_body);
 
-    util_strcat(&as->root, label);
-    util_strcat(&as->root, ":");
+void asm_gen_debug_loc(struct Asm *as, size_t line)
+{
+    if (!as->args->debug || !as->debug_file || !line || line == as->debug_line)
+        return;
 
-    free(label);
-    free(str);
+    const char *loc = ".loc %zu %zu\n";
+    char *s = calloc(strlen(loc) + MAX_INT_LEN * 2 + 1, sizeof(char));
+    sprintf(s, loc, as->debug_file, line);
+    util_strcat(&as->root, s);
     free(s);
+
+    as->debug_line = line;
 }
 
 
@@ -528,6 +2048,10 @@ char *asm_str_from_var(struct Asm *as, struct Node *node)
 {
     struct Node *var = scope_find_variable(as->scope, node, node->error_line);
 
+    // Members of lists that never change are read as immediates
+    if (node->variable_struct_member && node_strip_member_to_literal(node, as->scope) != node)
+        return asm_str_from_node(as, node_strip_member_to_literal(node, as->scope));
+
     if (var->type == NODE_VARIABLE)
         return asm_str_from_var_var(as, node);
     else if (var->type == NODE_VARIABLE_DEF)
@@ -592,6 +2116,17 @@ char *asm_str_from_var_def(struct Asm *as, struct Node *node)
 
 char *asm_str_from_function_call(struct Asm *as, struct Node *node)
 {
+    if (node->function_call_inlined)
+        return asm_str_from_node(as, node->function_call_inlined);
+
+    // Struct results stay where the callee wrote them
+    if (node_type_from_node(node, as->scope).type == NODE_STRUCT)
+    {
+        char *s = calloc(MAX_INT_LEN + 8, sizeof(char));
+        sprintf(s, "%d(%%ebp)", node->function_call_return_stack_offset);
+        return s;
+    }
+
     const char *template = "# Get function call return value: avoiding too many memory references\n"
                            "movl %d(%%ebp), %%ecx\n";
     char *s = calloc(strlen(template) + MAX_INT_LEN + 1, sizeof(char));
@@ -609,6 +2144,118 @@ char *asm_str_from_binop(struct Asm *as, struct Node *node)
 }
 
 
+char *asm_str_from_binop_const(int op, int k)
+{
+    // Operand in %eax, result in %ecx like the other binops
+    char *s = calloc(1, sizeof(char));
+    char buf[128];
+
+    unsigned abs_k = k < 0 ? -(unsigned)k : (unsigned)k;
+    int shift = 0;
+
+    while (abs_k && !((abs_k >> shift) & 1))
+        ++shift;
+
+    bool pow2 = abs_k && abs_k == 1u << shift;
+
+    if (op == OP_MUL)
+    {
+        int rest = k >> shift;
+
+        if (k == 0)
+            util_strcat(&s, "movl $0, %ecx\n");
+        else if (k == 1)
+            util_strcat(&s, "movl %eax, %ecx\n");
+        else if (k == 2)
+            util_strcat(&s, "leal (%eax,%eax), %ecx\n");
+        else if (k == 4 || k == 8)
+        {
+            sprintf(buf, "leal 0(,%%eax,%d), %%ecx\n", k);
+            util_strcat(&s, buf);
+        }
+        else if (k > 0 && pow2)
+        {
+            sprintf(buf, "movl %%eax, %%ecx\nshll $%d, %%ecx\n", shift);
+            util_strcat(&s, buf);
+        }
+        else if (k > 0 && (rest == 3 || rest == 5 || rest == 9))
+        {
+            sprintf(buf, "leal (%%eax,%%eax,%d), %%ecx\n", rest - 1);
+            util_strcat(&s, buf);
+
+            if (shift)
+            {
+                sprintf(buf, "shll $%d, %%ecx\n", shift);
+                util_strcat(&s, buf);
+            }
+        }
+        else
+        {
+            sprintf(buf, "imull $%d, %%eax, %%ecx\n", k);
+            util_strcat(&s, buf);
+        }
+
+        return s;
+    }
+
+    // Remainders take the dividend's sign, so only the divisor's magnitude matters
+    if (op == OP_MOD)
+        k = (int)abs_k;
+
+    if (abs_k == 1)
+        util_strcat(&s, op == OP_MOD ? "movl $0, %ecx\n" : "movl %eax, %ecx\n");
+    else if (pow2)
+    {
+        // Negative dividends are biased by 2^n - 1 so the shift rounds toward zero
+        sprintf(buf, "movl %%eax, %%ecx\nsarl $31, %%ecx\nshrl $%d, %%ecx\naddl %%eax, %%ecx\n", 32 - shift);
+        util_strcat(&s, buf);
+
+        if (op == OP_MOD)
+            sprintf(buf, "andl $%d, %%ecx\nsubl %%ecx, %%eax\nmovl %%eax, %%ecx\n", -k);
+        else
+            sprintf(buf, "sarl $%d, %%ecx\n", shift);
+
+        util_strcat(&s, buf);
+    }
+    else
+    {
+        int magic, magic_shift;
+        asm_div_magic(k, &magic, &magic_shift);
+
+        // High half of the dividend times the magic number, %ecx keeps the dividend
+        sprintf(buf, "movl %%eax, %%ecx\nmovl $%d, %%edx\nimull %%edx\n", magic);
+        util_strcat(&s, buf);
+
+        if (k > 0 && magic < 0)
+            util_strcat(&s, "addl %ecx, %edx\n");
+        else if (k < 0 && magic > 0)
+            util_strcat(&s, "subl %ecx, %edx\n");
+
+        if (magic_shift)
+        {
+            sprintf(buf, "sarl $%d, %%edx\n", magic_shift);
+            util_strcat(&s, buf);
+        }
+
+        util_strcat(&s, "movl %edx, %eax\nshrl $31, %eax\naddl %eax, %edx\n");
+
+        if (op == OP_MOD)
+        {
+            sprintf(buf, "imull $%d, %%edx, %%edx\nsubl %%edx, %%ecx\n", k);
+            util_strcat(&s, buf);
+        }
+        else
+            util_strcat(&s, "movl %edx, %ecx\n");
+
+        return s;
+    }
+
+    if (op == OP_DIV && k < 0)
+        util_strcat(&s, "negl %ecx\n");
+
+    return s;
+}
+
 char *asm_str_from_init_list(struct Asm *as, struct Node *node)
 {
     const char *tmp = "%d(%%ebp)";
@@ -621,21 +2268,344 @@ char *asm_str_from_init_list(struct Asm *as, struct Node *node)
 
 bool asm_check_lc_defined(struct Asm *as, char *string_asm_id)
 {
-    for (int i = 0; i < strlen(as->data); ++i)
+    // "\n.LCx:", excluding the '$'
+    char *label = calloc(strlen(string_asm_id) + 3, sizeof(char));
+    sprintf(label, "\n%s:", &string_asm_id[1]);
+
+    bool defined = strstr(as->data, label) != 0;
+    free(label);
+
+    return defined;
+}
+
+
+bool asm_check_function_defined(struct Asm *as, char *name)
+{
+    char *label = calloc(strlen(name) + 3, sizeof(char));
+    sprintf(label, "\n%s:", name);
+
+    bool defined = strstr(as->root, label) != 0;
+    free(label);
+
+    return defined;
+}
+
+
+bool asm_check_tail_call(struct Asm *as, struct Node *call)
+{
+    if (!as->args->optimize)
+        return false;
+
+    struct Node *func = scope_find_function(as->scope, call->function_call_name, call->error_line);
+    bool self = strcmp(call->function_call_name, as->curr_func->function_def_name) == 0;
+
+    if (self && !as->tail_label)
+        return false;
+
+    // Struct return values live in the caller's frame
+    if (func->function_def_return_type.type == NODE_STRUCT)
+        return false;
+
+    // Our C caller expects %ebx back, which Crust functions don't keep
+    if (as->curr_func->function_def_conv == CONV_CDECL && func->function_def_conv != CONV_CDECL)
+        return false;
+
+    // Stack args are written over our own, so they have to fit. On x86-64
+    // our pushed args are above the return address too, so none can be used.
+    size_t nregs = node_conv_nregs(func->function_def_conv, as->args->target);
+    size_t our_nregs = node_conv_nregs(as->curr_func->function_def_conv, as->args->target);
+
+    size_t nstack = call->function_call_args_size > nregs ? call->function_call_args_size - nregs : 0;
+    size_t our_nstack = as->curr_func->function_def_params_size > our_nregs ?
+                        as->curr_func->function_def_params_size - our_nregs : 0;
+
+    if (as->args->target == TARGET_X86_64)
+        our_nstack = 0;
+
+    if (nstack > our_nstack)
+        return false;
+
+    for (size_t i = 0; i < call->function_call_args_size; ++i)
+    {
+        struct Node *arg = call->function_call_args[i];
+
+        if (node_type_from_node(arg, as->scope).type != NODE_STRUCT)
+            continue;
+
+        // Structs are passed by pointer; only pointers into the caller's
+        // frame (our own struct params) stay valid once our frame is reused.
+        if (!asm_check_struct_param(as, arg))
+            return false;
+    }
+
+    return true;
+}
+
+
+bool asm_check_struct_param(struct Asm *as, struct Node *node)
+{
+    if (node->type != NODE_VARIABLE || node->variable_struct_member)
+        return false;
+
+    struct Node *var = scope_find_variable(as->scope, node, -1);
+    return var && var->type == NODE_VARIABLE;
+}
+
+
+bool asm_check_rvo_assignment(struct Asm *as, struct Node *node)
+{
+    struct Node *src = node->assignment_src;
+    struct Node *dst = node->assignment_dst;
+
+    if (src->type != NODE_FUNCTION_CALL || src->function_call_inlined || dst->type != NODE_VARIABLE)
+        return false;
+
+    // Struct params point into frames we can't see, they may alias the args
+    if (dst->variable_is_param || node_type_from_node(dst, as->scope).type != NODE_STRUCT)
+        return false;
+
+    // Struct args are passed by reference, the callee would read dst while writing it
+    for (size_t i = 0; i < src->function_call_args_size; ++i)
+    {
+        struct Node *arg = src->function_call_args[i];
+
+        if (arg->type == NODE_VARIABLE && strcmp(arg->variable_name, dst->variable_name) == 0 &&
+            node_type_from_node(arg, as->scope).type == NODE_STRUCT)
+            return false;
+    }
+
+    return true;
+}
+
+
+bool asm_check_init_list_rodata(struct Asm *as, struct Node *node)
+{
+    return as->args->optimize && node_sizeof_dtype(node) > ASM_COPY_UNROLL_MAX &&
+           asm_check_init_list_const(as, node);
+}
+
+
+bool asm_check_init_list_const(struct Asm *as, struct Node *node)
+{
+    for (size_t i = 0; i < node->init_list_len; ++i)
+    {
+        struct Node *value = node->init_list_values[i];
+
+        if (value->type == NODE_INIT_LIST)
+        {
+            if (!asm_check_init_list_const(as, value))
+                return false;
+
+            continue;
+        }
+
+        struct Node *literal = node_strip_to_literal(value, as->scope);
+
+        if (literal->type != NODE_INT && literal->type != NODE_STRING)
+            return false;
+    }
+
+    return true;
+}
+
+
+bool asm_check_cmp(struct Node *node)
+{
+    return node->type == NODE_BINOP && node->op_type >= OP_CMP && node->op_type <= OP_GE;
+}
+
+
+bool asm_check_binop_const(struct Node *node)
+{
+    if (node->op_type == OP_MUL)
+        return node->op_l->type == NODE_INT || node->op_r->type == NODE_INT;
+
+    // Division by zero is left to trap at run time; INT_MIN has no magnitude
+    if (node->op_type == OP_DIV || node->op_type == OP_MOD)
+        return node->op_r->type == NODE_INT && node->op_r->int_value != 0 && node->op_r->int_value != INT_MIN;
+
+    return false;
+}
+
+bool asm_check_select(struct Asm *as, struct Node *node)
+{
+    if (!asm_check_cmp(node->if_cond) || node->if_body->type != NODE_COMPOUND || node->if_body->compound_size != 1)
+        return false;
+
+    struct Node *assignment = node->if_body->compound_nodes[0];
+
+    if (assignment->type != NODE_ASSIGNMENT)
+        return false;
+
+    struct Node *dst = assignment->assignment_dst;
+    struct Node *src = assignment->assignment_src;
+
+    // Both sides are read without code of their own; str labels are tracked
+    // at compile time and can't be selected at run time.
+    if (dst->type != NODE_VARIABLE || dst->variable_struct_member ||
+        node_type_from_node(dst, as->scope).type != NODE_INT)
+        return false;
+
+    if (src->type == NODE_INT)
+        return true;
+
+    return src->type == NODE_VARIABLE && !src->variable_struct_member &&
+           node_type_from_node(src, as->scope).type == NODE_INT;
+}
+
+
+bool asm_check_cold_if(struct Asm *as, struct Node *node)
+{
+    if (!as->args->optimize || node->if_hint == HINT_LIKELY)
+        return false;
+
+    return node->if_hint == HINT_UNLIKELY || asm_find_cold_call(as, node->if_body) ||
+           (as->args->profile_use && profile_check_cold_if(node));
+}
+
+
+bool asm_find_cold_call(struct Asm *as, struct Node *node)
+{
+    switch (node->type)
     {
-        if (as->data[i] == '\n')
+    case NODE_COMPOUND:
+        for (size_t i = 0; i < node->compound_size; ++i)
         {
-            int prev = i;
-            char buf[MAX_INT_LEN + 3] = { 0 };
+            if (asm_find_cold_call(as, node->compound_nodes[i]))
+                return true;
+        }
+
+        return false;
+
+    case NODE_FUNCTION_CALL:
+    {
+        struct Node *def = scope_find_function(as->scope, node->function_call_name, -1);
 
-            while (as->data[i] != '\0' && as->data[++i] != ':')
-                buf[i - prev - 1] = as->data[i];
+        if (def && def->function_def_is_cold)
+            return true;
 
-            if (strcmp(&string_asm_id[1], buf) == 0)
+        // Calls in inlined bodies are made from here
+        if (node->function_call_inlined)
+            return asm_find_cold_call(as, node->function_call_inlined);
+
+        for (size_t i = 0; i < node->function_call_args_size; ++i)
+        {
+            if (asm_find_cold_call(as, node->function_call_args[i]))
                 return true;
         }
+
+        return false;
     }
 
-    return false;
+    case NODE_BINOP: return asm_find_cold_call(as, node->op_l) || asm_find_cold_call(as, node->op_r);
+    case NODE_VARIABLE_DEF: return asm_find_cold_call(as, node->variable_def_value);
+    case NODE_ASSIGNMENT: return asm_find_cold_call(as, node->assignment_src);
+    case NODE_RETURN: return asm_find_cold_call(as, node->return_value);
+    case NODE_IF: return asm_find_cold_call(as, node->if_body);
+    case NODE_WHILE: return asm_find_cold_call(as, node->while_body);
+    case NODE_FOR: return asm_find_cold_call(as, node->for_body);
+
+    default: return false;
+    }
+}
+
+
+const char *asm_cc_from_op(int op, bool negate)
+{
+    switch (op)
+    {
+    case OP_CMP: return negate ? "ne" : "e";
+    case OP_NE: return negate ? "e" : "ne";
+    case OP_LT: return negate ? "ge" : "l";
+    case OP_LE: return negate ? "g" : "le";
+    case OP_GT: return negate ? "le" : "g";
+    case OP_GE: return negate ? "l" : "ge";
+    }
+
+    return 0;
+}
+
+
+void asm_div_magic(int d, int *magic, int *shift)
+{
+    // Hacker's Delight, 10-1: smallest p where 2^p / d rounded up stays exact
+    // for every 32 bit dividend
+    const unsigned two31 = 0x80000000;
+
+    unsigned ad = d < 0 ? -(unsigned)d : (unsigned)d;
+    unsigned t = two31 + ((unsigned)d >> 31);
+    unsigned anc = t - 1 - t % ad;
+
+    unsigned q1 = two31 / anc, r1 = two31 - q1 * anc;
+    unsigned q2 = two31 / ad, r2 = two31 - q2 * ad;
+    unsigned delta;
+    int p = 31;
+
+    do
+    {
+        ++p;
+
+        q1 *= 2;
+        r1 *= 2;
+
+        if (r1 >= anc)
+        {
+            ++q1;
+            r1 -= anc;
+        }
+
+        q2 *= 2;
+        r2 *= 2;
+
+        if (r2 >= ad)
+        {
+            ++q2;
+            r2 -= ad;
+        }
+
+        delta = ad - r2;
+    } while (q1 < delta || (q1 == delta && r1 == 0));
+
+    *magic = (int)(q2 + 1);
+
+    if (d < 0)
+        *magic = -*magic;
+
+    *shift = p - 32;
+}
+
+bool asm_check_arg_simple(struct Node *node)
+{
+    return node->type == NODE_INT || node->type == NODE_STRING || node->type == NODE_VARIABLE;
 }
 
+
+bool asm_find_self_tail_call(struct Node *node, char *name)
+{
+    switch (node->type)
+    {
+    case NODE_COMPOUND:
+        for (size_t i = 0; i < node->compound_size; ++i)
+        {
+            if (asm_find_self_tail_call(node->compound_nodes[i], name))
+                return true;
+        }
+
+        return false;
+
+    case NODE_IF:
+        return asm_find_self_tail_call(node->if_body, name);
+
+    case NODE_WHILE:
+        return asm_find_self_tail_call(node->while_body, name);
+
+    case NODE_FOR:
+        return asm_find_self_tail_call(node->for_body, name);
+
+    case NODE_RETURN:
+        return node->return_value->type == NODE_FUNCTION_CALL &&
+               strcmp(node->return_value->function_call_name, name) == 0;
+
+    default: return false;
+    }
+}
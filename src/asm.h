@@ -5,16 +5,54 @@
 #include "scope.h"
 #include "args.h"
 
+#define MAX_INT_LEN 10
+// Struct copies up to this many bytes are unrolled into moves
+#define ASM_COPY_UNROLL_MAX 32
+#define MEMORY_REF(x) (isdigit(x[0]) || x[0] == '-')
+
+// Registers of the first args of Crust to Crust calls, see CONV_FASTCALL.
+// Return values are in %eax and callers pop the args they pushed.
+#define ASM_NREGARGS 2
+
+extern const char *g_asm_fastcall_regs[ASM_NREGARGS];
+
 struct Asm
 {
+    // String literals
     char *data;
+    // Init lists made only of literals, copied into frames as blocks. With -O
+    // they and functions each get a section --gc-sections can drop.
+    char *rodata;
     char *root;
+    // Cold if bodies of the function being generated, appended after its code
+    char *cold;
+    // Generating a cold function or body, which isn't worth aligning
+    bool in_cold;
 
     struct Scope *scope;
 
     struct Args *args;
 
     size_t func_label;
+    size_t rodata_label;
+    // Counters of -fprofile-generate
+    size_t profile_label;
+
+    // Function being generated
+    struct Node *curr_func;
+    // Label self tail calls jump back to, 0 if there is none
+    size_t tail_label;
+
+    // Inline functions called out of line, given a local copy at the end of
+    // the unit unless it defines them itself
+    struct Node **inline_copies;
+    size_t ninline_copies;
+
+    // Sources given a .file number for -g, numbered from 1, and the file
+    // and line the last .loc named
+    char **debug_files;
+    size_t ndebug_files;
+    size_t debug_file, debug_line;
 };
 
 struct Asm *asm_alloc(struct Args *args, bool main);
@@ -23,27 +61,104 @@ void asm_free(struct Asm *as);
 void asm_gen_expr(struct Asm *as, struct Node *node);
 
 void asm_gen_function_def(struct Asm *as, struct Node *node);
+// Comment, section and label every function starts with
+void asm_gen_function_label(struct Asm *as, struct Node *node);
+// Ends the function's unwind info and symbol, then adds its cold bodies
+void asm_gen_function_end(struct Asm *as, struct Node *node);
 void asm_gen_return(struct Asm *as, struct Node *node);
+// Restores the callee saved registers and our caller's frame
+// Struct returning functions copy their value to the pointer they were passed
+void asm_gen_return_struct(struct Asm *as, struct Node *node);
+// Stores the members through the caller's pointer without building the value first
+void asm_gen_return_init_list(struct Asm *as, struct Node *node, int offset);
+void asm_gen_load_return_ptr(struct Asm *as, const char *reg);
+void asm_gen_epilogue(struct Asm *as);
+// Code after the ret is still in the function's frame
+void asm_gen_ret(struct Asm *as);
+// Self calls become a jump back to the function start, other calls reuse our frame
+void asm_gen_tail_call(struct Asm *as, struct Node *node);
+// Notes an out-of-line call, which needs a copy if name is an inline function
+void asm_add_inline_copy(struct Asm *as, char *name);
+// Only headers' declarations export inline functions, so calls that weren't
+// inlined would otherwise be left undefined
+void asm_gen_inline_copies(struct Asm *as);
 
 void asm_gen_variable_def(struct Asm *as, struct Node *node);
-// Add a string label to the data section.
+// Add a string label to the mergeable string section.
 void asm_gen_store_string(struct Asm *as, struct Node *node);
+void asm_gen_init_list_rodata(struct Asm *as, struct Node *node, const char *dst_base, int dst_offset);
+// Returns the address of the list's first word in .rodata
+char *asm_gen_rodata(struct Asm *as, struct Node *node);
+void asm_gen_rodata_words(struct Asm *as, struct Node *node, char **words, size_t first);
 // Add data to stack; node must be a literal
 void asm_gen_add_to_stack(struct Asm *as, struct Node *node, int stack_offset);
 
 void asm_gen_function_call(struct Asm *as, struct Node *node);
+// Pushes the stack args and loads the register args. Returns the number of
+// args pushed for the caller to pop.
+size_t asm_gen_args(struct Asm *as, struct Node *node, size_t nregs);
+void asm_gen_load_arg(struct Asm *as, struct Node *node, const char *reg);
 void asm_gen_push_args(struct Asm *as, struct Node *node);
+void asm_gen_push_arg(struct Asm *as, struct Node *node);
 void asm_gen_push_args_primitive(struct Asm *as, struct Node *node);
 void asm_gen_push_args_struct(struct Asm *as, struct Node *node);
 
 void asm_gen_assignment(struct Asm *as, struct Node *node);
+void asm_gen_assignment_struct(struct Asm *as, struct Node *node);
+
+// Copies the struct value src to the struct whose first member is at
+// dst_offset(dst_base); members go down from there.
+void asm_gen_copy_struct(struct Asm *as, struct Node *src, const char *dst_base, int dst_offset);
+// Returns the base register of struct value node's first member and sets
+// *offset, loading reg with a pointer when the struct isn't in our frame.
+char *asm_gen_struct_base(struct Asm *as, struct Node *node, char *reg, int *offset);
+void asm_gen_copy(struct Asm *as, const char *src_base, int src_offset, const char *dst_base, int dst_offset, size_t size);
 
 void asm_gen_binop(struct Asm *as, struct Node *node);
 void asm_gen_binop_cmp(struct Asm *as, struct Node *node);
+// Multiplication, division and modulo by a literal, see asm_str_from_binop_const
+void asm_gen_binop_const(struct Asm *as, struct Node *node);
 
 void asm_gen_inline_asm(struct Asm *as, struct Node *node);
 
 void asm_gen_if_statement(struct Asm *as, struct Node *node);
+// Generates the if's body into as->cold under label, jumping back to end
+void asm_gen_cold(struct Asm *as, struct Node *node, size_t label, size_t end);
+// Emits the function's cold bodies after its code, in .text.unlikely with -O
+void asm_gen_cold_blocks(struct Asm *as, struct Node *node);
+// Sets the flags for op_l compared to op_r, taking operands from registers,
+// immediates and their slots where it can
+void asm_gen_cmp(struct Asm *as, struct Node *node);
+// if c { x = y; } as a cmov, see asm_check_select
+void asm_gen_select(struct Asm *as, struct Node *node);
+
+void asm_gen_while(struct Asm *as, struct Node *node);
+void asm_gen_for(struct Asm *as, struct Node *node);
+void asm_gen_for_unrolled(struct Asm *as, struct Node *node);
+// Aligned label loops jump back to
+void asm_gen_loop_top(struct Asm *as, size_t label);
+
+// Counts each time it's run in the program's profile, see profile.h
+void asm_gen_profile_counter(struct Asm *as, char *key);
+// Counts the runs of an if's body
+void asm_gen_profile_taken(struct Asm *as, struct Node *node);
+// Writes the counters to PROFILE_FILE once main returns, exit code in %eax
+void asm_gen_profile_writer(struct Asm *as);
+
+// Adds the function to the trace's symbol map and calls the entry hook
+void asm_gen_trace_enter(struct Asm *as, struct Node *node);
+// Calls crust_trace_enter or crust_trace_exit for the current function
+void asm_gen_trace_call(struct Asm *as, const char *hook);
+// The ring buffer and the hooks filling it, see trace.h
+void asm_gen_trace_hooks(struct Asm *as);
+// Writes the symbol map and the buffer to TRACE_FILE, exit code in %eax
+void asm_gen_trace_writer(struct Asm *as);
+
+// Line tables of -g. Files are numbered as functions from them are
+// generated, and statements that generate code where they stand get a .loc.
+void asm_gen_debug_file(struct Asm *as, char *path);
+void asm_gen_debug_line(struct Asm *as, struct Node *node);
+void asm_gen_debug_loc(struct Asm *as, size_t line);
 
 // Get assembly representation of a node (x(%ebp), $.LCx, $x, %ebx, etc.)
 char *asm_str_from_node(struct Asm *as, struct Node *node);
@@ -54,9 +169,36 @@ char *asm_str_from_var_var(struct Asm *as, struct Node *node);
 char *asm_str_from_var_def(struct Asm *as, struct Node *node);
 char *asm_str_from_function_call(struct Asm *as, struct Node *node);
 char *asm_str_from_binop(struct Asm *as, struct Node *node);
+// Instructions computing %eax op k into %ecx with shifts, lea and multiplies
+// by magic numbers instead of idivl. Only uses %eax, %ecx and %edx.
+char *asm_str_from_binop_const(int op, int k);
 char *asm_str_from_init_list(struct Asm *as, struct Node *node);
 
 bool asm_check_lc_defined(struct Asm *as, char *string_asm_id);
+bool asm_check_function_defined(struct Asm *as, char *name);
+// Check if call can replace the current function's frame instead of pushing a new one
+bool asm_check_tail_call(struct Asm *as, struct Node *call);
+bool asm_find_self_tail_call(struct Node *node, char *name);
+// Struct params hold a pointer, other struct values are addressed in our frame
+bool asm_check_struct_param(struct Asm *as, struct Node *node);
+bool asm_check_rvo_assignment(struct Asm *as, struct Node *node);
+// Lists bigger than a few moves that only hold literals are copied from .rodata
+bool asm_check_init_list_rodata(struct Asm *as, struct Node *node);
+bool asm_check_init_list_const(struct Asm *as, struct Node *node);
+bool asm_check_cmp(struct Node *node);
+bool asm_check_binop_const(struct Node *node);
+// If statements that only assign an int to an int variable
+bool asm_check_select(struct Asm *as, struct Node *node);
+// unlikely(...) bodies, bodies calling cold functions and the ones the profile
+// found rarely run, unless the condition is likely(...)
+bool asm_check_cold_if(struct Asm *as, struct Node *node);
+bool asm_find_cold_call(struct Asm *as, struct Node *node);
+// Condition code suffix of a comparison op, for jcc, setcc and cmovcc
+const char *asm_cc_from_op(int op, bool negate);
+// Multiplier and shift for signed division by d with |d| >= 2, not a power of 2
+void asm_div_magic(int d, int *magic, int *shift);
+// Args whose value is available without generating any code
+bool asm_check_arg_simple(struct Node *node);
 
 #endif
 
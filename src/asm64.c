@@ -0,0 +1,1561 @@
+#include "asm64.h"
+#include "util.h"
+#include "errors.h"
+#include "loop.h"
+#include "stats.h"
+#include "profile.h"
+#include "trace.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+const char *g_asm64_arg_regs[ASM64_NREGARGS] = { "%rdi", "%rsi", "%rdx", "%rcx", "%r8", "%r9" };
+
+
+struct Asm *asm64_alloc(struct Args *args, bool main)
+{
+    struct Asm *as = asm_alloc(args, false);
+
+    if (main)
+    {
+        util_strcat(&as->root, ".globl _start\n"
+                               "_start:\n"
+                               "call main\n");
+
+        if (args->profile_generate)
+            asm64_gen_profile_writer(as);
+
+        if (args->instrument_functions)
+            asm64_gen_trace_writer(as);
+
+        // main's return value is the exit code
+        util_strcat(&as->root, "movl %eax, %edi\n"
+                               "movl $60, %eax\n"
+                               "syscall\n");
+
+        if (args->instrument_functions)
+            asm64_gen_trace_hooks(as);
+    }
+
+    return as;
+}
+
+
+void asm64_gen_profile_writer(struct Asm *as)
+{
+    util_strcat(&as->data, ".LPF: .asciz \"" PROFILE_FILE "\"\n");
+
+    // Same as asm_gen_profile_writer with the x86-64 syscalls, which only
+    // clobber %rcx and %r11
+    util_strcat(&as->root, "# Write profile\n"
+                           "pushq %rax\n"
+                           "movl $2, %eax\n"
+                           "leaq .LPF(%rip), %rdi\n"
+                           "movl $577, %esi\n"
+                           "movl $420, %edx\n"
+                           "syscall\n"
+                           "movl %eax, %edi\n"
+                           "leaq __stop_crust_prof_keys(%rip), %rax\n"
+                           "leaq __start_crust_prof_keys(%rip), %rsi\n"
+                           "subq %rsi, %rax\n"
+                           "pushq %rax\n"
+                           "movl $1, %eax\n"
+                           "movq %rsp, %rsi\n"
+                           "movl $4, %edx\n"
+                           "syscall\n"
+                           "movl $1, %eax\n"
+                           "leaq __start_crust_prof_keys(%rip), %rsi\n"
+                           "movq (%rsp), %rdx\n"
+                           "syscall\n"
+                           "movl $1, %eax\n"
+                           "leaq __start_crust_prof(%rip), %rsi\n"
+                           "leaq __stop_crust_prof(%rip), %rdx\n"
+                           "subq %rsi, %rdx\n"
+                           "syscall\n"
+                           "movl $3, %eax\n"
+                           "syscall\n"
+                           "addq $8, %rsp\n"
+                           "popq %rax\n");
+}
+
+
+void asm64_gen_trace_hooks(struct Asm *as)
+{
+    const char *buffer = ".pushsection .bss\n"
+                         ".p2align 4\n"
+                         ".LTB: .skip %d\n"
+                         ".LTP: .skip 4\n"
+                         ".popsection\n";
+    char *s = calloc(strlen(buffer) + MAX_INT_LEN + 1, sizeof(char));
+    sprintf(s, buffer, TRACE_RECORDS * TRACE_RECORD_SIZE);
+    util_strcat(&as->rodata, s);
+    free(s);
+
+    // Same as asm_gen_trace_hooks, the record is addressed through %rsi
+    const char *hooks = "# Function trace hooks\n"
+                        ".globl crust_trace_enter\n"
+                        ".globl crust_trace_exit\n"
+                        "crust_trace_exit:\n"
+                        "pushq $%d\n"
+                        "jmp .LTH\n"
+                        "crust_trace_enter:\n"
+                        "pushq $%d\n"
+                        ".LTH:\n"
+                        "pushq %%rax\n"
+                        "pushq %%rcx\n"
+                        "pushq %%rdx\n"
+                        "pushq %%rsi\n"
+                        "rdtsc\n"
+                        "movl .LTP(%%rip), %%ecx\n"
+                        "andl $%d, %%ecx\n"
+                        "shll $4, %%ecx\n"
+                        "leaq .LTB(%%rip), %%rsi\n"
+                        "addq %%rcx, %%rsi\n"
+                        "movl %%eax, (%%rsi)\n"
+                        "movl %%edx, 4(%%rsi)\n"
+                        "movl 48(%%rsp), %%eax\n"
+                        "movl %%eax, 8(%%rsi)\n"
+                        "movl 32(%%rsp), %%eax\n"
+                        "movl %%eax, 12(%%rsi)\n"
+                        "incl .LTP(%%rip)\n"
+                        "popq %%rsi\n"
+                        "popq %%rdx\n"
+                        "popq %%rcx\n"
+                        "popq %%rax\n"
+                        "addq $8, %%rsp\n"
+                        "ret\n";
+    s = calloc(strlen(hooks) + MAX_INT_LEN * 3 + 1, sizeof(char));
+    sprintf(s, hooks, TRACE_EXIT, TRACE_ENTER, TRACE_RECORDS - 1);
+    util_strcat(&as->root, s);
+    free(s);
+}
+
+
+void asm64_gen_trace_writer(struct Asm *as)
+{
+    util_strcat(&as->data, ".LTF: .asciz \"" TRACE_FILE "\"\n");
+
+    const char *writer = "# Write trace\n"
+                         "pushq %%rax\n"
+                         "movl $2, %%eax\n"
+                         "leaq .LTF(%%rip), %%rdi\n"
+                         "movl $577, %%esi\n"
+                         "movl $420, %%edx\n"
+                         "syscall\n"
+                         "movl %%eax, %%edi\n"
+                         "leaq __stop_crust_trace_names(%%rip), %%rax\n"
+                         "leaq __start_crust_trace_names(%%rip), %%rsi\n"
+                         "subq %%rsi, %%rax\n"
+                         "pushq %%rax\n"
+                         "movl $1, %%eax\n"
+                         "movq %%rsp, %%rsi\n"
+                         "movl $4, %%edx\n"
+                         "syscall\n"
+                         "movl $1, %%eax\n"
+                         "leaq __start_crust_trace_names(%%rip), %%rsi\n"
+                         "movq (%%rsp), %%rdx\n"
+                         "syscall\n"
+                         "movl $1, %%eax\n"
+                         "leaq __start_crust_trace_addrs(%%rip), %%rsi\n"
+                         "leaq __stop_crust_trace_addrs(%%rip), %%rdx\n"
+                         "subq %%rsi, %%rdx\n"
+                         "syscall\n"
+                         "movl $1, %%eax\n"
+                         "leaq .LTP(%%rip), %%rsi\n"
+                         "movl $4, %%edx\n"
+                         "syscall\n"
+                         "movl $1, %%eax\n"
+                         "leaq .LTB(%%rip), %%rsi\n"
+                         "movl $%d, %%edx\n"
+                         "syscall\n"
+                         "movl $3, %%eax\n"
+                         "syscall\n"
+                         "addq $8, %%rsp\n"
+                         "popq %%rax\n";
+    char *s = calloc(strlen(writer) + MAX_INT_LEN + 1, sizeof(char));
+    sprintf(s, writer, TRACE_RECORDS * TRACE_RECORD_SIZE);
+    util_strcat(&as->root, s);
+    free(s);
+}
+
+
+void asm64_gen_expr(struct Asm *as, struct Node *node)
+{
+    switch (node->type)
+    {
+    case NODE_COMPOUND:
+        for (size_t i = 0; i < node->compound_size; ++i)
+        {
+            asm_gen_debug_line(as, node->compound_nodes[i]);
+            asm64_gen_expr(as, node->compound_nodes[i]);
+        }
+        break;
+
+    case NODE_FUNCTION_DEF:
+        if (node->function_def_is_decl)
+        {
+            struct Node *def = scope_find_function_def(as->scope, node->function_def_name, -1);
+
+            // Declaring an inline function from an include emits its out-of-line copy
+            if (def && def->function_def_is_inline && !asm_check_function_defined(as, def->function_def_name))
+                asm64_gen_function_def(as, def);
+
+            scope_add_function_def(as->scope, node);
+            return;
+        }
+
+        errors_asm_check_function_def(as->scope, node);
+        scope_add_function_def(as->scope, node);
+        asm64_gen_function_def(as, node);
+        break;
+
+    case NODE_RETURN:
+        asm64_gen_return(as, node);
+        break;
+
+    case NODE_VARIABLE_DEF:
+        scope_add_variable_def(as->scope, node);
+        asm64_gen_variable_def(as, node);
+        break;
+
+    case NODE_FUNCTION_CALL:
+        asm64_gen_function_call(as, node);
+        break;
+
+    case NODE_ASSIGNMENT:
+        asm64_gen_assignment(as, node);
+        break;
+
+    case NODE_STRUCT:
+        scope_add_struct_def(as->scope, node);
+        break;
+
+    case NODE_INCLUDE:
+        scope_combine(as->scope, node->include_scope);
+        break;
+
+    case NODE_BINOP:
+        asm64_gen_binop(as, node);
+        break;
+
+    case NODE_IDOF:
+        asm64_gen_expr(as, node->idof_original_expr);
+        asm64_gen_expr(as, node->idof_new_expr);
+        break;
+
+    case NODE_STRING:
+        asm_gen_store_string(as, node);
+        break;
+
+    case NODE_INLINE_ASM:
+        asm64_gen_inline_asm(as, node);
+        break;
+
+    case NODE_IF:
+        asm64_gen_if_statement(as, node);
+        break;
+
+    case NODE_WHILE:
+        asm64_gen_while(as, node);
+        break;
+
+    case NODE_FOR:
+        asm64_gen_for(as, node);
+        break;
+
+    default: break;
+    }
+}
+
+
+void asm64_gen_function_def(struct Asm *as, struct Node *node)
+{
+    size_t start = strlen(as->root);
+    asm_gen_function_label(as, node);
+
+    util_strcat(&as->root, "pushq %rbp\n");
+
+    if (as->args->debug)
+        util_strcat(&as->root, ".cfi_def_cfa_offset 16\n"
+                               ".cfi_offset %rbp, -16\n");
+
+    util_strcat(&as->root, "movq %rsp, %rbp\n");
+
+    if (as->args->debug)
+        util_strcat(&as->root, ".cfi_def_cfa_register %rbp\n");
+
+    char *s;
+
+    as->curr_func = node;
+    as->tail_label = 0;
+
+    // Locals and the home slots of the register args, 16 byte aligned
+    size_t frame = (node->function_def_stack_size + 15) & ~(size_t)15;
+
+    if (frame)
+    {
+        const char *reserve = "subq $%zu, %%rsp\n";
+        s = calloc(strlen(reserve) + MAX_INT_LEN + 1, sizeof(char));
+        sprintf(s, reserve, frame);
+        util_strcat(&as->root, s);
+        free(s);
+    }
+
+    // %rbx is callee saved in the C convention
+    if (node->function_def_conv == CONV_CDECL)
+        util_strcat(&as->root, "movq %rbx, -8(%rbp)\n");
+
+    // Before the self tail call label, which isn't a new entry
+    if (as->args->profile_generate && node->profile_key)
+        asm_gen_profile_counter(as, node->profile_key);
+
+    if (as->args->instrument_functions)
+        asm_gen_trace_enter(as, node);
+
+    if (as->args->optimize && asm_find_self_tail_call(node->function_def_body, node->function_def_name))
+    {
+        // Args arrive in registers again, so they're spilled again too
+        as->tail_label = as->func_label++;
+
+        s = calloc(MAX_INT_LEN + 5, sizeof(char));
+        sprintf(s, ".L%zu:\n", as->tail_label);
+        util_strcat(&as->root, s);
+        free(s);
+    }
+
+    for (size_t i = 0; i < node->function_def_params_size && i < ASM64_NREGARGS; ++i)
+    {
+        const char *spill = "movq %s, %d(%%rbp)\n";
+        s = calloc(strlen(spill) + strlen(g_asm64_arg_regs[i]) + MAX_INT_LEN + 1, sizeof(char));
+        sprintf(s, spill, g_asm64_arg_regs[i], node->function_def_params[i]->variable_stack_offset);
+        util_strcat(&as->root, s);
+        free(s);
+    }
+
+    if (node->function_def_return_type.type == NODE_STRUCT)
+    {
+        const char *spill = "movq %%rax, %d(%%rbp)\n";
+        s = calloc(strlen(spill) + MAX_INT_LEN + 1, sizeof(char));
+        sprintf(s, spill, node->function_def_return_ptr_stack_offset);
+        util_strcat(&as->root, s);
+        free(s);
+    }
+
+    scope_push_layer(as->scope);
+
+    as->scope->curr_layer->params = node->function_def_params;
+    as->scope->curr_layer->nparams = node->function_def_params_size;
+
+    asm64_gen_expr(as, node->function_def_body);
+
+    if (node->function_def_return_type.type == NODE_NOOP)
+    {
+        util_strcat(&as->root, "movl $0, %eax\n");
+        asm64_gen_epilogue(as);
+        asm_gen_ret(as);
+    }
+
+    asm_gen_function_end(as, node);
+
+    errors_asm_check_function_return(as->scope, node);
+
+    if (as->args->warnings[WARNING_UNUSED_VARIABLE] && !node->function_def_is_stdlib)
+        errors_warn_unused_variable(as->scope, node);
+
+    scope_pop_layer(as->scope);
+
+    if (as->args->warnings[WARNING_DEAD_CODE] && !node->function_def_is_stdlib)
+        errors_warn_dead_code(node);
+
+    // Checked like any other function, then dropped
+    if (node->function_def_is_dead)
+        as->root[start] = '\0';
+}
+
+
+void asm64_gen_return(struct Asm *as, struct Node *node)
+{
+    if (node->return_value->type == NODE_FUNCTION_CALL && !node->return_value->function_call_inlined &&
+        asm_check_tail_call(as, node->return_value))
+    {
+        asm64_gen_tail_call(as, node->return_value);
+        return;
+    }
+
+    if (as->curr_func->function_def_return_type.type == NODE_STRUCT)
+    {
+        asm64_gen_return_struct(as, node);
+        return;
+    }
+
+    const char *template =  "# Return\n"
+                            "movl %s, %%eax\n";
+
+    asm64_gen_expr(as, node->return_value);
+    char *ret = asm64_str_from_node(as, node->return_value);
+
+    char *s = calloc(strlen(template) + strlen(ret) + 1, sizeof(char));
+    sprintf(s, template, ret);
+    util_strcat(&as->root, s);
+
+    free(s);
+    free(ret);
+
+    asm64_gen_epilogue(as);
+    asm_gen_ret(as);
+}
+
+
+void asm64_gen_return_struct(struct Asm *as, struct Node *node)
+{
+    struct Node *value = node->return_value;
+
+    if (value->type == NODE_INIT_LIST)
+        asm64_gen_return_init_list(as, value, 0);
+    else
+    {
+        asm64_gen_expr(as, value);
+
+        // The callee wrote through our pointer and handed it back in %rax
+        if (value->type == NODE_FUNCTION_CALL && value->function_call_return_ptr_stack_offset)
+        {
+            asm64_gen_epilogue(as);
+            asm_gen_ret(as);
+            return;
+        }
+
+        util_strcat(&as->root, "# Return struct into the caller's result\n");
+        asm64_gen_load_return_ptr(as, "%rdx");
+        asm64_gen_copy_struct(as, value, "%rdx", 0);
+    }
+
+    asm64_gen_load_return_ptr(as, "%rax");
+
+    asm64_gen_epilogue(as);
+    asm_gen_ret(as);
+}
+
+
+void asm64_gen_return_init_list(struct Asm *as, struct Node *node, int offset)
+{
+    errors_asm_check_init_list(as->scope, node);
+
+    if (asm_check_init_list_rodata(as, node))
+    {
+        asm64_gen_load_return_ptr(as, "%rdx");
+        asm64_gen_init_list_rodata(as, node, "%rdx", offset);
+        return;
+    }
+
+    for (size_t i = 0; i < node->init_list_len; ++i)
+    {
+        struct Node *value = node->init_list_values[i];
+        int dst = offset - 4 * (int)i;
+
+        if (value->type == NODE_INIT_LIST)
+        {
+            asm64_gen_return_init_list(as, value, dst);
+            continue;
+        }
+
+        asm64_gen_expr(as, value);
+
+        if (node_type_from_node(value, as->scope).type == NODE_STRUCT)
+        {
+            asm64_gen_load_return_ptr(as, "%rdx");
+            asm64_gen_copy_struct(as, value, "%rdx", dst);
+            continue;
+        }
+
+        char *src = asm64_str_from_node(as, value);
+
+        if (MEMORY_REF(src))
+        {
+            char *s = calloc(strlen(src) + 20, sizeof(char));
+            sprintf(s, "movl %s, %%eax\n", src);
+            util_strcat(&as->root, s);
+
+            free(src);
+            free(s);
+
+            src = util_strcpy("%eax");
+        }
+
+        asm64_gen_load_return_ptr(as, "%rdx");
+
+        const char *template = "# Store member into the caller's result\n"
+                               "movl %s, %d(%%rdx)\n";
+        char *s = calloc(strlen(template) + strlen(src) + MAX_INT_LEN + 1, sizeof(char));
+        sprintf(s, template, src, dst);
+        util_strcat(&as->root, s);
+
+        free(src);
+        free(s);
+    }
+}
+
+
+void asm64_gen_load_return_ptr(struct Asm *as, const char *reg)
+{
+    const char *template = "movq %d(%%rbp), %s\n";
+    char *s = calloc(strlen(template) + strlen(reg) + MAX_INT_LEN + 1, sizeof(char));
+    sprintf(s, template, as->curr_func->function_def_return_ptr_stack_offset, reg);
+    util_strcat(&as->root, s);
+    free(s);
+}
+
+
+void asm64_gen_epilogue(struct Asm *as)
+{
+    if (as->args->instrument_functions)
+        asm_gen_trace_call(as, "crust_trace_exit");
+
+    if (as->args->debug)
+        util_strcat(&as->root, ".cfi_remember_state\n");
+
+    if (as->curr_func->function_def_conv == CONV_CDECL)
+        util_strcat(&as->root, "movq -8(%rbp), %rbx\n");
+
+    util_strcat(&as->root, "leave\n");
+
+    if (as->args->debug)
+        util_strcat(&as->root, ".cfi_def_cfa %rsp, 8\n");
+}
+
+
+void asm64_gen_tail_call(struct Asm *as, struct Node *node)
+{
+    struct Node *func = scope_find_function(as->scope, node->function_call_name, node->error_line);
+    errors_asm_check_function_call(as->scope, func, node);
+    asm_add_inline_copy(as, node->function_call_name);
+
+    // Every arg fits in a register, so nothing is left on our frame
+    asm64_gen_args(as, node);
+    util_strcat(&as->root, "# Tail call\n");
+
+    bool self = strcmp(node->function_call_name, as->curr_func->function_def_name) == 0;
+
+    const char *template;
+    char *s;
+
+    if (self)
+    {
+        template = "jmp .L%zu\n";
+        s = calloc(strlen(template) + MAX_INT_LEN + 1, sizeof(char));
+        sprintf(s, template, as->tail_label);
+    }
+    else
+    {
+        asm64_gen_epilogue(as);
+
+        template = "jmp %s\n";
+        s = calloc(strlen(template) + strlen(node->function_call_name) + 1, sizeof(char));
+        sprintf(s, template, node->function_call_name);
+    }
+
+    util_strcat(&as->root, s);
+    free(s);
+
+    // Same as after a ret
+    if (!self && as->args->debug)
+        util_strcat(&as->root, ".cfi_restore_state\n");
+
+    stats_add_tail_call(as->curr_func->function_def_name, node->function_call_name, self);
+}
+
+
+void asm64_gen_variable_def(struct Asm *as, struct Node *node)
+{
+    if (node->variable_def_is_dead)
+    {
+        errors_asm_check_variable_def(as->scope, node);
+        return;
+    }
+
+    if (node->variable_def_type.type == NODE_STRUCT && node->variable_def_value->type != NODE_INIT_LIST)
+    {
+        asm64_gen_expr(as, node->variable_def_value);
+        errors_asm_check_variable_def(as->scope, node);
+
+        asm64_gen_copy_struct(as, node->variable_def_value, "%rbp", node->variable_def_stack_offset);
+        return;
+    }
+
+    struct Node *literal = node_strip_to_literal(node, as->scope);
+    asm64_gen_expr(as, node->variable_def_value);
+
+    asm64_gen_add_to_stack(as, literal, node->variable_def_stack_offset);
+    errors_asm_check_variable_def(as->scope, node);
+}
+
+
+void asm64_gen_add_to_stack(struct Asm *as, struct Node *node, int stack_offset)
+{
+    if (node->type == NODE_INIT_LIST)
+    {
+        errors_asm_check_init_list(as->scope, node);
+
+        if (asm_check_init_list_rodata(as, node))
+        {
+            asm64_gen_init_list_rodata(as, node, "%rbp", stack_offset);
+            return;
+        }
+
+        for (size_t i = 0; i < node->init_list_len; ++i)
+        {
+            if (node->init_list_values[i]->type != NODE_INIT_LIST)
+                asm64_gen_expr(as, node->init_list_values[i]);
+
+            asm64_gen_add_to_stack(as, node->init_list_values[i], stack_offset - 4 * i);
+        }
+
+        return;
+    }
+
+    if (node_type_from_node(node, as->scope).type == NODE_STRUCT)
+    {
+        asm64_gen_copy_struct(as, node, "%rbp", stack_offset);
+        return;
+    }
+
+    const char *template =  "# Add value to stack\n"
+                            "movl %s, %d(%%rbp)\n";
+
+    char *left = asm64_str_from_node(as, node);
+
+    if (MEMORY_REF(left))
+    {
+        const char *tmp = "# Avoid too many memory references\n"
+                          "movl %s, %%eax\n";
+        char *s = calloc(strlen(tmp) + strlen(left) + 1, sizeof(char));
+        sprintf(s, tmp, left);
+        util_strcat(&as->root, s);
+
+        free(left);
+        free(s);
+
+        left = util_strcpy("%eax");
+    }
+
+    char *s = calloc(strlen(template) + strlen(left) + MAX_INT_LEN + 1, sizeof(char));
+    sprintf(s, template, left, stack_offset);
+    util_strcat(&as->root, s);
+
+    free(left);
+    free(s);
+}
+
+
+void asm64_gen_init_list_rodata(struct Asm *as, struct Node *node, const char *dst_base, int dst_offset)
+{
+    char *src = asm_gen_rodata(as, node);
+
+    const char *template = "# Init list from .rodata\n"
+                           "leaq %s(%%rip), %%rcx\n";
+    char *s = calloc(strlen(template) + strlen(src) + 1, sizeof(char));
+    sprintf(s, template, src);
+    util_strcat(&as->root, s);
+
+    free(s);
+    free(src);
+
+    asm64_gen_copy(as, "%rcx", 0, dst_base, dst_offset, node_sizeof_dtype(node));
+}
+
+
+void asm64_gen_function_call(struct Asm *as, struct Node *node)
+{
+    struct Node *func = scope_find_function(as->scope, node->function_call_name, node->error_line);
+
+    errors_asm_check_function_call(as->scope, func, node);
+
+    if (node->function_call_inlined)
+    {
+        util_strcat(&as->root, "# Inlined call\n");
+
+        // Lines of the body are the callee's, in its own source
+        size_t file = as->debug_file;
+        asm_gen_debug_file(as, func->function_def_file);
+        asm_gen_debug_line(as, node->function_call_inlined);
+        asm64_gen_expr(as, node->function_call_inlined);
+
+        as->debug_file = file;
+        as->debug_line = 0;
+        return;
+    }
+
+    asm_add_inline_copy(as, node->function_call_name);
+
+    size_t nstack = node->function_call_args_size > ASM64_NREGARGS ?
+                    node->function_call_args_size - ASM64_NREGARGS : 0;
+
+    // C callees expect %rsp 16 byte aligned at the call
+    if (nstack % 2)
+        util_strcat(&as->root, "subq $8, %rsp\n");
+
+    asm64_gen_args(as, node);
+
+    bool ret_struct = func->function_def_return_type.type == NODE_STRUCT;
+    char *s;
+
+    // Struct results are written straight into our frame, or into our caller's result
+    if (ret_struct && node->function_call_return_ptr_stack_offset)
+        asm64_gen_load_return_ptr(as, "%rax");
+    else if (ret_struct)
+    {
+        const char *dst = "leaq %d(%%rbp), %%rax\n";
+        s = calloc(strlen(dst) + MAX_INT_LEN + 1, sizeof(char));
+        sprintf(s, dst, node->function_call_return_stack_offset);
+        util_strcat(&as->root, s);
+        free(s);
+    }
+
+    const char *template = "# Function call\n"
+                           "call %s\n";
+
+    s = calloc(strlen(template) + strlen(node->function_call_name) + 1, sizeof(char));
+    sprintf(s, template, node->function_call_name);
+    util_strcat(&as->root, s);
+    free(s);
+
+    // The caller pops the pushed args and the padding
+    if (nstack)
+    {
+        const char *pop = "addq $%zu, %%rsp\n";
+        s = calloc(strlen(pop) + MAX_INT_LEN + 1, sizeof(char));
+        sprintf(s, pop, 8 * (nstack + nstack % 2));
+        util_strcat(&as->root, s);
+        free(s);
+    }
+
+    if (ret_struct)
+        return;
+
+    const char *result = "movl %%eax, %d(%%rbp)\n";
+    s = calloc(strlen(result) + MAX_INT_LEN + 1, sizeof(char));
+    sprintf(s, result, node->function_call_return_stack_offset);
+    util_strcat(&as->root, s);
+    free(s);
+}
+
+
+void asm64_gen_args(struct Asm *as, struct Node *node)
+{
+    util_strcat(&as->root, "# Push function call args\n");
+
+    // Pushed backwards so the stack args end up in order; later args can't
+    // clobber earlier ones while they're on the stack.
+    for (int i = node->function_call_args_size - 1; i >= 0; --i)
+    {
+        asm64_gen_expr(as, node->function_call_args[i]);
+        NodeDType type = node_type_from_node(node->function_call_args[i], as->scope);
+
+        if (type.type == NODE_STRUCT)
+            asm64_gen_push_args_struct(as, node->function_call_args[i]);
+        else
+            asm64_gen_push_args_primitive(as, node->function_call_args[i]);
+    }
+
+    for (size_t i = 0; i < node->function_call_args_size && i < ASM64_NREGARGS; ++i)
+    {
+        const char *pop = "popq %s\n";
+        char *s = calloc(strlen(pop) + strlen(g_asm64_arg_regs[i]) + 1, sizeof(char));
+        sprintf(s, pop, g_asm64_arg_regs[i]);
+        util_strcat(&as->root, s);
+        free(s);
+    }
+}
+
+
+void asm64_gen_push_args_primitive(struct Asm *as, struct Node *node)
+{
+    // Values are 4 bytes, the movl zero extends them to a full push
+    const char *template = "movl %s, %%eax\n"
+                           "pushq %%rax\n";
+    struct Node *arg = node_strip_to_literal(node, as->scope);
+    char *value = asm64_str_from_node(as, arg);
+
+    char *s = calloc(strlen(template) + strlen(value) + 1, sizeof(char));
+    sprintf(s, template, value);
+
+    util_strcat(&as->root, s);
+    free(s);
+    free(value);
+}
+
+
+void asm64_gen_push_args_struct(struct Asm *as, struct Node *node)
+{
+    struct Node *list = node_strip_to_literal(node, as->scope);
+
+    // Lists written in the call are only stored here
+    if (node->type == NODE_INIT_LIST)
+        asm64_gen_add_to_stack(as, node, node->init_list_stack_offset);
+
+    char *value = asm64_str_from_node(as, list);
+
+    const char *template;
+
+    // Our own struct params already hold a pointer
+    if (list->type == NODE_VARIABLE && list->variable_is_param && !list->variable_struct_member)
+        template = "# Pass struct param pointer on\n"
+                   "movq %s, %%rax\n"
+                   "pushq %%rax\n";
+    else
+        template = "# Push init list ptr into function call args\n"
+                   "leaq %s, %%rax\n"
+                   "pushq %%rax\n";
+
+    char *s = calloc(strlen(template) + strlen(value) + 1, sizeof(char));
+    sprintf(s, template, value);
+
+    util_strcat(&as->root, s);
+
+    free(value);
+    free(s);
+}
+
+
+void asm64_gen_assignment(struct Asm *as, struct Node *node)
+{
+    // The call writes its result into dst itself, so the copy below is skipped
+    if (asm_check_rvo_assignment(as, node))
+    {
+        int offset;
+        char *base = asm64_gen_struct_base(as, node->assignment_dst, "%rdx", &offset);
+
+        if (strcmp(base, "%rbp") == 0)
+            node->assignment_src->function_call_return_stack_offset = offset;
+
+        free(base);
+    }
+
+    asm64_gen_expr(as, node->assignment_src);
+    errors_asm_check_assignment(as->scope, node);
+
+    if (node_type_from_node(node->assignment_dst, as->scope).type == NODE_STRUCT)
+    {
+        asm64_gen_assignment_struct(as, node);
+        return;
+    }
+
+    char *src = asm64_str_from_node(as, node->assignment_src);
+    char *dst = asm64_str_from_node(as, node->assignment_dst);
+
+    char *template;
+
+    // Avoid too many memory references in one mov instruction
+    if (MEMORY_REF(src) && MEMORY_REF(dst))
+        template =  "# Assignment: Avoid too many memory references\n"
+                    "movl %s, %%ecx\n"
+                    "movl %%ecx, %s\n";
+    else
+        template =  "# Assignment\n"
+                    "movl %s, %s\n";
+
+    char *s = calloc(strlen(template) + strlen(src) + strlen(dst) + 1, sizeof(char));
+    sprintf(s, template, src, dst);
+
+    util_strcat(&as->root, s);
+
+    free(src);
+    free(dst);
+    free(s);
+
+    struct Node *node_src = node_strip_to_literal(node->assignment_src, as->scope);
+    struct Node *node_dst = node_strip_to_literal(node->assignment_dst, as->scope);
+
+    if (node_dst->type == NODE_STRING && node_src->type == NODE_STRING)
+    {
+        free(node_dst->string_asm_id);
+        node_dst->string_asm_id = util_strcpy(node_src->string_asm_id);
+    }
+}
+
+
+void asm64_gen_assignment_struct(struct Asm *as, struct Node *node)
+{
+    struct Node *src = node->assignment_src;
+
+    if (src->type == NODE_INIT_LIST)
+        asm64_gen_add_to_stack(as, src, src->init_list_stack_offset);
+
+    int offset;
+    char *base = asm64_gen_struct_base(as, node->assignment_dst, "%rdx", &offset);
+
+    asm64_gen_copy_struct(as, src, base, offset);
+    free(base);
+}
+
+
+void asm64_gen_copy_struct(struct Asm *as, struct Node *src, const char *dst_base, int dst_offset)
+{
+    NodeDType type = node_type_from_node(src, as->scope);
+    struct Node *def = scope_find_struct(as->scope, type.struct_type, src->error_line);
+
+    int src_offset;
+    char *src_base = asm64_gen_struct_base(as, src, "%rcx", &src_offset);
+
+    asm64_gen_copy(as, src_base, src_offset, dst_base, dst_offset, node_sizeof_struct(def, as->scope));
+    free(src_base);
+}
+
+
+char *asm64_gen_struct_base(struct Asm *as, struct Node *node, char *reg, int *offset)
+{
+    *offset = 0;
+
+    if (node->type == NODE_INIT_LIST)
+    {
+        *offset = node->init_list_stack_offset;
+        return util_strcpy("%rbp");
+    }
+
+    if (node->type == NODE_FUNCTION_CALL && !node->function_call_inlined)
+    {
+        *offset = node->function_call_return_stack_offset;
+        return util_strcpy("%rbp");
+    }
+
+    char *value = asm64_str_from_node(as, node);
+
+    if (!asm_check_struct_param(as, node) && strstr(value, "(%rbp)"))
+    {
+        *offset = atoi(value);
+        free(value);
+        return util_strcpy("%rbp");
+    }
+
+    const char *template = asm_check_struct_param(as, node) ? "movq %s, %s\n" : "leaq %s, %s\n";
+    char *s = calloc(strlen(template) + strlen(value) + strlen(reg) + 1, sizeof(char));
+    sprintf(s, template, value, reg);
+    util_strcat(&as->root, s);
+
+    free(s);
+    free(value);
+
+    return util_strcpy(reg);
+}
+
+
+void asm64_gen_copy(struct Asm *as, const char *src_base, int src_offset, const char *dst_base, int dst_offset, size_t size)
+{
+    // Results built in place by the callee
+    if (src_offset == dst_offset && strcmp(src_base, dst_base) == 0)
+        return;
+
+    util_strcat(&as->root, "# Copy struct\n");
+
+    // Copied up from the lowest member
+    int src_low = src_offset - (int)size + 4;
+    int dst_low = dst_offset - (int)size + 4;
+    char *s;
+
+    if (size > ASM64_COPY_SSE_MAX)
+    {
+        const char *template = "leaq %d(%s), %%rsi\n"
+                               "leaq %d(%s), %%rdi\n"
+                               "movl $%zu, %%ecx\n"
+                               "rep movsl\n";
+        s = calloc(strlen(template) + strlen(src_base) + strlen(dst_base) + MAX_INT_LEN * 3 + 1, sizeof(char));
+        sprintf(s, template, src_low, src_base, dst_low, dst_base, size / 4);
+        util_strcat(&as->root, s);
+        free(s);
+        return;
+    }
+
+    size_t i = 0;
+
+    // Every x86-64 CPU has SSE2; 16 bytes per move
+    while (size > ASM_COPY_UNROLL_MAX && size - i >= 16)
+    {
+        const char *template = "movdqu %d(%s), %%xmm0\n"
+                               "movdqu %%xmm0, %d(%s)\n";
+        s = calloc(strlen(template) + strlen(src_base) + strlen(dst_base) + MAX_INT_LEN * 2 + 1, sizeof(char));
+        sprintf(s, template, src_low + (int)i, src_base, dst_low + (int)i, dst_base);
+        util_strcat(&as->root, s);
+        free(s);
+
+        i += 16;
+    }
+
+    for (; i < size; i += size - i >= 8 ? 8 : 4)
+    {
+        const char *template = size - i >= 8 ? "movq %d(%s), %%rax\nmovq %%rax, %d(%s)\n" :
+                                               "movl %d(%s), %%eax\nmovl %%eax, %d(%s)\n";
+        s = calloc(strlen(template) + strlen(src_base) + strlen(dst_base) + MAX_INT_LEN * 2 + 1, sizeof(char));
+        sprintf(s, template, src_low + (int)i, src_base, dst_low + (int)i, dst_base);
+        util_strcat(&as->root, s);
+        free(s);
+    }
+}
+
+
+void asm64_gen_binop(struct Asm *as, struct Node *node)
+{
+    if (as->args->optimize && asm_check_binop_const(node))
+    {
+        asm64_gen_binop_const(as, node);
+        return;
+    }
+
+    util_strcat(&as->root, "# Binop left\n");
+    asm64_gen_expr(as, node->op_l);
+    asm64_gen_add_to_stack(as, node->op_l, node->op_stack_offset);
+
+    util_strcat(&as->root, "# Binop right\n");
+    asm64_gen_expr(as, node->op_r);
+    asm64_gen_add_to_stack(as, node->op_r, node->op_stack_offset - 4);
+
+    const char *prepare_registers = "# Prepare registers for math\n"
+                                    "movl %d(%%rbp), %%eax\n"
+                                    "movl %d(%%rbp), %%ecx\n";
+    char *s = calloc(strlen(prepare_registers) + MAX_INT_LEN * 2 + 1, sizeof(char));
+    sprintf(s, prepare_registers, node->op_stack_offset, node->op_stack_offset - 4);
+    util_strcat(&as->root, s);
+    free(s);
+
+    switch (node->op_type)
+    {
+    case OP_PLUS:
+        util_strcat(&as->root, "addl %eax, %ecx\n"); break;
+    case OP_MINUS:
+        util_strcat(&as->root, "subl %ecx, %eax\nmovl %eax, %ecx\n"); break;
+    case OP_MUL:
+        util_strcat(&as->root, "imull %eax, %ecx\n"); break;
+    case OP_DIV:
+        util_strcat(&as->root, "cltd\nidivl %ecx\nmovl %eax, %ecx\n"); break;
+    case OP_MOD:
+        util_strcat(&as->root, "cltd\nidivl %ecx\nmovl %edx, %ecx\n"); break;
+    case OP_CMP:
+    case OP_NE:
+    case OP_LT:
+    case OP_LE:
+    case OP_GT:
+    case OP_GE:
+        asm_gen_binop_cmp(as, node);
+    }
+}
+
+
+void asm64_gen_binop_const(struct Asm *as, struct Node *node)
+{
+    struct Node *value = node->op_l;
+    struct Node *k = node->op_r;
+
+    if (k->type != NODE_INT)
+    {
+        value = node->op_r;
+        k = node->op_l;
+    }
+
+    util_strcat(&as->root, "# Binop by constant\n");
+    asm64_gen_expr(as, value);
+
+    char *src = asm64_str_from_node(as, value);
+    const char *tmp = "movl %s, %%eax\n";
+    char *s = calloc(strlen(tmp) + strlen(src) + 1, sizeof(char));
+    sprintf(s, tmp, src);
+    util_strcat(&as->root, s);
+    free(s);
+    free(src);
+
+    s = asm_str_from_binop_const(node->op_type, k->int_value);
+    util_strcat(&as->root, s);
+    free(s);
+}
+
+void asm64_gen_inline_asm(struct Asm *as, struct Node *node)
+{
+    char *s = calloc(1, sizeof(char));
+
+    for (size_t i = 0; i < node->asm_nargs; ++i)
+    {
+        asm64_gen_expr(as, node->asm_args[i]);
+        struct Node *literal = node_strip_to_literal(node->asm_args[i], as->scope);
+
+        if (literal->type == NODE_STRING)
+        {
+            util_strcat(&s, literal->string_value);
+        }
+        else
+        {
+            char *tmp = asm64_str_from_node(as, literal);
+            util_strcat(&s, tmp);
+            free(tmp);
+        }
+    }
+
+    util_strcat(&as->root, "#APP\n");
+    util_strcat(&as->root, s);
+    free(s);
+
+    util_strcat(&as->root, "\n#NO_APP\n");
+}
+
+
+void asm64_gen_if_statement(struct Asm *as, struct Node *node)
+{
+    if (as->args->optimize && asm_check_select(as, node))
+    {
+        asm64_gen_select(as, node);
+        return;
+    }
+
+    if (as->args->profile_generate && node->profile_key)
+        asm_gen_profile_counter(as, node->profile_key);
+
+    size_t label = as->func_label++;
+    bool cold = asm_check_cold_if(as, node);
+    size_t body = cold ? as->func_label++ : label;
+    char *s;
+
+    if (asm_check_cmp(node->if_cond))
+    {
+        asm64_gen_cmp(as, node->if_cond);
+
+        const char *template = "j%s .L%zu\n";
+        const char *cc = asm_cc_from_op(node->if_cond->op_type, !cold);
+        s = calloc(strlen(template) + strlen(cc) + MAX_INT_LEN + 1, sizeof(char));
+        sprintf(s, template, cc, body);
+    }
+    else
+    {
+        asm64_gen_expr(as, node->if_cond);
+        char *cond = asm64_str_from_node(as, node->if_cond);
+
+        const char *template = cold ? "cmpl $0, %s\n"
+                                      "jne .L%zu\n"
+                                    : "cmpl $0, %s\n"
+                                      "je .L%zu\n";
+        s = calloc(strlen(template) + strlen(cond) + MAX_INT_LEN + 1, sizeof(char));
+        sprintf(s, template, cond, body);
+        free(cond);
+    }
+
+    util_strcat(&as->root, s);
+    free(s);
+
+    if (cold)
+        asm_gen_cold(as, node, body, label);
+    else
+    {
+        asm_gen_profile_taken(as, node);
+        asm64_gen_expr(as, node->if_body);
+    }
+
+    s = calloc(MAX_INT_LEN + 5, sizeof(char));
+    sprintf(s, ".L%zu:\n", label);
+    util_strcat(&as->root, s);
+    free(s);
+}
+
+
+void asm64_gen_while(struct Asm *as, struct Node *node)
+{
+    size_t top = as->func_label++;
+    size_t cond = as->func_label++;
+    char *s;
+
+    struct Node *literal = node_strip_to_literal(node->while_cond, as->scope);
+
+    // Constant conditions don't need to be tested
+    if (literal->type == NODE_INT && !literal->int_value)
+        return;
+
+    if (literal->type != NODE_INT)
+    {
+        // The condition sits below the body, so each iteration only takes one branch
+        s = calloc(MAX_INT_LEN + 9, sizeof(char));
+        sprintf(s, "jmp .L%zu\n", cond);
+        util_strcat(&as->root, s);
+        free(s);
+    }
+
+    asm64_gen_loop_top(as, top);
+
+    scope_push_block(as->scope);
+    asm64_gen_expr(as, node->while_body);
+    scope_pop_layer(as->scope);
+
+    s = calloc(MAX_INT_LEN + 5, sizeof(char));
+    sprintf(s, ".L%zu:\n", cond);
+    util_strcat(&as->root, s);
+    free(s);
+
+    // Back on the while's line after the body's
+    as->debug_line = 0;
+    asm_gen_debug_loc(as, node->error_line);
+
+    if (literal->type == NODE_INT)
+    {
+        const char *template = "jmp .L%zu\n";
+        s = calloc(strlen(template) + MAX_INT_LEN + 1, sizeof(char));
+        sprintf(s, template, top);
+    }
+    else if (asm_check_cmp(node->while_cond))
+    {
+        asm64_gen_cmp(as, node->while_cond);
+
+        const char *template = "j%s .L%zu\n";
+        const char *cc = asm_cc_from_op(node->while_cond->op_type, false);
+        s = calloc(strlen(template) + strlen(cc) + MAX_INT_LEN + 1, sizeof(char));
+        sprintf(s, template, cc, top);
+    }
+    else
+    {
+        asm64_gen_expr(as, node->while_cond);
+        char *value = asm64_str_from_node(as, node->while_cond);
+
+        const char *template = "cmpl $0, %s\n"
+                               "jne .L%zu\n";
+        s = calloc(strlen(template) + strlen(value) + MAX_INT_LEN + 1, sizeof(char));
+        sprintf(s, template, value, top);
+        free(value);
+    }
+
+    util_strcat(&as->root, s);
+    free(s);
+}
+
+
+void asm64_gen_for(struct Asm *as, struct Node *node)
+{
+    scope_push_block(as->scope);
+
+    struct Node *var = node->for_var;
+    scope_add_variable_def(as->scope, var);
+    asm64_gen_variable_def(as, var);
+
+    errors_asm_check_loop_range(as->scope, node);
+    asm64_gen_expr(as, node->for_end);
+
+    char *end;
+
+    if (node->for_end->type == NODE_INT)
+        end = asm64_str_from_node(as, node->for_end);
+    else
+    {
+        // The end is evaluated once, the body can't change it
+        asm64_gen_add_to_stack(as, node->for_end, node->for_end_stack_offset);
+
+        end = calloc(MAX_INT_LEN + 8, sizeof(char));
+        sprintf(end, "%d(%%rbp)", node->for_end_stack_offset);
+    }
+
+    if (loop_check_unroll(node, as->args))
+    {
+        for (size_t i = 0; i < node->for_nivs; ++i)
+            scope_add_variable_def(as->scope, node->for_ivs[i]);
+
+        asm64_gen_for_unrolled(as, node);
+
+        free(end);
+        scope_pop_layer(as->scope);
+        return;
+    }
+
+    for (size_t i = 0; i < node->for_nivs; ++i)
+    {
+        scope_add_variable_def(as->scope, node->for_ivs[i]);
+        asm64_gen_variable_def(as, node->for_ivs[i]);
+    }
+
+    size_t top = as->func_label++;
+    size_t done = as->func_label++;
+
+    char *i = asm64_str_from_var_def(as, var);
+    char *s;
+
+    struct Node *start = var->variable_def_value;
+
+    // Loops known to run at least once go straight into the body
+    bool guard = start->type != NODE_INT || node->for_end->type != NODE_INT ||
+                 start->int_value >= node->for_end->int_value;
+
+    if (guard)
+    {
+        const char *template = "# Loop guard\n"
+                               "movl %s, %%eax\n"
+                               "cmpl %s, %%eax\n"
+                               "jge .L%zu\n";
+        s = calloc(strlen(template) + strlen(i) + strlen(end) + MAX_INT_LEN + 1, sizeof(char));
+        sprintf(s, template, i, end, done);
+        util_strcat(&as->root, s);
+        free(s);
+    }
+
+    asm64_gen_loop_top(as, top);
+    asm64_gen_expr(as, node->for_body);
+
+    const char *step = "# Loop latch\n"
+                       "movl %s, %%eax\n"
+                       "addl $1, %%eax\n"
+                       "movl %%eax, %s\n";
+    s = calloc(strlen(step) + strlen(i) * 2 + 1, sizeof(char));
+    sprintf(s, step, i, i);
+    util_strcat(&as->root, s);
+    free(s);
+
+    // Derived variables are stepped along instead of multiplied every iteration
+    for (size_t j = 0; j < node->for_nivs; ++j)
+    {
+        struct Node *iv = node->for_ivs[j];
+
+        const char *template = "addl $%d, %d(%%rbp)\n";
+        s = calloc(strlen(template) + MAX_INT_LEN * 2 + 1, sizeof(char));
+        sprintf(s, template, iv->variable_def_value->op_r->int_value, iv->variable_def_stack_offset);
+        util_strcat(&as->root, s);
+        free(s);
+    }
+
+    const char *test = "cmpl %s, %%eax\n"
+                       "jl .L%zu\n";
+    s = calloc(strlen(test) + strlen(end) + MAX_INT_LEN + 1, sizeof(char));
+    sprintf(s, test, end, top);
+    util_strcat(&as->root, s);
+    free(s);
+
+    if (guard)
+    {
+        s = calloc(MAX_INT_LEN + 5, sizeof(char));
+        sprintf(s, ".L%zu:\n", done);
+        util_strcat(&as->root, s);
+        free(s);
+    }
+
+    free(i);
+    free(end);
+    scope_pop_layer(as->scope);
+}
+
+
+void asm64_gen_for_unrolled(struct Asm *as, struct Node *node)
+{
+    struct Node *var = node->for_var;
+
+    for (int v = var->variable_def_value->int_value; v < node->for_end->int_value; ++v)
+    {
+        const char *template = "# Unrolled iteration\n"
+                               "movl $%d, %d(%%rbp)\n";
+        char *s = calloc(strlen(template) + MAX_INT_LEN * 2 + 1, sizeof(char));
+        sprintf(s, template, v, var->variable_def_stack_offset);
+        util_strcat(&as->root, s);
+        free(s);
+
+        for (size_t j = 0; j < node->for_nivs; ++j)
+        {
+            struct Node *iv = node->for_ivs[j];
+
+            const char *tmp = "movl $%d, %d(%%rbp)\n";
+            s = calloc(strlen(tmp) + MAX_INT_LEN * 2 + 1, sizeof(char));
+            sprintf(s, tmp, v * iv->variable_def_value->op_r->int_value, iv->variable_def_stack_offset);
+            util_strcat(&as->root, s);
+            free(s);
+        }
+
+        asm64_gen_expr(as, node->for_body);
+    }
+}
+
+
+void asm64_gen_loop_top(struct Asm *as, size_t label)
+{
+    // Keeps the loop's first instructions in one fetch block
+    if (as->args->optimize && !as->in_cold)
+        util_strcat(&as->root, ".p2align 4,,10\n");
+
+    char *s = calloc(MAX_INT_LEN + 5, sizeof(char));
+    sprintf(s, ".L%zu:\n", label);
+    util_strcat(&as->root, s);
+    free(s);
+}
+
+void asm64_gen_select(struct Asm *as, struct Node *node)
+{
+    struct Node *assignment = node->if_body->compound_nodes[0];
+    errors_asm_check_assignment(as->scope, assignment);
+
+    asm64_gen_cmp(as, node->if_cond);
+
+    const char *tmp = "# Select\n"
+                      "movl %s, %%eax\n"
+                      "movl %s, %%ecx\n"
+                      "cmov%s %%eax, %%ecx\n"
+                      "movl %%ecx, %s\n";
+
+    char *src = asm64_str_from_node(as, assignment->assignment_src);
+    char *dst = asm64_str_from_node(as, assignment->assignment_dst);
+    const char *cc = asm_cc_from_op(node->if_cond->op_type, false);
+
+    char *s = calloc(strlen(tmp) + strlen(src) + strlen(dst) * 2 + strlen(cc) + 1, sizeof(char));
+    sprintf(s, tmp, src, dst, cc, dst);
+    util_strcat(&as->root, s);
+
+    free(s);
+    free(src);
+    free(dst);
+}
+
+
+void asm64_gen_cmp(struct Asm *as, struct Node *node)
+{
+    util_strcat(&as->root, "# Compare\n");
+    asm64_gen_expr(as, node->op_l);
+
+    char *l;
+
+    if (asm_check_arg_simple(node->op_r))
+    {
+        l = asm64_str_from_node(as, node->op_l);
+
+        if (l[0] == '$' || (MEMORY_REF(l) && node->op_r->type == NODE_VARIABLE))
+        {
+            const char *tmp = "movl %s, %%eax\n";
+            char *s = calloc(strlen(tmp) + strlen(l) + 1, sizeof(char));
+            sprintf(s, tmp, l);
+            util_strcat(&as->root, s);
+            free(s);
+            free(l);
+
+            l = util_strcpy("%eax");
+        }
+    }
+    else
+    {
+        asm64_gen_add_to_stack(as, node->op_l, node->op_stack_offset);
+
+        l = calloc(MAX_INT_LEN + 8, sizeof(char));
+        sprintf(l, "%d(%%rbp)", node->op_stack_offset);
+    }
+
+    asm64_gen_expr(as, node->op_r);
+    char *r = asm64_str_from_node(as, node->op_r);
+
+    if (MEMORY_REF(l) && MEMORY_REF(r))
+    {
+        const char *tmp = "movl %s, %%eax\n";
+        char *s = calloc(strlen(tmp) + strlen(r) + 1, sizeof(char));
+        sprintf(s, tmp, r);
+        util_strcat(&as->root, s);
+        free(s);
+        free(r);
+
+        r = util_strcpy("%eax");
+    }
+
+    const char *tmp = "cmpl %s, %s\n";
+    char *s = calloc(strlen(tmp) + strlen(l) + strlen(r) + 1, sizeof(char));
+    sprintf(s, tmp, r, l);
+    util_strcat(&as->root, s);
+
+    free(s);
+    free(l);
+    free(r);
+}
+
+
+char *asm64_str_from_node(struct Asm *as, struct Node *node)
+{
+    switch (node->type)
+    {
+    case NODE_INT: return asm_str_from_int(as, node);
+    case NODE_STRING: return asm_str_from_str(as, node);
+    case NODE_VARIABLE: return asm64_str_from_var(as, node);
+    case NODE_FUNCTION_CALL: return asm64_str_from_function_call(as, node);
+    case NODE_BINOP: return asm_str_from_binop(as, node);
+    case NODE_IDOF: return asm64_str_from_node(as, node->idof_new_expr);
+    case NODE_INIT_LIST: return asm64_str_from_init_list(as, node);
+    default:
+        errors_asm_str_from_node(node);
+        break;
+    }
+
+    return 0;
+}
+
+
+char *asm64_str_from_var(struct Asm *as, struct Node *node)
+{
+    struct Node *var = scope_find_variable(as->scope, node, node->error_line);
+
+    // Members of lists that never change are read as immediates
+    if (node->variable_struct_member && node_strip_member_to_literal(node, as->scope) != node)
+        return asm64_str_from_node(as, node_strip_member_to_literal(node, as->scope));
+
+    if (var->type == NODE_VARIABLE)
+        return asm64_str_from_var_var(as, node);
+    else if (var->type == NODE_VARIABLE_DEF)
+        return asm64_str_from_var_def(as, var);
+
+    return asm64_str_from_node(as, node_strip_to_literal(var, as->scope));
+}
+
+
+char *asm64_str_from_var_var(struct Asm *as, struct Node *node)
+{
+    struct Node *var = scope_find_variable(as->scope, node, node->error_line);
+    char *s;
+
+    if (node->variable_is_param && node != var)
+    {
+        const char *template =  "# Param struct member\n"
+                                "movq %d(%%rbp), %%rbx\n";
+        s = calloc(strlen(template) + MAX_INT_LEN + 1, sizeof(char));
+        sprintf(s, template, node->variable_stack_offset);
+        util_strcat(&as->root, s);
+        free(s);
+
+        s = calloc(MAX_INT_LEN + 8, sizeof(char));
+        sprintf(s, "%d(%%rbx)", var->variable_stack_offset - node->variable_stack_offset);
+
+        return s;
+    }
+
+    s = calloc(MAX_INT_LEN + 8, sizeof(char));
+    sprintf(s, "%d(%%rbp)", var->variable_stack_offset);
+
+    return s;
+}
+
+
+char *asm64_str_from_var_def(struct Asm *as, struct Node *node)
+{
+    char *s = calloc(MAX_INT_LEN + 8, sizeof(char));
+    sprintf(s, "%d(%%rbp)", node->variable_def_stack_offset);
+    return s;
+}
+
+
+char *asm64_str_from_function_call(struct Asm *as, struct Node *node)
+{
+    if (node->function_call_inlined)
+        return asm64_str_from_node(as, node->function_call_inlined);
+
+    if (node_type_from_node(node, as->scope).type == NODE_STRUCT)
+    {
+        char *s = calloc(MAX_INT_LEN + 8, sizeof(char));
+        sprintf(s, "%d(%%rbp)", node->function_call_return_stack_offset);
+        return s;
+    }
+
+    const char *template = "# Get function call return value: avoiding too many memory references\n"
+                           "movl %d(%%rbp), %%ecx\n";
+    char *s = calloc(strlen(template) + MAX_INT_LEN + 1, sizeof(char));
+    sprintf(s, template, node->function_call_return_stack_offset);
+    util_strcat(&as->root, s);
+    free(s);
+
+    return util_strcpy("%ecx");
+}
+
+
+char *asm64_str_from_init_list(struct Asm *as, struct Node *node)
+{
+    char *s = calloc(MAX_INT_LEN + 8, sizeof(char));
+    sprintf(s, "%d(%%rbp)", node->init_list_stack_offset);
+    return s;
+}
+
@@ -0,0 +1,71 @@
+#ifndef ASM64_H
+#define ASM64_H
+
+#include "asm.h"
+
+// x86-64 backend, parallel to asm.c. Ints and string labels keep their 4 byte
+// slots; struct pointers are 8 bytes. The first ASM64_NREGARGS args are
+// passed in registers and spilled to home slots the parser reserved like
+// locals, the rest are pushed. Return values are in %eax. Crust and extern
+// functions share this convention, except extern ones keep %rbx.
+#define ASM64_NREGARGS 6
+// Struct copies up to this many bytes use SSE2 moves, larger ones rep movsl
+#define ASM64_COPY_SSE_MAX 128
+
+extern const char *g_asm64_arg_regs[ASM64_NREGARGS];
+
+struct Asm *asm64_alloc(struct Args *args, bool main);
+void asm64_gen_profile_writer(struct Asm *as);
+void asm64_gen_trace_hooks(struct Asm *as);
+void asm64_gen_trace_writer(struct Asm *as);
+
+void asm64_gen_expr(struct Asm *as, struct Node *node);
+
+void asm64_gen_function_def(struct Asm *as, struct Node *node);
+void asm64_gen_return(struct Asm *as, struct Node *node);
+void asm64_gen_return_struct(struct Asm *as, struct Node *node);
+void asm64_gen_return_init_list(struct Asm *as, struct Node *node, int offset);
+void asm64_gen_load_return_ptr(struct Asm *as, const char *reg);
+void asm64_gen_epilogue(struct Asm *as);
+void asm64_gen_tail_call(struct Asm *as, struct Node *node);
+
+void asm64_gen_variable_def(struct Asm *as, struct Node *node);
+void asm64_gen_add_to_stack(struct Asm *as, struct Node *node, int stack_offset);
+void asm64_gen_init_list_rodata(struct Asm *as, struct Node *node, const char *dst_base, int dst_offset);
+
+void asm64_gen_function_call(struct Asm *as, struct Node *node);
+// Pushes every arg, then pops the first ones into their registers
+void asm64_gen_args(struct Asm *as, struct Node *node);
+void asm64_gen_push_args_primitive(struct Asm *as, struct Node *node);
+void asm64_gen_push_args_struct(struct Asm *as, struct Node *node);
+
+void asm64_gen_assignment(struct Asm *as, struct Node *node);
+void asm64_gen_assignment_struct(struct Asm *as, struct Node *node);
+
+void asm64_gen_copy_struct(struct Asm *as, struct Node *src, const char *dst_base, int dst_offset);
+char *asm64_gen_struct_base(struct Asm *as, struct Node *node, char *reg, int *offset);
+void asm64_gen_copy(struct Asm *as, const char *src_base, int src_offset, const char *dst_base, int dst_offset, size_t size);
+
+void asm64_gen_binop(struct Asm *as, struct Node *node);
+void asm64_gen_binop_const(struct Asm *as, struct Node *node);
+
+void asm64_gen_inline_asm(struct Asm *as, struct Node *node);
+
+void asm64_gen_if_statement(struct Asm *as, struct Node *node);
+void asm64_gen_cmp(struct Asm *as, struct Node *node);
+void asm64_gen_select(struct Asm *as, struct Node *node);
+
+void asm64_gen_while(struct Asm *as, struct Node *node);
+void asm64_gen_for(struct Asm *as, struct Node *node);
+void asm64_gen_for_unrolled(struct Asm *as, struct Node *node);
+void asm64_gen_loop_top(struct Asm *as, size_t label);
+
+char *asm64_str_from_node(struct Asm *as, struct Node *node);
+char *asm64_str_from_var(struct Asm *as, struct Node *node);
+char *asm64_str_from_var_var(struct Asm *as, struct Node *node);
+char *asm64_str_from_var_def(struct Asm *as, struct Node *node);
+char *asm64_str_from_function_call(struct Asm *as, struct Node *node);
+char *asm64_str_from_init_list(struct Asm *as, struct Node *node);
+
+#endif
+
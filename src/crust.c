@@ -2,29 +2,73 @@
 #include "lexer.h"
 #include "parser.h"
 #include "asm.h"
+#include "asm64.h"
 #include "scope.h"
 #include "util.h"
 #include "errors.h"
+#include "stats.h"
+#include "dce.h"
+#include "profile.h"
+#include "order.h"
+#include "trace.h"
 
 #include <string.h>
+#include <glob.h>
 
 
 void crust_compile(struct Args *args)
 {
+    if (args->trace_report)
+    {
+        trace_report(args->trace_report);
+
+        // Only reading a trace
+        if (!args->nsources)
+            return;
+    }
+
     char **objs = malloc(sizeof(char*) * args->nsources);
     size_t nobjs = args->nsources;
 
-    for (size_t i = 0; i < args->nsources; ++i)
+    if (args->profile_use)
+        profile_load(args->profile_use);
+
+    if (args->perf_script)
+        order_load_perf(args->perf_script);
+
+    if (args->lto && !args->link_objs)
+        errors_warn_lto_without_link();
+
+    if (args->lto && args->link_objs)
     {
-        crust_compile_file(args, args->sources[i]);
+        objs[0] = crust_compile_program(args);
+        util_rename_extension(&objs[0], ".o");
+        nobjs = 1;
+    }
+    else
+    {
+        for (size_t i = 0; i < args->nsources; ++i)
+        {
+            crust_compile_file(args, args->sources[i]);
 
-        objs[i] = util_strcpy(args->sources[i]);
-        util_rename_extension(&objs[i], ".o");
+            objs[i] = util_strcpy(args->sources[i]);
+            util_rename_extension(&objs[i], ".o");
+        }
     }
 
+    if (args->order_generate)
+        order_write(args->order_generate);
+
     if (args->link_objs)
         crust_link(args, objs, nobjs);
 
+    if (args->print_stats)
+        stats_print();
+
+    stats_free();
+    profile_free();
+    order_free();
+
     for (size_t i = 0; i < nobjs; ++i)
     {
         if (args->link_objs)
@@ -50,7 +94,17 @@ void crust_compile_file(struct Args *args, char *file)
     errors_load_source(source, nlines);
 
     struct Node *root = crust_gen_ast(args, file);
+    crust_compile_ast(args, root, file);
 
+    for (size_t i = 0; i < nlines; ++i)
+        free(source[i]);
+
+    free(source);
+}
+
+
+void crust_compile_ast(struct Args *args, struct Node *root, char *file)
+{
     bool main = false;
 
     for (size_t i = 0; i < root->compound_size; ++i)
@@ -62,16 +116,165 @@ void crust_compile_file(struct Args *args, char *file)
         }
     }
 
+    dce_program(root, args);
+
+    if (args->order_generate)
+        order_add_unit(root);
+
     char *as = crust_gen_asm(root, args, main);
     crust_assemble(as, args, file);
 
     node_free(root);
     free(as);
+}
 
-    for (size_t i = 0; i < nlines; ++i)
-        free(source[i]);
 
-    free(source);
+char *crust_compile_program(struct Args *args)
+{
+    size_t nfiles;
+    char **files = crust_program_sources(args, &nfiles);
+
+    struct Token ***tokens = malloc(sizeof(struct Token**) * nfiles);
+    size_t *ntokens = malloc(sizeof(size_t) * nfiles);
+    bool *main = malloc(sizeof(bool) * nfiles);
+
+    for (size_t i = 0; i < nfiles; ++i)
+    {
+        tokens[i] = crust_tokenize(files[i], &ntokens[i]);
+        main[i] = crust_check_main(tokens[i], ntokens[i]);
+    }
+
+    struct Node *root = node_alloc(NODE_COMPOUND);
+    root->compound_nodes = 0;
+    root->compound_size = 0;
+
+    struct Parser *parser = 0;
+    char ***sources = malloc(sizeof(char**) * nfiles);
+    size_t *nlines = malloc(sizeof(size_t) * nfiles);
+    char *file = 0;
+
+    // Callees have to be parsed before their callers to be inlined, so
+    // the stdlib comes first and the sources defining main last
+    for (int pass = 0; pass < 2; ++pass)
+    {
+        for (size_t i = 0; i < nfiles; ++i)
+        {
+            if (main[i] != (pass == 1))
+                continue;
+
+            sources[i] = util_read_file_lines(files[i], &nlines[i]);
+            errors_load_source(sources[i], nlines[i]);
+
+            if (!parser)
+                parser = parser_alloc(tokens[i], ntokens[i], args);
+            else
+                parser_set_tokens(parser, tokens[i], ntokens[i]);
+
+            parser->file = files[i];
+
+            // The stdlib comes before the user's sources
+            bool stdlib = i < nfiles - args->nsources;
+            bool idof = args->warnings[WARNING_REDUNDANT_IDOF];
+            args->warnings[WARNING_REDUNDANT_IDOF] = idof && !stdlib;
+
+            struct Node *part = parser_parse_compound(parser);
+            args->warnings[WARNING_REDUNDANT_IDOF] = idof;
+
+            for (size_t j = 0; j < part->compound_size; ++j)
+            {
+                if (part->compound_nodes[j]->type == NODE_FUNCTION_DEF)
+                    part->compound_nodes[j]->function_def_is_stdlib = stdlib;
+            }
+
+            root->compound_nodes = realloc(root->compound_nodes,
+                    sizeof(struct Node*) * (root->compound_size + part->compound_size));
+            memcpy(&root->compound_nodes[root->compound_size], part->compound_nodes,
+                    sizeof(struct Node*) * part->compound_size);
+            root->compound_size += part->compound_size;
+
+            free(part->compound_nodes);
+            free(part);
+
+            // The unit is named after the source defining main
+            if (!file || main[i])
+                file = files[i];
+        }
+    }
+
+    parser_free(parser);
+
+    // Nodes don't know which source they came from, so errors found while
+    // generating assembly can't quote their lines
+    errors_load_source(0, 0);
+    crust_compile_ast(args, root, file);
+    file = util_strcpy(file);
+
+    for (size_t i = 0; i < nfiles; ++i)
+    {
+        for (size_t j = 0; j < ntokens[i]; ++j)
+            token_free(tokens[i][j]);
+
+        for (size_t j = 0; j < nlines[i]; ++j)
+            free(sources[i][j]);
+
+        free(tokens[i]);
+        free(sources[i]);
+        free(files[i]);
+    }
+
+    free(files);
+    free(tokens);
+    free(ntokens);
+    free(main);
+    free(sources);
+    free(nlines);
+
+    return file;
+}
+
+
+char **crust_program_sources(struct Args *args, size_t *nfiles)
+{
+    char *pattern = util_strcpy(args->stdlib_dir);
+    util_strcat(&pattern, "*.crust");
+
+    glob_t g;
+    char **files = 0;
+    *nfiles = 0;
+
+    if (glob(pattern, 0, 0, &g) == 0)
+    {
+        for (size_t i = 0; i < g.gl_pathc; ++i)
+        {
+            files = realloc(files, sizeof(char*) * ++*nfiles);
+            files[*nfiles - 1] = util_strcpy(g.gl_pathv[i]);
+        }
+
+        globfree(&g);
+    }
+
+    free(pattern);
+
+    for (size_t i = 0; i < args->nsources; ++i)
+    {
+        files = realloc(files, sizeof(char*) * ++*nfiles);
+        files[*nfiles - 1] = util_strcpy(args->sources[i]);
+    }
+
+    return files;
+}
+
+
+bool crust_check_main(struct Token **tokens, size_t ntokens)
+{
+    for (size_t i = 0; i + 1 < ntokens; ++i)
+    {
+        if (tokens[i]->type == TOKEN_ID && strcmp(tokens[i]->value, "fn") == 0 &&
+            strcmp(tokens[i + 1]->value, "main") == 0)
+            return true;
+    }
+
+    return false;
 }
 
 
@@ -81,6 +284,7 @@ struct Node *crust_gen_ast(struct Args *args, char *file)
     struct Token **tokens = crust_tokenize(file, &ntokens);
 
     struct Parser *parser = parser_alloc(tokens, ntokens, args);
+    parser->file = file;
     struct Node *root = parser_parse_compound(parser);
 
     parser_free(parser);
@@ -117,12 +321,24 @@ struct Token **crust_tokenize(char *file, size_t *ntokens)
 
 char *crust_gen_asm(struct Node *root, struct Args *args, bool main)
 {
-    struct Asm *as = asm_alloc(args, main);
-    asm_gen_expr(as, root);
+    struct Asm *as;
+
+    if (args->target == TARGET_X86_64)
+    {
+        as = asm64_alloc(args, main);
+        asm64_gen_expr(as, root);
+    }
+    else
+    {
+        as = asm_alloc(args, main);
+        asm_gen_expr(as, root);
+    }
 
-    size_t len = strlen(as->data) + strlen(as->root);
+    asm_gen_inline_copies(as);
+
+    size_t len = strlen(as->data) + strlen(as->rodata) + strlen(as->root);
     char *s = malloc(sizeof(char) * (len + 1));
-    sprintf(s, "%s%s", as->data, as->root);
+    sprintf(s, "%s%s%s", as->data, as->rodata, as->root);
     s[len] = '\0';
 
     asm_free(as);
@@ -140,7 +356,7 @@ void crust_assemble(char *as, struct Args *args, char *file)
     fprintf(out, "%s\n", as);
     fclose(out);
 
-    char *cmd = util_strcpy("as --32 ");
+    char *cmd = util_strcpy(args->target == TARGET_X86_64 ? "as --64 " : "as --32 ");
 
     util_strcat(&cmd, path);
     util_strcat(&cmd, " -o ");
@@ -156,7 +372,11 @@ void crust_assemble(char *as, struct Args *args, char *file)
 
 void crust_link(struct Args *args, char **files, size_t nfiles)
 {
-    char *s = util_strcpy("ld -m elf_i386");
+    char *s = util_strcpy(args->target == TARGET_X86_64 ? "ld -m elf_x86_64" : "ld -m elf_i386");
+
+    // Drops the function and string sections nothing refers to
+    if (args->optimize)
+        util_strcat(&s, " --gc-sections");
 
     for (size_t i = 0; i < nfiles; ++i)
     {
@@ -176,7 +396,55 @@ void crust_link(struct Args *args, char **files, size_t nfiles)
         util_strcat(&s, args->libs[i]);
     }
 
+    char *script = args->function_order ? crust_link_script(args->function_order) : 0;
+
+    if (script)
+    {
+        util_strcat(&s, " -T ");
+        util_strcat(&s, script);
+    }
+
     system(s);
     free(s);
+
+    if (script && !args->keep_assembly)
+        remove(script);
+
+    free(script);
+}
+
+
+char *crust_link_script(char *order)
+{
+    size_t nfuncs;
+    char **funcs = util_read_file_lines(order, &nfuncs);
+
+    if (!funcs)
+        return 0;
+
+    char *path = util_strcpy(order);
+    util_strcat(&path, ".ld");
+
+    FILE *out = fopen(path, "w");
+
+    // Added in front of the default script's .text, so these sections are
+    // taken before its own patterns see them
+    fprintf(out, "SECTIONS\n{\n    .text.ordered :\n    {\n");
+
+    for (size_t i = 0; i < nfuncs; ++i)
+    {
+        funcs[i][strcspn(funcs[i], "\n")] = '\0';
+
+        if (funcs[i][0])
+            fprintf(out, "        *(.text.hot.%s .text.%s)\n", funcs[i], funcs[i]);
+
+        free(funcs[i]);
+    }
+
+    fprintf(out, "    }\n}\nINSERT BEFORE .text;\n");
+    fclose(out);
+    free(funcs);
+
+    return path;
 }
 
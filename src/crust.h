@@ -2,9 +2,19 @@
 #define CRUST_H
 
 #include "args.h"
+#include "node.h"
+#include "token.h"
 
 void crust_compile(struct Args *args);
 void crust_compile_file(struct Args *args, char *file);
+void crust_compile_ast(struct Args *args, struct Node *root, char *file);
+
+// -flto: every source and the stdlib's are parsed into one unit, so
+// functions can be inlined and found dead across them. Returns the
+// source the unit's .s and .o are named after.
+char *crust_compile_program(struct Args *args);
+char **crust_program_sources(struct Args *args, size_t *nfiles);
+bool crust_check_main(struct Token **tokens, size_t ntokens);
 
 struct Node *crust_gen_ast(struct Args *args, char *file);
 struct Token **crust_tokenize(char *file, size_t *ntokens);
@@ -13,6 +23,9 @@ char *crust_gen_asm(struct Node *root, struct Args *args, bool main);
 
 void crust_assemble(char *as, struct Args *args, char *file);
 void crust_link(struct Args *args, char **files, size_t nfiles);
+// Linker script placing the function sections in the order listed in the
+// file, written next to it. Returns its path, or 0 if order can't be read.
+char *crust_link_script(char *order);
 
 #endif
 
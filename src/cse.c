@@ -0,0 +1,558 @@
+#include "cse.h"
+#include "asm.h"
+#include "loop.h"
+#include "stats.h"
+#include "util.h"
+
+#include <stdio.h>
+#include <string.h>
+
+
+void cse_function(struct Parser *parser, struct Node *func)
+{
+    struct Cse cse = {
+        .parser = parser,
+        .func = func,
+        .hoist = true
+    };
+
+    struct CseAvail avail = { 0 };
+
+    cse_block(&cse, func->function_def_body, &avail);
+    free(avail.exprs);
+
+    cse_materialize(&cse);
+    cse_free(&cse);
+}
+
+
+void cse_block(struct Cse *cse, struct Node *compound, struct CseAvail *avail)
+{
+    struct Node *prev_compound = cse->compound;
+    size_t prev_stmt = cse->stmt;
+
+    for (size_t i = 0; i < compound->compound_size; ++i)
+    {
+        cse->compound = compound;
+        cse->stmt = i;
+        cse->called = false;
+
+        cse_stmt(cse, compound->compound_nodes[i], avail);
+    }
+
+    cse->compound = prev_compound;
+    cse->stmt = prev_stmt;
+}
+
+
+void cse_stmt(struct Cse *cse, struct Node *node, struct CseAvail *avail)
+{
+    switch (node->type)
+    {
+    case NODE_COMPOUND:
+        cse_block(cse, node, avail);
+        break;
+
+    case NODE_VARIABLE_DEF:
+        cse_expr(cse, &node->variable_def_value, avail);
+        cse_kill_var(avail, node->variable_def_name);
+        break;
+
+    case NODE_ASSIGNMENT:
+        cse_expr(cse, &node->assignment_src, avail);
+        cse_kill(avail, node);
+        break;
+
+    case NODE_RETURN:
+        cse_expr(cse, &node->return_value, avail);
+        break;
+
+    case NODE_FUNCTION_CALL:
+        cse_function_call(cse, node, avail);
+        break;
+
+    case NODE_INLINE_ASM:
+        avail->nexprs = 0;
+        break;
+
+    case NODE_IF:
+        cse_expr(cse, &node->if_cond, avail);
+        cse_nested(cse, node->if_body, avail, cse->hoist);
+        break;
+
+    case NODE_WHILE:
+        // The condition is evaluated again on every iteration
+        cse_kill(avail, node);
+        cse_nested(cse, node->while_body, avail, cse->hoist);
+        break;
+
+    case NODE_FOR:
+        cse_expr(cse, &node->for_var->variable_def_value, avail);
+        cse_expr(cse, &node->for_end, avail);
+        cse_kill(avail, node);
+        cse_nested(cse, node->for_body, avail, cse->hoist && !loop_check_unroll(node, cse->parser->args));
+        break;
+
+    default: break;
+    }
+}
+
+
+void cse_nested(struct Cse *cse, struct Node *body, struct CseAvail *avail, bool hoist)
+{
+    struct CseAvail inner = { 0 };
+
+    if (cse->parser->args->optimize >= 2)
+    {
+        inner.exprs = malloc(sizeof(struct CseExpr*) * (avail->nexprs + 1));
+        inner.nexprs = avail->nexprs;
+        memcpy(inner.exprs, avail->exprs, sizeof(struct CseExpr*) * avail->nexprs);
+    }
+
+    bool prev_hoist = cse->hoist;
+    cse->hoist = hoist;
+
+    if (body->type == NODE_COMPOUND)
+        cse_block(cse, body, &inner);
+
+    cse->hoist = prev_hoist;
+    free(inner.exprs);
+
+    // Only the values the body leaves alone are available on both paths out of it
+    if (cse->parser->args->optimize >= 2)
+        cse_kill(avail, body);
+    else
+        avail->nexprs = 0;
+}
+
+
+void cse_expr(struct Cse *cse, struct Node **slot, struct CseAvail *avail)
+{
+    struct Node *node = *slot;
+
+    switch (node->type)
+    {
+    case NODE_BINOP:
+    {
+        // Members may have changed since the statement began
+        if (!cse_check_pure(node) || (cse->called && cse_check_member(node)))
+        {
+            cse_expr(cse, &node->op_l, avail);
+            cse_expr(cse, &node->op_r, avail);
+            break;
+        }
+
+        for (size_t i = 0; i < avail->nexprs; ++i)
+        {
+            struct CseExpr *e = avail->exprs[i];
+
+            if (cse_cmp(e->expr, node))
+            {
+                e->slots = realloc(e->slots, sizeof(struct Node**) * ++e->nslots);
+                e->slots[e->nslots - 1] = slot;
+                return;
+            }
+        }
+
+        cse_expr(cse, &node->op_l, avail);
+        cse_expr(cse, &node->op_r, avail);
+
+        if (!cse->hoist || !cse_check_worth(node))
+            break;
+
+        struct CseExpr *e = calloc(1, sizeof(struct CseExpr));
+        e->expr = node;
+        e->slots = malloc(sizeof(struct Node**));
+        e->slots[0] = slot;
+        e->nslots = 1;
+        e->compound = cse->compound;
+        e->stmt = cse->stmt;
+        e->order = cse->order++;
+
+        cse->exprs = realloc(cse->exprs, sizeof(struct CseExpr*) * ++cse->nexprs);
+        cse->exprs[cse->nexprs - 1] = e;
+
+        avail->exprs = realloc(avail->exprs, sizeof(struct CseExpr*) * ++avail->nexprs);
+        avail->exprs[avail->nexprs - 1] = e;
+    } break;
+
+    case NODE_FUNCTION_CALL:
+        cse_function_call(cse, node, avail);
+        break;
+
+    case NODE_INIT_LIST:
+        for (size_t i = 0; i < node->init_list_len; ++i)
+            cse_expr(cse, &node->init_list_values[i], avail);
+        break;
+
+    default: break;
+    }
+}
+
+
+void cse_function_call(struct Cse *cse, struct Node *node, struct CseAvail *avail)
+{
+    // Inlined bodies hold copies of the args
+    if (node->function_call_inlined)
+    {
+        cse_kill(avail, node->function_call_inlined);
+
+        if (cse_check_writes(node->function_call_inlined))
+            cse->called = true;
+
+        return;
+    }
+
+    // Struct args are passed by reference. Ints can't be reached from the callee.
+    cse_kill_members(avail);
+    cse->called = true;
+
+    for (size_t i = 0; i < node->function_call_args_size; ++i)
+        cse_expr(cse, &node->function_call_args[i], avail);
+}
+
+
+void cse_kill(struct CseAvail *avail, struct Node *node)
+{
+    switch (node->type)
+    {
+    case NODE_COMPOUND:
+        for (size_t i = 0; i < node->compound_size; ++i)
+            cse_kill(avail, node->compound_nodes[i]);
+        break;
+
+    case NODE_VARIABLE_DEF:
+        cse_kill_var(avail, node->variable_def_name);
+        cse_kill(avail, node->variable_def_value);
+        break;
+
+    case NODE_ASSIGNMENT:
+        if (node->assignment_dst->variable_struct_member)
+            cse_kill_members(avail);
+
+        cse_kill_var(avail, node->assignment_dst->variable_name);
+        cse_kill(avail, node->assignment_src);
+        break;
+
+    case NODE_RETURN:
+        cse_kill(avail, node->return_value);
+        break;
+
+    case NODE_FUNCTION_CALL:
+        if (node->function_call_inlined)
+        {
+            cse_kill(avail, node->function_call_inlined);
+            break;
+        }
+
+        cse_kill_members(avail);
+
+        for (size_t i = 0; i < node->function_call_args_size; ++i)
+            cse_kill(avail, node->function_call_args[i]);
+        break;
+
+    case NODE_INLINE_ASM:
+        avail->nexprs = 0;
+        break;
+
+    case NODE_BINOP:
+        cse_kill(avail, node->op_l);
+        cse_kill(avail, node->op_r);
+        break;
+
+    case NODE_INIT_LIST:
+        for (size_t i = 0; i < node->init_list_len; ++i)
+            cse_kill(avail, node->init_list_values[i]);
+        break;
+
+    case NODE_IF:
+        cse_kill(avail, node->if_cond);
+        cse_kill(avail, node->if_body);
+        break;
+
+    case NODE_WHILE:
+        cse_kill(avail, node->while_cond);
+        cse_kill(avail, node->while_body);
+        break;
+
+    case NODE_FOR:
+        cse_kill(avail, node->for_var);
+        cse_kill(avail, node->for_end);
+
+        for (size_t i = 0; i < node->for_nivs; ++i)
+            cse_kill(avail, node->for_ivs[i]);
+
+        cse_kill(avail, node->for_body);
+        break;
+
+    default: break;
+    }
+}
+
+
+void cse_kill_var(struct CseAvail *avail, char *name)
+{
+    size_t n = 0;
+
+    for (size_t i = 0; i < avail->nexprs; ++i)
+    {
+        if (!cse_check_uses(avail->exprs[i]->expr, name))
+            avail->exprs[n++] = avail->exprs[i];
+    }
+
+    avail->nexprs = n;
+}
+
+
+void cse_kill_members(struct CseAvail *avail)
+{
+    size_t n = 0;
+
+    for (size_t i = 0; i < avail->nexprs; ++i)
+    {
+        if (!cse_check_member(avail->exprs[i]->expr))
+            avail->exprs[n++] = avail->exprs[i];
+    }
+
+    avail->nexprs = n;
+}
+
+
+void cse_materialize(struct Cse *cse)
+{
+    struct CseExpr **temps = malloc(sizeof(struct CseExpr*) * (cse->nexprs + 1));
+    size_t ntemps = 0;
+
+    for (size_t i = 0; i < cse->nexprs; ++i)
+    {
+        if (cse->exprs[i]->nslots > 1)
+            temps[ntemps++] = cse->exprs[i];
+    }
+
+    // Later statements first so the indices of earlier ones don't move
+    qsort(temps, ntemps, sizeof(struct CseExpr*), cse_cmp_insert);
+
+    for (size_t i = 0; i < ntemps; ++i)
+    {
+        struct CseExpr *e = temps[i];
+        struct Parser *parser = cse->parser;
+
+        char *name = calloc(strlen("cse.") + MAX_INT_LEN + 1, sizeof(char));
+        sprintf(name, "cse.%zu", e->order);
+
+        struct Node *def = node_alloc(NODE_VARIABLE_DEF);
+        def->error_line = e->expr->error_line;
+        def->variable_def_name = name;
+        def->variable_def_type = (NodeDType){ NODE_INT, 0 };
+        def->variable_def_value = e->expr;
+        def->variable_def_stack_offset = -parser->stack_size;
+        parser->stack_size += 4;
+
+        for (size_t j = 0; j < e->nslots; ++j)
+        {
+            if (j > 0)
+                node_free(*e->slots[j]);
+
+            struct Node *var = node_alloc(NODE_VARIABLE);
+            var->error_line = e->expr->error_line;
+            var->variable_name = util_strcpy(name);
+            var->variable_type = (NodeDType){ NODE_INT, 0 };
+            var->variable_stack_offset = def->variable_def_stack_offset;
+
+            *e->slots[j] = var;
+        }
+
+        struct Node *compound = e->compound;
+        compound->compound_nodes = realloc(compound->compound_nodes, sizeof(struct Node*) * ++compound->compound_size);
+        memmove(&compound->compound_nodes[e->stmt + 1], &compound->compound_nodes[e->stmt],
+                sizeof(struct Node*) * (compound->compound_size - e->stmt - 1));
+        compound->compound_nodes[e->stmt] = def;
+    }
+
+    if (ntemps)
+        stats_add_cse(cse->func->function_def_name, ntemps);
+
+    free(temps);
+}
+
+
+int cse_cmp_insert(const void *a, const void *b)
+{
+    const struct CseExpr *e1 = *(const struct CseExpr**)a;
+    const struct CseExpr *e2 = *(const struct CseExpr**)b;
+
+    if (e1->stmt != e2->stmt)
+        return e1->stmt < e2->stmt ? 1 : -1;
+
+    // Inserted at the same index, so the last one inserted ends up first
+    return e1->order < e2->order ? 1 : -1;
+}
+
+
+bool cse_check_pure(struct Node *node)
+{
+    switch (node->type)
+    {
+    case NODE_INT:
+        return true;
+
+    case NODE_VARIABLE:
+    {
+        struct Node *var = node;
+
+        while (var->variable_struct_member)
+            var = var->variable_struct_member;
+
+        return var->variable_type.type == NODE_INT;
+    }
+
+    case NODE_BINOP:
+        return cse_check_pure(node->op_l) && cse_check_pure(node->op_r);
+
+    default: return false;
+    }
+}
+
+
+bool cse_check_worth(struct Node *node)
+{
+    if (node->op_l->type == NODE_BINOP || node->op_r->type == NODE_BINOP)
+        return true;
+
+    return node->op_l->type != NODE_INT && node->op_r->type != NODE_INT;
+}
+
+
+bool cse_check_member(struct Node *node)
+{
+    switch (node->type)
+    {
+    case NODE_VARIABLE:
+        return node->variable_struct_member != 0;
+
+    case NODE_BINOP:
+        return cse_check_member(node->op_l) || cse_check_member(node->op_r);
+
+    default: return false;
+    }
+}
+
+
+bool cse_check_uses(struct Node *node, char *name)
+{
+    switch (node->type)
+    {
+    case NODE_VARIABLE:
+        return strcmp(node->variable_name, name) == 0;
+
+    case NODE_BINOP:
+        return cse_check_uses(node->op_l, name) || cse_check_uses(node->op_r, name);
+
+    default: return false;
+    }
+}
+
+
+bool cse_check_writes(struct Node *node)
+{
+    switch (node->type)
+    {
+    case NODE_COMPOUND:
+        for (size_t i = 0; i < node->compound_size; ++i)
+        {
+            if (cse_check_writes(node->compound_nodes[i]))
+                return true;
+        }
+
+        return false;
+
+    case NODE_ASSIGNMENT:
+        return node->assignment_dst->variable_struct_member || cse_check_writes(node->assignment_src);
+
+    case NODE_VARIABLE_DEF:
+        return cse_check_writes(node->variable_def_value);
+
+    case NODE_RETURN:
+        return cse_check_writes(node->return_value);
+
+    case NODE_FUNCTION_CALL:
+        return !node->function_call_inlined || cse_check_writes(node->function_call_inlined);
+
+    case NODE_BINOP:
+        return cse_check_writes(node->op_l) || cse_check_writes(node->op_r);
+
+    case NODE_INIT_LIST:
+        for (size_t i = 0; i < node->init_list_len; ++i)
+        {
+            if (cse_check_writes(node->init_list_values[i]))
+                return true;
+        }
+
+        return false;
+
+    case NODE_INLINE_ASM:
+    case NODE_IF:
+    case NODE_WHILE:
+    case NODE_FOR:
+        return true;
+
+    default: return false;
+    }
+}
+
+
+bool cse_cmp(struct Node *a, struct Node *b)
+{
+    if (a->type != b->type)
+        return false;
+
+    switch (a->type)
+    {
+    case NODE_INT:
+        return a->int_value == b->int_value;
+
+    case NODE_VARIABLE:
+        while (a && b)
+        {
+            if (strcmp(a->variable_name, b->variable_name) != 0)
+                return false;
+
+            a = a->variable_struct_member;
+            b = b->variable_struct_member;
+        }
+
+        return !a && !b;
+
+    case NODE_BINOP:
+        if (a->op_type != b->op_type)
+            return false;
+
+        if (cse_cmp(a->op_l, b->op_l) && cse_cmp(a->op_r, b->op_r))
+            return true;
+
+        // Commutative ops match with their operands swapped
+        switch (a->op_type)
+        {
+        case OP_PLUS:
+        case OP_MUL:
+        case OP_CMP:
+        case OP_NE:
+            return cse_cmp(a->op_l, b->op_r) && cse_cmp(a->op_r, b->op_l);
+        default: return false;
+        }
+
+    default: return false;
+    }
+}
+
+
+void cse_free(struct Cse *cse)
+{
+    for (size_t i = 0; i < cse->nexprs; ++i)
+    {
+        free(cse->exprs[i]->slots);
+        free(cse->exprs[i]);
+    }
+
+    free(cse->exprs);
+}
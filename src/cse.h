@@ -0,0 +1,84 @@
+#ifndef CSE_H
+#define CSE_H
+
+#include "node.h"
+#include "parser.h"
+
+#include <stdbool.h>
+
+// Common subexpression elimination by value numbering. Int binops computed
+// more than once while their operands keep their values are evaluated once
+// into a temporary defined before the statement of their first occurrence.
+// At -O each run of statements is numbered on its own; at -O2 if and loop
+// bodies also reuse the values available where they're entered. Calls can
+// only change struct members, which are passed by reference, so they only
+// end values that read members.
+// Runs once a function's body is parsed, before its frame is laid out.
+struct CseExpr
+{
+    // First occurrence, moved into the temporary's def
+    struct Node *expr;
+    struct Node ***slots;
+    size_t nslots;
+
+    // The temporary is defined before this statement
+    struct Node *compound;
+    size_t stmt;
+    // Inner expressions come first, their temporaries are defined first
+    size_t order;
+};
+
+// Values available at a point of a block
+struct CseAvail
+{
+    struct CseExpr **exprs;
+    size_t nexprs;
+};
+
+struct Cse
+{
+    struct Parser *parser;
+    struct Node *func;
+
+    struct CseExpr **exprs;
+    size_t nexprs, order;
+
+    // Statement being numbered
+    struct Node *compound;
+    size_t stmt;
+    // A call in it may have changed members already
+    bool called;
+    // Cleared in unrolled loops, whose bodies can't define variables
+    bool hoist;
+};
+
+void cse_function(struct Parser *parser, struct Node *func);
+void cse_block(struct Cse *cse, struct Node *compound, struct CseAvail *avail);
+void cse_stmt(struct Cse *cse, struct Node *node, struct CseAvail *avail);
+// Numbers body as its own block, entered with avail's values at -O2
+void cse_nested(struct Cse *cse, struct Node *body, struct CseAvail *avail, bool hoist);
+void cse_expr(struct Cse *cse, struct Node **slot, struct CseAvail *avail);
+void cse_function_call(struct Cse *cse, struct Node *node, struct CseAvail *avail);
+
+// Ends the values anything in node writes to
+void cse_kill(struct CseAvail *avail, struct Node *node);
+void cse_kill_var(struct CseAvail *avail, char *name);
+void cse_kill_members(struct CseAvail *avail);
+
+// Replaces every occurrence of the values used more than once with a temporary
+void cse_materialize(struct Cse *cse);
+int cse_cmp_insert(const void *a, const void *b);
+
+// Int binops of ints and int variables or members
+bool cse_check_pure(struct Node *node);
+// Binops by a constant are cheaper to compute again than to keep
+bool cse_check_worth(struct Node *node);
+bool cse_check_member(struct Node *node);
+bool cse_check_uses(struct Node *node, char *name);
+// Calls, asm or member assignments that can change members
+bool cse_check_writes(struct Node *node);
+bool cse_cmp(struct Node *a, struct Node *b);
+
+void cse_free(struct Cse *cse);
+
+#endif
@@ -0,0 +1,417 @@
+#include "dce.h"
+#include "stats.h"
+#include "token.h"
+#include "util.h"
+
+#include <string.h>
+
+
+void dce_function(struct Parser *parser, struct Node *func)
+{
+    dce_unreachable(func->function_def_body);
+    dce_stores(func, func->function_def_body);
+}
+
+
+void dce_unreachable(struct Node *node)
+{
+    switch (node->type)
+    {
+    case NODE_COMPOUND:
+    {
+        size_t n = 0;
+
+        for (size_t i = 0; i < node->compound_size; ++i)
+        {
+            struct Node *stmt = node->compound_nodes[i];
+
+            if ((stmt->type == NODE_IF && stmt->if_cond->type == NODE_INT && stmt->if_cond->int_value == 0) ||
+                (stmt->type == NODE_WHILE && stmt->while_cond->type == NODE_INT && stmt->while_cond->int_value == 0))
+            {
+                node_free(stmt);
+                continue;
+            }
+
+            dce_unreachable(stmt);
+            node->compound_nodes[n++] = stmt;
+
+            if (stmt->type == NODE_RETURN)
+            {
+                for (size_t j = i + 1; j < node->compound_size; ++j)
+                    node_free(node->compound_nodes[j]);
+
+                break;
+            }
+        }
+
+        node->compound_size = n;
+    } break;
+
+    case NODE_IF:
+        dce_unreachable(node->if_body);
+        break;
+
+    case NODE_WHILE:
+        dce_unreachable(node->while_body);
+        break;
+
+    case NODE_FOR:
+        dce_unreachable(node->for_body);
+        break;
+
+    default: break;
+    }
+}
+
+
+void dce_stores(struct Node *func, struct Node *node)
+{
+    switch (node->type)
+    {
+    case NODE_COMPOUND:
+        for (size_t i = 0; i < node->compound_size; ++i)
+        {
+            struct Node *def = node->compound_nodes[i];
+
+            if (def->type != NODE_VARIABLE_DEF)
+            {
+                dce_stores(func, def);
+                continue;
+            }
+
+            struct Node *var = node_alloc(NODE_VARIABLE);
+            var->variable_name = util_strcpy(def->variable_def_name);
+
+            if (!dce_check_read(func->function_def_body, var) && dce_check_pure(def->variable_def_value) &&
+                dce_check_stores(func->function_def_body, def->variable_def_name))
+            {
+                def->variable_def_is_dead = true;
+                dce_remove_assignments(func->function_def_body, def->variable_def_name);
+                ++g_stats.dead_stores;
+            }
+
+            node_free(var);
+        }
+        break;
+
+    case NODE_IF:
+        dce_stores(func, node->if_body);
+        break;
+
+    case NODE_WHILE:
+        dce_stores(func, node->while_body);
+        break;
+
+    case NODE_FOR:
+        dce_stores(func, node->for_body);
+        break;
+
+    default: break;
+    }
+}
+
+
+void dce_remove_assignments(struct Node *node, char *name)
+{
+    switch (node->type)
+    {
+    case NODE_COMPOUND:
+    {
+        size_t n = 0;
+
+        for (size_t i = 0; i < node->compound_size; ++i)
+        {
+            struct Node *stmt = node->compound_nodes[i];
+
+            if (stmt->type == NODE_ASSIGNMENT && strcmp(stmt->assignment_dst->variable_name, name) == 0)
+            {
+                node_free(stmt);
+                continue;
+            }
+
+            dce_remove_assignments(stmt, name);
+            node->compound_nodes[n++] = stmt;
+        }
+
+        node->compound_size = n;
+    } break;
+
+    case NODE_IF:
+        dce_remove_assignments(node->if_body, name);
+        break;
+
+    case NODE_WHILE:
+        dce_remove_assignments(node->while_body, name);
+        break;
+
+    case NODE_FOR:
+        dce_remove_assignments(node->for_body, name);
+        break;
+
+    default: break;
+    }
+}
+
+
+bool dce_check_read(struct Node *node, struct Node *var)
+{
+    switch (node->type)
+    {
+    case NODE_COMPOUND:
+        for (size_t i = 0; i < node->compound_size; ++i)
+        {
+            if (dce_check_read(node->compound_nodes[i], var))
+                return true;
+        }
+
+        return false;
+
+    // Names are only found where they're read, not where they're assigned to
+    case NODE_ASSIGNMENT:
+        return strcmp(node->assignment_dst->variable_name, var->variable_name) != 0 &&
+               node_find_node(node->assignment_src, var);
+
+    case NODE_IF:
+        return node_find_node(node->if_cond, var) || dce_check_read(node->if_body, var);
+
+    case NODE_WHILE:
+        return node_find_node(node->while_cond, var) || dce_check_read(node->while_body, var);
+
+    case NODE_FOR:
+        return node_find_node(node->for_var, var) || node_find_node(node->for_end, var) ||
+               dce_check_read(node->for_body, var);
+
+    default: return node_find_node(node, var);
+    }
+}
+
+
+bool dce_check_stores(struct Node *node, char *name)
+{
+    switch (node->type)
+    {
+    case NODE_COMPOUND:
+        for (size_t i = 0; i < node->compound_size; ++i)
+        {
+            if (!dce_check_stores(node->compound_nodes[i], name))
+                return false;
+        }
+
+        return true;
+
+    case NODE_ASSIGNMENT:
+        return strcmp(node->assignment_dst->variable_name, name) != 0 || dce_check_pure(node->assignment_src);
+
+    case NODE_IF:
+        return dce_check_stores(node->if_body, name);
+
+    case NODE_WHILE:
+        return dce_check_stores(node->while_body, name);
+
+    case NODE_FOR:
+        return dce_check_stores(node->for_body, name);
+
+    default: return true;
+    }
+}
+
+
+bool dce_check_pure(struct Node *node)
+{
+    switch (node->type)
+    {
+    case NODE_INT:
+    case NODE_STRING:
+    case NODE_VARIABLE:
+        return true;
+
+    case NODE_BINOP:
+        if ((node->op_type == OP_DIV || node->op_type == OP_MOD) &&
+            (node->op_r->type != NODE_INT || node->op_r->int_value == 0))
+            return false;
+
+        return dce_check_pure(node->op_l) && dce_check_pure(node->op_r);
+
+    case NODE_INIT_LIST:
+        for (size_t i = 0; i < node->init_list_len; ++i)
+        {
+            if (!dce_check_pure(node->init_list_values[i]))
+                return false;
+        }
+
+        return true;
+
+    default: return false;
+    }
+}
+
+
+void dce_program(struct Node *root, struct Args *args)
+{
+    if (!args->optimize)
+        return;
+
+    char **reached = 0;
+    size_t nreached = 0;
+
+    if (args->link_objs && (args->nsources == 1 || args->lto))
+        dce_reach_name(root, "main", &reached, &nreached);
+
+    bool closed = nreached > 0;
+
+    // Otherwise every function but the static ones is exported. extern fns
+    // are entry points for C code, so they're exported either way.
+    for (size_t i = 0; i < root->compound_size; ++i)
+    {
+        struct Node *def = root->compound_nodes[i];
+
+        if (def->type != NODE_FUNCTION_DEF || def->function_def_is_decl || def->function_def_is_static)
+            continue;
+
+        if (!closed || def->function_def_conv == CONV_CDECL)
+            dce_reach_name(root, def->function_def_name, &reached, &nreached);
+    }
+
+    for (size_t i = 0; i < root->compound_size; ++i)
+    {
+        struct Node *def = root->compound_nodes[i];
+
+        if (def->type != NODE_FUNCTION_DEF || def->function_def_is_decl)
+            continue;
+
+        bool live = false;
+
+        for (size_t j = 0; j < nreached && !live; ++j)
+            live = strcmp(reached[j], def->function_def_name) == 0;
+
+        if (!live)
+        {
+            def->function_def_is_dead = true;
+            stats_add_dead_function(def->function_def_name);
+        }
+    }
+
+    for (size_t i = 0; i < nreached; ++i)
+        free(reached[i]);
+
+    free(reached);
+}
+
+
+void dce_reach(struct Node *root, struct Node *func, char ***reached, size_t *nreached)
+{
+    *reached = realloc(*reached, sizeof(char*) * ++*nreached);
+    (*reached)[*nreached - 1] = util_strcpy(func->function_def_name);
+
+    dce_reach_node(root, func->function_def_body, reached, nreached);
+}
+
+
+void dce_reach_node(struct Node *root, struct Node *node, char ***reached, size_t *nreached)
+{
+    switch (node->type)
+    {
+    case NODE_COMPOUND:
+        for (size_t i = 0; i < node->compound_size; ++i)
+            dce_reach_node(root, node->compound_nodes[i], reached, nreached);
+        break;
+
+    case NODE_FUNCTION_CALL:
+        // Inlined bodies hold copies of the args, and the callee isn't called
+        if (node->function_call_inlined)
+        {
+            dce_reach_node(root, node->function_call_inlined, reached, nreached);
+            break;
+        }
+
+        dce_reach_name(root, node->function_call_name, reached, nreached);
+
+        for (size_t i = 0; i < node->function_call_args_size; ++i)
+            dce_reach_node(root, node->function_call_args[i], reached, nreached);
+        break;
+
+    case NODE_INLINE_ASM:
+        // Any function named in the asm might be called from it
+        for (size_t i = 0; i < node->asm_nargs; ++i)
+        {
+            if (node->asm_args[i]->type != NODE_STRING)
+                continue;
+
+            for (size_t j = 0; j < root->compound_size; ++j)
+            {
+                struct Node *def = root->compound_nodes[j];
+
+                if (def->type == NODE_FUNCTION_DEF && strstr(node->asm_args[i]->string_value, def->function_def_name))
+                    dce_reach_name(root, def->function_def_name, reached, nreached);
+            }
+        }
+        break;
+
+    case NODE_VARIABLE_DEF:
+        dce_reach_node(root, node->variable_def_value, reached, nreached);
+        break;
+
+    case NODE_ASSIGNMENT:
+        dce_reach_node(root, node->assignment_src, reached, nreached);
+        break;
+
+    case NODE_RETURN:
+        dce_reach_node(root, node->return_value, reached, nreached);
+        break;
+
+    case NODE_BINOP:
+        dce_reach_node(root, node->op_l, reached, nreached);
+        dce_reach_node(root, node->op_r, reached, nreached);
+        break;
+
+    case NODE_INIT_LIST:
+        for (size_t i = 0; i < node->init_list_len; ++i)
+            dce_reach_node(root, node->init_list_values[i], reached, nreached);
+        break;
+
+    case NODE_IDOF:
+        dce_reach_node(root, node->idof_original_expr, reached, nreached);
+        dce_reach_node(root, node->idof_new_expr, reached, nreached);
+        break;
+
+    case NODE_IF:
+        dce_reach_node(root, node->if_cond, reached, nreached);
+        dce_reach_node(root, node->if_body, reached, nreached);
+        break;
+
+    case NODE_WHILE:
+        dce_reach_node(root, node->while_cond, reached, nreached);
+        dce_reach_node(root, node->while_body, reached, nreached);
+        break;
+
+    case NODE_FOR:
+        dce_reach_node(root, node->for_var, reached, nreached);
+        dce_reach_node(root, node->for_end, reached, nreached);
+        dce_reach_node(root, node->for_body, reached, nreached);
+        break;
+
+    default: break;
+    }
+}
+
+
+void dce_reach_name(struct Node *root, char *name, char ***reached, size_t *nreached)
+{
+    for (size_t i = 0; i < *nreached; ++i)
+    {
+        if (strcmp((*reached)[i], name) == 0)
+            return;
+    }
+
+    for (size_t i = 0; i < root->compound_size; ++i)
+    {
+        struct Node *def = root->compound_nodes[i];
+
+        if (def->type == NODE_FUNCTION_DEF && !def->function_def_is_decl &&
+            strcmp(def->function_def_name, name) == 0)
+        {
+            dce_reach(root, def, reached, nreached);
+            return;
+        }
+    }
+}
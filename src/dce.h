@@ -0,0 +1,38 @@
+#ifndef DCE_H
+#define DCE_H
+
+#include "node.h"
+#include "parser.h"
+#include "args.h"
+
+#include <stdbool.h>
+
+// Dead code elimination. Statements after a return, and ifs and whiles on
+// the int 0, are removed. Locals that are never read and only ever hold
+// values without side effects are marked dead: their def isn't stored and
+// assignments to them are removed.
+// Runs once a function's body is parsed, before the other function passes.
+void dce_function(struct Parser *parser, struct Node *func);
+void dce_unreachable(struct Node *node);
+void dce_stores(struct Node *func, struct Node *node);
+void dce_remove_assignments(struct Node *node, char *name);
+
+// Reads outside of the values assigned to var itself
+bool dce_check_read(struct Node *node, struct Node *var);
+// Assignments to name in node only store values without side effects
+bool dce_check_stores(struct Node *node, char *name);
+// Division could trap unless the divisor is a nonzero int
+bool dce_check_pure(struct Node *node);
+
+// A unit defining main that is linked into an executable on its own, or
+// that holds the whole program with -flto, only exports main and its
+// extern fns. Other units export their functions that aren't static.
+// Functions the exported ones can't reach are marked dead, so they're
+// checked like any other but not emitted.
+void dce_program(struct Node *root, struct Args *args);
+void dce_reach(struct Node *root, struct Node *func, char ***reached, size_t *nreached);
+// Follows calls, including the ones in inlined bodies, and names in inline asm
+void dce_reach_node(struct Node *root, struct Node *node, char ***reached, size_t *nreached);
+void dce_reach_name(struct Node *root, char *name, char ***reached, size_t *nreached);
+
+#endif
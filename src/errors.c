@@ -210,6 +210,20 @@ void errors_asm_check_assignment(struct Scope *scope, struct Node *assignment)
 }
 
 
+void errors_asm_check_loop_range(struct Scope *scope, struct Node *loop)
+{
+    NodeDType end_type = node_type_from_node(loop->for_end, scope);
+
+    if (end_type.type != NODE_INT)
+    {
+        fprintf(stderr, ERROR "Attempting to loop '%s' up to a value of type %s.\n",
+                        loop->for_var->variable_def_name, node_str_from_type(end_type));
+        errors_print_lines(loop->error_line);
+        exit(EXIT_FAILURE);
+    }
+}
+
+
 void errors_asm_check_init_list(struct Scope *scope, struct Node *list)
 {
     struct Node *struct_node = scope_find_struct(scope, list->init_list_type.struct_type, list->error_line);
@@ -265,6 +279,13 @@ void errors_args_no_opt_value(char *opt)
 }
 
 
+void errors_args_nonexistent_target(char *target)
+{
+    fprintf(stderr, ERROR "'%s' is not a valid target, expected i386 or x86_64.\n", target);
+    exit(EXIT_FAILURE);
+}
+
+
 void errors_scope_nonexistent_variable(char *name, size_t line)
 {
     fprintf(stderr, ERROR "Variable '%s' does not exist.\n", name);
@@ -349,6 +370,24 @@ void errors_warn_redundant_idof(struct Node *idof)
 }
 
 
+void errors_warn_missing_profile(char *path)
+{
+    fprintf(stderr, WARNING "Can't read profile '%s', compiling without it.\n", path);
+}
+
+
+void errors_warn_missing_trace(char *path)
+{
+    fprintf(stderr, WARNING "Can't read trace '%s'.\n", path);
+}
+
+
+void errors_warn_lto_without_link()
+{
+    fprintf(stderr, WARNING "-flto needs a link, compiling each file on its own with --obj.\n");
+}
+
+
 void errors_print_lines(size_t line)
 {
     int begin = line - ERROR_RANGE;
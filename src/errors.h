@@ -26,6 +26,7 @@ void errors_asm_check_function_def(struct Scope *scope, struct Node *def);
 
 void errors_asm_check_variable_def(struct Scope *scope, struct Node *def);
 void errors_asm_check_assignment(struct Scope *scope, struct Node *assignment);
+void errors_asm_check_loop_range(struct Scope *scope, struct Node *loop);
 
 void errors_asm_check_init_list(struct Scope *scope, struct Node *list);
 
@@ -33,6 +34,7 @@ void errors_asm_str_from_node(struct Node *node);
 
 void errors_args_nonexistent_warning(char *warning);
 void errors_args_no_opt_value(char *opt);
+void errors_args_nonexistent_target(char *target);
 
 void errors_scope_nonexistent_variable(char *name, size_t line);
 void errors_scope_nonexistent_function(char *name, size_t line);
@@ -43,6 +45,9 @@ void errors_warn_dead_code(struct Node *func_def);
 void errors_warn_unused_variable(struct Scope *scope, struct Node *func_def);
 void errors_warn_print_unused_variable(size_t line, char *var_name);
 void errors_warn_redundant_idof(struct Node *idof);
+void errors_warn_missing_profile(char *path);
+void errors_warn_missing_trace(char *path);
+void errors_warn_lto_without_link();
 
 void errors_print_lines(size_t line);
 void errors_print_line(size_t line);
@@ -0,0 +1,204 @@
+#include "frame.h"
+#include "stats.h"
+
+#include <stdio.h>
+
+
+void frame_layout(struct Node *func, struct Scope *scope, size_t base, bool reuse)
+{
+    struct Frame f = {
+        .func = func,
+        .scope = scope,
+        .base = base,
+        .reuse = reuse,
+        .depth_max = 0,
+        .total = 0
+    };
+
+    frame_alloc_stmt(&f, func->function_def_body);
+
+    // base starts at 4, the slot at -4(%ebp)
+    size_t vars = base - 4;
+    func->function_def_stack_size = vars + f.depth_max;
+
+    stats_add_frame(func->function_def_name, vars + f.total, func->function_def_stack_size);
+}
+
+
+void frame_alloc_stmt(struct Frame *f, struct Node *node)
+{
+    switch (node->type)
+    {
+    case NODE_COMPOUND:
+        for (size_t i = 0; i < node->compound_size; ++i)
+            frame_alloc_stmt(f, node->compound_nodes[i]);
+        break;
+
+    case NODE_VARIABLE_DEF:
+        // Init lists are built directly in the variable's slots
+        if (node->variable_def_value->type == NODE_INIT_LIST)
+            frame_alloc_init_list_values(f, node->variable_def_value, 0);
+        // So are struct results
+        else if (frame_check_rvo(f, node->variable_def_value))
+        {
+            frame_alloc_args(f, node->variable_def_value, 0);
+            node->variable_def_value->function_call_return_stack_offset = node->variable_def_stack_offset;
+        }
+        else
+            frame_alloc_expr(f, node->variable_def_value, 0);
+        break;
+
+    case NODE_RETURN:
+        // Returned structs are built through the caller's pointer
+        if (node->return_value->type == NODE_INIT_LIST)
+            frame_alloc_init_list_values(f, node->return_value, 0);
+        else if (f->func->function_def_return_type.type == NODE_STRUCT && frame_check_rvo(f, node->return_value))
+        {
+            frame_alloc_args(f, node->return_value, 0);
+            node->return_value->function_call_return_ptr_stack_offset = f->func->function_def_return_ptr_stack_offset;
+        }
+        else
+            frame_alloc_expr(f, node->return_value, 0);
+        break;
+
+    case NODE_ASSIGNMENT:
+        frame_alloc_expr(f, node->assignment_src, 0);
+        break;
+
+    case NODE_IF:
+        frame_alloc_expr(f, node->if_cond, 0);
+        frame_alloc_stmt(f, node->if_body);
+        break;
+
+    case NODE_WHILE:
+        frame_alloc_expr(f, node->while_cond, 0);
+        frame_alloc_stmt(f, node->while_body);
+        break;
+
+    case NODE_FOR:
+        frame_alloc_stmt(f, node->for_var);
+        frame_alloc_expr(f, node->for_end, 0);
+
+        for (size_t i = 0; i < node->for_nivs; ++i)
+            frame_alloc_stmt(f, node->for_ivs[i]);
+
+        frame_alloc_stmt(f, node->for_body);
+        break;
+
+    case NODE_INLINE_ASM:
+        for (size_t i = 0; i < node->asm_nargs; ++i)
+            frame_alloc_expr(f, node->asm_args[i], 0);
+        break;
+
+    default:
+        frame_alloc_expr(f, node, 0);
+        break;
+    }
+}
+
+
+size_t frame_alloc_expr(struct Frame *f, struct Node *node, size_t depth)
+{
+    switch (node->type)
+    {
+    case NODE_BINOP:
+        // Both operands are stored before either is read
+        node->op_stack_offset = frame_temp(f, depth, 8);
+        frame_alloc_expr(f, node->op_l, depth + 8);
+        frame_alloc_expr(f, node->op_r, depth + 8);
+        return depth;
+
+    case NODE_FUNCTION_CALL:
+    {
+        // Inlined calls only need the temporaries of the substituted body
+        if (node->function_call_inlined && node->function_call_inlined->type == NODE_COMPOUND)
+        {
+            frame_alloc_stmt(f, node->function_call_inlined);
+            return depth;
+        }
+
+        if (node->function_call_inlined)
+            return frame_alloc_expr(f, node->function_call_inlined, depth);
+
+        frame_alloc_args(f, node, depth);
+
+        struct Node *def = scope_find_function(f->scope, node->function_call_name, -1);
+        size_t size = 4;
+
+        if (def && def->function_def_return_type.struct_type)
+        {
+            struct Node *s = scope_find_struct(f->scope, def->function_def_return_type.struct_type, -1);
+
+            if (s)
+                size = node_sizeof_struct(s, f->scope);
+        }
+
+        node->function_call_return_stack_offset = frame_temp(f, depth, size);
+        return depth + size;
+    }
+
+    case NODE_INIT_LIST:
+    {
+        size_t size = node_sizeof_dtype(node);
+        node->init_list_stack_offset = frame_temp(f, depth, size);
+        frame_alloc_init_list_values(f, node, depth + size);
+        return depth + size;
+    }
+
+    case NODE_IDOF:
+        frame_alloc_expr(f, node->idof_original_expr, depth);
+        return frame_alloc_expr(f, node->idof_new_expr, depth);
+
+    default:
+        return depth;
+    }
+}
+
+
+void frame_alloc_args(struct Frame *f, struct Node *call, size_t depth)
+{
+    // Every argument is pushed as soon as it's evaluated
+    for (size_t i = 0; i < call->function_call_args_size; ++i)
+        frame_alloc_expr(f, call->function_call_args[i], depth);
+}
+
+
+void frame_alloc_init_list_values(struct Frame *f, struct Node *list, size_t depth)
+{
+    for (size_t i = 0; i < list->init_list_len; ++i)
+    {
+        struct Node *value = list->init_list_values[i];
+
+        // Nested lists live inside the parent's slots
+        if (value->type == NODE_INIT_LIST)
+            frame_alloc_init_list_values(f, value, depth);
+        else
+            frame_alloc_expr(f, value, depth);
+    }
+}
+
+
+bool frame_check_rvo(struct Frame *f, struct Node *node)
+{
+    if (node->type != NODE_FUNCTION_CALL || node->function_call_inlined)
+        return false;
+
+    struct Node *def = scope_find_function(f->scope, node->function_call_name, -1);
+    return def && def->function_def_return_type.type == NODE_STRUCT;
+}
+
+
+int frame_temp(struct Frame *f, size_t depth, size_t size)
+{
+    // Without reuse every temporary gets a fresh slot
+    if (!f->reuse)
+        depth = f->total;
+
+    f->total += size;
+
+    if (depth + size > f->depth_max)
+        f->depth_max = depth + size;
+
+    return -(int)(f->base + depth);
+}
+
@@ -0,0 +1,44 @@
+#ifndef FRAME_H
+#define FRAME_H
+
+#include "node.h"
+#include "scope.h"
+
+#include <stdbool.h>
+
+// Assigns stack slots to the temporaries of a function (binop operands, call
+// results, init lists that aren't stored in a variable). Variables keep the
+// slots the parser gave them, temporaries go below them.
+struct Frame
+{
+    struct Node *func;
+    struct Scope *scope;
+
+    // Parser stack size after the last variable
+    size_t base;
+
+    // Give temporaries with disjoint lifetimes the same slots
+    bool reuse;
+
+    size_t depth_max;
+    // Bytes of temporaries if none were shared
+    size_t total;
+};
+
+// Sets the stack offsets of every temporary in func and its frame size.
+void frame_layout(struct Node *func, struct Scope *scope, size_t base, bool reuse);
+
+void frame_alloc_stmt(struct Frame *f, struct Node *node);
+// Returns the depth still in use while node's value hasn't been consumed
+size_t frame_alloc_expr(struct Frame *f, struct Node *node, size_t depth);
+void frame_alloc_args(struct Frame *f, struct Node *call, size_t depth);
+void frame_alloc_init_list_values(struct Frame *f, struct Node *list, size_t depth);
+
+// Struct results of calls that initialize a variable or are returned are
+// written straight into their destination and need no temporary
+bool frame_check_rvo(struct Frame *f, struct Node *node);
+
+int frame_temp(struct Frame *f, size_t depth, size_t size);
+
+#endif
+
@@ -0,0 +1,292 @@
+#include "inline.h"
+#include "scope.h"
+#include "stats.h"
+#include "profile.h"
+
+#include <string.h>
+
+
+struct Node *inline_expand(struct Parser *parser, struct Node *call, struct Node *def)
+{
+    if (!parser->args->optimize || !inline_check_def(def) || !inline_check_args(parser, call, def))
+        return 0;
+
+    struct Node *body = def->function_def_body;
+
+    // Value returning functions are replaced by their return value
+    if (def->function_def_return_type.type != NODE_NOOP)
+        body = body->compound_nodes[0]->return_value;
+
+    size_t limit = parser->args->inline_limit;
+
+    // Growing hot callers pays off more than it costs
+    if (parser->args->profile_use && profile_function_heat(def) == PROFILE_HOT)
+        limit *= PROFILE_INLINE_SCALE;
+
+    if (!def->function_def_is_inline && inline_cost(body) > limit)
+        return 0;
+
+    struct Node *copy = node_copy(body);
+
+    if (!inline_subst(parser, &copy, call, def, false))
+    {
+        node_free(copy);
+        return 0;
+    }
+
+    stats_add_inline(def->function_def_name);
+    return copy;
+}
+
+
+bool inline_check_def(struct Node *def)
+{
+    // The body isn't set yet while it's being parsed, so recursion is never inlined
+    if (def->function_def_is_decl || !def->function_def_body)
+        return false;
+
+    if (def->function_def_return_type.type == NODE_STRUCT)
+        return false;
+
+    for (size_t i = 0; i < def->function_def_params_size; ++i)
+    {
+        if (def->function_def_params[i]->variable_type.type == NODE_STRUCT)
+            return false;
+    }
+
+    struct Node *body = def->function_def_body;
+
+    if (def->function_def_return_type.type == NODE_NOOP)
+        return inline_check_stmt(body);
+
+    return body->compound_size == 1 &&
+           body->compound_nodes[0]->type == NODE_RETURN &&
+           body->compound_nodes[0]->return_value &&
+           inline_check_expr(body->compound_nodes[0]->return_value);
+}
+
+
+bool inline_check_stmt(struct Node *node)
+{
+    switch (node->type)
+    {
+    case NODE_COMPOUND:
+        for (size_t i = 0; i < node->compound_size; ++i)
+        {
+            if (!inline_check_stmt(node->compound_nodes[i]))
+                return false;
+        }
+
+        return true;
+
+    case NODE_INLINE_ASM:
+        for (size_t i = 0; i < node->asm_nargs; ++i)
+        {
+            if (!inline_check_expr(node->asm_args[i]))
+                return false;
+        }
+
+        return true;
+
+    case NODE_FUNCTION_CALL:
+        return inline_check_expr(node);
+
+    case NODE_IF:
+        return inline_check_expr(node->if_cond) && inline_check_stmt(node->if_body);
+
+    default: return false;
+    }
+}
+
+
+bool inline_check_expr(struct Node *node)
+{
+    switch (node->type)
+    {
+    case NODE_INT:
+    case NODE_STRING:
+        return true;
+
+    case NODE_VARIABLE:
+        return !node->variable_struct_member;
+
+    case NODE_BINOP:
+        return inline_check_expr(node->op_l) && inline_check_expr(node->op_r);
+
+    case NODE_FUNCTION_CALL:
+        for (size_t i = 0; i < node->function_call_args_size; ++i)
+        {
+            if (!inline_check_expr(node->function_call_args[i]))
+                return false;
+        }
+
+        return true;
+
+    case NODE_IDOF:
+        return inline_check_expr(node->idof_original_expr);
+
+    default: return false;
+    }
+}
+
+
+bool inline_check_args(struct Parser *parser, struct Node *call, struct Node *def)
+{
+    // Mismatched calls are reported when the call is generated
+    if (call->function_call_args_size != def->function_def_params_size)
+        return false;
+
+    for (size_t i = 0; i < call->function_call_args_size; ++i)
+    {
+        struct Node *arg = call->function_call_args[i];
+
+        // Args are copied to every use of their param, so evaluating
+        // them has to be free and can't have side effects.
+        if (arg->type != NODE_INT && arg->type != NODE_STRING && arg->type != NODE_VARIABLE)
+            return false;
+
+        if (!node_dtype_cmp(node_type_from_node(arg, parser->scope), def->function_def_params[i]->variable_type))
+            return false;
+    }
+
+    return true;
+}
+
+
+size_t inline_cost(struct Node *node)
+{
+    size_t cost = 0;
+
+    switch (node->type)
+    {
+    case NODE_COMPOUND:
+        for (size_t i = 0; i < node->compound_size; ++i)
+            cost += inline_cost(node->compound_nodes[i]);
+
+        return cost;
+
+    case NODE_INLINE_ASM:
+        return 1;
+
+    case NODE_FUNCTION_CALL:
+        if (node->function_call_inlined)
+            return inline_cost(node->function_call_inlined);
+
+        // Pushes, call and result copy
+        cost = node->function_call_args_size + 2;
+
+        for (size_t i = 0; i < node->function_call_args_size; ++i)
+            cost += inline_cost(node->function_call_args[i]);
+
+        return cost;
+
+    case NODE_BINOP:
+        // Both operands go through the stack
+        return 5 + inline_cost(node->op_l) + inline_cost(node->op_r);
+
+    case NODE_IF:
+        return 2 + inline_cost(node->if_cond) + inline_cost(node->if_body);
+
+    default: return 0;
+    }
+}
+
+
+bool inline_subst(struct Parser *parser, struct Node **node, struct Node *call, struct Node *def, bool in_asm)
+{
+    struct Node *n = *node;
+
+    switch (n->type)
+    {
+    case NODE_VARIABLE:
+        for (size_t i = 0; i < def->function_def_params_size; ++i)
+        {
+            if (strcmp(def->function_def_params[i]->variable_name, n->variable_name) != 0)
+                continue;
+
+            struct Node *arg = call->function_call_args[i];
+
+            if (in_asm && arg->type == NODE_STRING)
+            {
+                // asm pastes strings as they are, the param stood for the string's label
+                struct Node *idof = node_alloc(NODE_IDOF);
+                idof->error_line = n->error_line;
+                idof->idof_original_expr = node_copy(arg);
+                idof->idof_new_expr = parser_idof_new_expr(parser, arg, n->error_line);
+
+                node_free(n);
+                *node = idof;
+                return true;
+            }
+
+            // A str variable's label is only known once its assignments are generated
+            if (in_asm && node_type_from_node(arg, parser->scope).type == NODE_STRING)
+                return false;
+
+            // The copy isn't visited again, so args named like params stay as they are
+            node_free(n);
+            *node = node_copy(arg);
+            return true;
+        }
+
+        return true;
+
+    case NODE_COMPOUND:
+        for (size_t i = 0; i < n->compound_size; ++i)
+        {
+            if (!inline_subst(parser, &n->compound_nodes[i], call, def, false))
+                return false;
+        }
+
+        return true;
+
+    case NODE_INLINE_ASM:
+        for (size_t i = 0; i < n->asm_nargs; ++i)
+        {
+            if (!inline_subst(parser, &n->asm_args[i], call, def, true))
+                return false;
+        }
+
+        return true;
+
+    case NODE_FUNCTION_CALL:
+        for (size_t i = 0; i < n->function_call_args_size; ++i)
+        {
+            if (!inline_subst(parser, &n->function_call_args[i], call, def, false))
+                return false;
+        }
+
+        return !n->function_call_inlined ||
+               inline_subst(parser, &n->function_call_inlined, call, def, false);
+
+    case NODE_BINOP:
+        return inline_subst(parser, &n->op_l, call, def, false) &&
+               inline_subst(parser, &n->op_r, call, def, false);
+
+    case NODE_IF:
+        return inline_subst(parser, &n->if_cond, call, def, false) &&
+               inline_subst(parser, &n->if_body, call, def, false);
+
+    case NODE_IDOF:
+    {
+        struct Node *original = n->idof_original_expr;
+
+        if (!inline_subst(parser, &n->idof_original_expr, call, def, false))
+            return false;
+
+        // The new expression was built from the param, build it again from the arg
+        if (n->idof_original_expr != original)
+        {
+            struct Node *literal = node_strip_to_literal(n->idof_original_expr, parser->scope);
+
+            node_free(n->idof_new_expr);
+            n->idof_new_expr = parser_idof_new_expr(parser, literal, n->error_line);
+        }
+
+        return true;
+    }
+
+    default: return true;
+    }
+}
+
@@ -0,0 +1,32 @@
+#ifndef INLINE_H
+#define INLINE_H
+
+#include "node.h"
+#include "parser.h"
+
+#include <stdbool.h>
+
+// Call inlining. Runs in the parser as soon as a call is parsed, so the
+// caller's frame layout already sees the substituted body.
+
+// Returns def's body with call's args substituted for its params, or 0 if
+// the call shouldn't or can't be inlined.
+struct Node *inline_expand(struct Parser *parser, struct Node *call, struct Node *def);
+
+// Only bodies that don't need a frame of their own can be substituted: no
+// locals, no assignments, no struct params or return value, and either a
+// single return or no return at all.
+bool inline_check_def(struct Node *def);
+bool inline_check_stmt(struct Node *node);
+bool inline_check_expr(struct Node *node);
+bool inline_check_args(struct Parser *parser, struct Node *call, struct Node *def);
+
+// Estimated number of instructions generated for node
+size_t inline_cost(struct Node *node);
+
+// Replaces the params in *node with copies of call's args. Returns false if
+// an arg can't stand in for its param.
+bool inline_subst(struct Parser *parser, struct Node **node, struct Node *call, struct Node *def, bool in_asm);
+
+#endif
+
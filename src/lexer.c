@@ -118,11 +118,45 @@ struct Token *lexer_get_next_token(struct Lexer *lexer)
                 return t;
             }
         } break;
+        case '!':
+        case '<':
+        case '>':
+        {
+            char tmp[3] = { lexer->current_c, '\0', '\0' };
+            lexer_advance(lexer);
+
+            if (lexer->current_c == '=')
+            {
+                tmp[1] = '=';
+                lexer_advance(lexer);
+            }
+            else if (tmp[0] == '!')
+                errors_lexer_unrecognized_char('!', lexer->line_num);
+
+            struct Token *t = token_alloc(TOKEN_BINOP, util_strcpy(tmp), lexer->line_num);
+
+            switch (tmp[0])
+            {
+            case '!': t->binop_type = OP_NE; break;
+            case '<': t->binop_type = tmp[1] ? OP_LE : OP_LT; break;
+            case '>': t->binop_type = tmp[1] ? OP_GE : OP_GT; break;
+            }
+
+            return t;
+        } break;
         case ',': lexer_advance(lexer); return token_alloc(TOKEN_COMMA, util_strcpy(","), lexer->line_num);
         case ':': lexer_advance(lexer); return token_alloc(TOKEN_COLON, util_strcpy(":"), lexer->line_num);
-        case '.': lexer_advance(lexer); return token_alloc(TOKEN_PERIOD, util_strcpy("."), lexer->line_num);
+        case '.':
+            lexer_advance(lexer);
+
+            if (lexer->current_c != '.')
+                return token_alloc(TOKEN_PERIOD, util_strcpy("."), lexer->line_num);
+
+            lexer_advance(lexer);
+            return token_alloc(TOKEN_RANGE, util_strcpy(".."), lexer->line_num);
         case '+':
         case '*':
+        case '%':
         {
             char tmp[2] = { lexer->current_c, '\0' };
             struct Token *t = token_alloc(TOKEN_BINOP, util_strcpy(tmp), lexer->line_num);
@@ -131,6 +165,7 @@ struct Token *lexer_get_next_token(struct Lexer *lexer)
             {
             case '+': t->binop_type = OP_PLUS; break;
             case '*': t->binop_type = OP_MUL; break;
+            case '%': t->binop_type = OP_MOD; break;
             }
 
             lexer_advance(lexer);
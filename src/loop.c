@@ -0,0 +1,265 @@
+#include "loop.h"
+#include "asm.h"
+#include "scope.h"
+#include "util.h"
+
+#include <stdio.h>
+#include <string.h>
+
+
+void loop_strength_reduce(struct Parser *parser, struct Node *loop)
+{
+    // Derived variables only stay in step with an induction variable that just counts
+    if (loop_check_writes(loop->for_body, loop->for_var->variable_def_name))
+        return;
+
+    loop_reduce(parser, &loop->for_body, loop);
+}
+
+
+void loop_reduce(struct Parser *parser, struct Node **node, struct Node *loop)
+{
+    struct Node *n = *node;
+
+    switch (n->type)
+    {
+    case NODE_BINOP:
+    {
+        int k;
+
+        if (loop_check_iv_mul(n, loop->for_var->variable_def_name, &k))
+        {
+            struct Node *var = loop_iv(parser, loop, k);
+            var->error_line = n->error_line;
+
+            node_free(n);
+            *node = var;
+            return;
+        }
+
+        loop_reduce(parser, &n->op_l, loop);
+        loop_reduce(parser, &n->op_r, loop);
+    } break;
+
+    case NODE_COMPOUND:
+        for (size_t i = 0; i < n->compound_size; ++i)
+            loop_reduce(parser, &n->compound_nodes[i], loop);
+        break;
+
+    case NODE_ASSIGNMENT:
+        loop_reduce(parser, &n->assignment_src, loop);
+        break;
+
+    case NODE_VARIABLE_DEF:
+        loop_reduce(parser, &n->variable_def_value, loop);
+        break;
+
+    case NODE_RETURN:
+        loop_reduce(parser, &n->return_value, loop);
+        break;
+
+    case NODE_FUNCTION_CALL:
+        for (size_t i = 0; i < n->function_call_args_size; ++i)
+            loop_reduce(parser, &n->function_call_args[i], loop);
+
+        if (n->function_call_inlined)
+            loop_reduce(parser, &n->function_call_inlined, loop);
+        break;
+
+    case NODE_IF:
+        loop_reduce(parser, &n->if_cond, loop);
+        loop_reduce(parser, &n->if_body, loop);
+        break;
+
+    case NODE_WHILE:
+        loop_reduce(parser, &n->while_cond, loop);
+        loop_reduce(parser, &n->while_body, loop);
+        break;
+
+    case NODE_FOR:
+        loop_reduce(parser, &n->for_var->variable_def_value, loop);
+        loop_reduce(parser, &n->for_end, loop);
+        loop_reduce(parser, &n->for_body, loop);
+        break;
+
+    // asm args are pasted as they are
+    default: break;
+    }
+}
+
+
+struct Node *loop_iv(struct Parser *parser, struct Node *loop, int k)
+{
+    struct Node *def = 0;
+
+    for (size_t i = 0; i < loop->for_nivs; ++i)
+    {
+        if (loop->for_ivs[i]->variable_def_value->op_r->int_value == k)
+            def = loop->for_ivs[i];
+    }
+
+    if (!def)
+    {
+        struct Node *var = loop->for_var;
+
+        struct Node *iv = node_alloc(NODE_VARIABLE);
+        iv->error_line = var->error_line;
+        iv->variable_name = util_strcpy(var->variable_def_name);
+        iv->variable_type = (NodeDType){ NODE_INT, 0 };
+        iv->variable_stack_offset = var->variable_def_stack_offset;
+
+        struct Node *step = node_alloc(NODE_INT);
+        step->int_value = k;
+
+        struct Node *mul = node_alloc(NODE_BINOP);
+        mul->error_line = var->error_line;
+        mul->op_type = OP_MUL;
+        mul->op_l = iv;
+        mul->op_r = step;
+
+        def = node_alloc(NODE_VARIABLE_DEF);
+        def->error_line = var->error_line;
+        def->variable_def_type = (NodeDType){ NODE_INT, 0 };
+        def->variable_def_value = mul;
+        def->variable_def_is_assigned = true;
+
+        // Not an identifier, so it can't clash with the program's variables
+        def->variable_def_name = calloc(strlen(var->variable_def_name) + MAX_INT_LEN + 2, sizeof(char));
+        sprintf(def->variable_def_name, "%s*%d", var->variable_def_name, k);
+
+        def->variable_def_stack_offset = -parser->stack_size;
+        parser->stack_size += 4;
+
+        scope_add_variable_def(parser->scope, def);
+
+        loop->for_ivs = realloc(loop->for_ivs, sizeof(struct Node*) * ++loop->for_nivs);
+        loop->for_ivs[loop->for_nivs - 1] = def;
+    }
+
+    struct Node *var = node_alloc(NODE_VARIABLE);
+    var->variable_name = util_strcpy(def->variable_def_name);
+    var->variable_type = (NodeDType){ NODE_INT, 0 };
+    var->variable_stack_offset = def->variable_def_stack_offset;
+
+    return var;
+}
+
+
+bool loop_check_iv_mul(struct Node *node, char *name, int *k)
+{
+    if (node->op_type != OP_MUL)
+        return false;
+
+    struct Node *var = node->op_l, *step = node->op_r;
+
+    if (var->type == NODE_INT)
+    {
+        var = node->op_r;
+        step = node->op_l;
+    }
+
+    if (step->type != NODE_INT || var->type != NODE_VARIABLE || var->variable_struct_member ||
+        strcmp(var->variable_name, name) != 0)
+        return false;
+
+    *k = step->int_value;
+    return true;
+}
+
+
+bool loop_check_writes(struct Node *node, char *name)
+{
+    switch (node->type)
+    {
+    case NODE_COMPOUND:
+        for (size_t i = 0; i < node->compound_size; ++i)
+        {
+            if (loop_check_writes(node->compound_nodes[i], name))
+                return true;
+        }
+
+        return false;
+
+    case NODE_ASSIGNMENT:
+        return node->assignment_dst->type == NODE_VARIABLE &&
+               strcmp(node->assignment_dst->variable_name, name) == 0;
+
+    case NODE_VARIABLE_DEF:
+        return strcmp(node->variable_def_name, name) == 0;
+
+    case NODE_INLINE_ASM:
+        // The variable's slot can be pasted as a destination
+        for (size_t i = 0; i < node->asm_nargs; ++i)
+        {
+            struct Node *arg = node->asm_args[i];
+
+            if (arg->type == NODE_VARIABLE && strcmp(arg->variable_name, name) == 0)
+                return true;
+        }
+
+        return false;
+
+    case NODE_FUNCTION_CALL:
+        return node->function_call_inlined && loop_check_writes(node->function_call_inlined, name);
+
+    case NODE_IF:
+        return loop_check_writes(node->if_body, name);
+
+    case NODE_WHILE:
+        return loop_check_writes(node->while_body, name);
+
+    case NODE_FOR:
+        return loop_check_writes(node->for_var, name) || loop_check_writes(node->for_body, name);
+
+    default: return false;
+    }
+}
+
+
+bool loop_check_defs(struct Node *node)
+{
+    switch (node->type)
+    {
+    case NODE_COMPOUND:
+        for (size_t i = 0; i < node->compound_size; ++i)
+        {
+            if (loop_check_defs(node->compound_nodes[i]))
+                return true;
+        }
+
+        return false;
+
+    case NODE_VARIABLE_DEF:
+    case NODE_FOR:
+        return true;
+
+    case NODE_FUNCTION_CALL:
+        return node->function_call_inlined && loop_check_defs(node->function_call_inlined);
+
+    case NODE_IF:
+        return loop_check_defs(node->if_body);
+
+    case NODE_WHILE:
+        return loop_check_defs(node->while_body);
+
+    default: return false;
+    }
+}
+
+
+bool loop_check_unroll(struct Node *loop, struct Args *args)
+{
+    if (!args->optimize || !args->unroll_loops)
+        return false;
+
+    struct Node *start = loop->for_var->variable_def_value;
+
+    if (start->type != NODE_INT || loop->for_end->type != NODE_INT)
+        return false;
+
+    int trips = loop->for_end->int_value - start->int_value;
+
+    // Every copy of the body is generated again, defining its variables again
+    return trips > 0 && trips <= LOOP_UNROLL_MAX && !loop_check_defs(loop->for_body);
+}
+
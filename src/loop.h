@@ -0,0 +1,30 @@
+#ifndef LOOP_H
+#define LOOP_H
+
+#include "node.h"
+#include "parser.h"
+
+#include <stdbool.h>
+
+// Fully unrolled for loops run at most this many iterations
+#define LOOP_UNROLL_MAX 8
+
+// Replaces i * k in the body of for loop with a variable that starts at
+// start * k and is stepped by k with i. Runs in the parser right after the
+// loop is parsed, while the loop's block scope is still open.
+void loop_strength_reduce(struct Parser *parser, struct Node *loop);
+void loop_reduce(struct Parser *parser, struct Node **node, struct Node *loop);
+// Returns the variable standing for loop's induction variable times k
+struct Node *loop_iv(struct Parser *parser, struct Node *loop, int k);
+// Sets *k if node is name * k or k * name
+bool loop_check_iv_mul(struct Node *node, char *name, int *k);
+
+// Check if node can change name's value other than by stepping it
+bool loop_check_writes(struct Node *node, char *name);
+// Variable defs can only be generated once in a scope
+bool loop_check_defs(struct Node *node);
+// Constant trip count loops small enough to be unrolled with -funroll-loops
+bool loop_check_unroll(struct Node *loop, struct Args *args);
+
+#endif
+
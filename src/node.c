@@ -1,6 +1,7 @@
 #include "node.h"
 #include "scope.h"
 #include "util.h"
+#include "args.h"
 
 #include <string.h>
 
@@ -15,10 +16,19 @@ struct Node *node_alloc(int type)
 
     node->function_def_body = 0;
     node->function_def_name = 0;
+    node->function_def_file = 0;
     node->function_def_params = 0;
     node->function_def_params_size = 0;
     node->function_def_return_type = (NodeDType){ 0, 0 };
     node->function_def_is_decl = false;
+    node->function_def_stack_size = 0;
+    node->function_def_return_ptr_stack_offset = 0;
+    node->function_def_is_inline = false;
+    node->function_def_is_static = false;
+    node->function_def_is_cold = false;
+    node->function_def_conv = CONV_FASTCALL;
+    node->function_def_is_dead = false;
+    node->function_def_is_stdlib = false;
 
     node->int_value = 0;
 
@@ -31,6 +41,8 @@ struct Node *node_alloc(int type)
     node->variable_def_name = 0;
     node->variable_def_type = (NodeDType){ 0, 0 };
     node->variable_def_stack_offset = 0;
+    node->variable_def_is_assigned = false;
+    node->variable_def_is_dead = false;
 
     node->variable_name = 0;
     node->variable_struct_member = 0;
@@ -42,6 +54,8 @@ struct Node *node_alloc(int type)
     node->function_call_args = 0;
     node->function_call_args_size = 0;
     node->function_call_return_stack_offset = 0;
+    node->function_call_return_ptr_stack_offset = 0;
+    node->function_call_inlined = 0;
 
     node->assignment_dst = 0;
     node->assignment_src = 0;
@@ -75,6 +89,19 @@ struct Node *node_alloc(int type)
 
     node->if_cond = 0;
     node->if_body = 0;
+    node->if_hint = HINT_NONE;
+
+    node->while_cond = 0;
+    node->while_body = 0;
+
+    node->for_var = 0;
+    node->for_end = 0;
+    node->for_end_stack_offset = 0;
+    node->for_body = 0;
+    node->for_ivs = 0;
+    node->for_nivs = 0;
+
+    node->profile_key = 0;
 
     node->error_line = 0;
 
@@ -102,6 +129,12 @@ void node_free(struct Node *node)
     if (node->idof_new_expr) node_free(node->idof_new_expr);
     if (node->if_cond) node_free(node->if_cond);
     if (node->if_body) node_free(node->if_body);
+    if (node->while_cond) node_free(node->while_cond);
+    if (node->while_body) node_free(node->while_body);
+    if (node->for_var) node_free(node->for_var);
+    if (node->for_end) node_free(node->for_end);
+    if (node->for_body) node_free(node->for_body);
+    if (node->function_call_inlined) node_free(node->function_call_inlined);
 
     free(node);
 }
@@ -156,6 +189,14 @@ void node_free_lists(struct Node *node)
 
         free(node->asm_args);
     }
+
+    if (node->for_ivs)
+    {
+        for (size_t i = 0; i < node->for_nivs; ++i)
+            node_free(node->for_ivs[i]);
+
+        free(node->for_ivs);
+    }
 }
 
 
@@ -164,12 +205,14 @@ void node_free_strings(struct Node *node)
     if (node->string_value) free(node->string_value);
     if (node->string_asm_id) free(node->string_asm_id);
     if (node->function_def_name) free(node->function_def_name);
+    if (node->function_def_file) free(node->function_def_file);
     if (node->variable_def_name) free(node->variable_def_name);
     if (node->variable_name) free(node->variable_name);
     if (node->function_call_name) free(node->function_call_name);
     if (node->struct_name) free(node->struct_name);
     if (node->member_name) free(node->member_name);
     if (node->include_path) free(node->include_path);
+    if (node->profile_key) free(node->profile_key);
 }
 
 
@@ -193,14 +236,28 @@ struct Node *node_strip_to_literal(struct Node *node, struct Scope *scope)
     case NODE_VARIABLE:
     {
         if (node->variable_struct_member)
-            return node;
+            return node_strip_member_to_literal(node, scope);
 
         struct Node *var = scope_find_variable(scope, node, node->error_line);
 
         if (var->type == NODE_VARIABLE)
             return var;
-        else
-            return node_strip_to_literal(var, scope);
+
+        // Struct copies have storage of their own
+        if (var->variable_def_type.type == NODE_STRUCT && var->variable_def_value->type != NODE_INIT_LIST)
+            return node;
+
+        struct Node *literal = node_strip_to_literal(var, scope);
+
+        // Computed values are only evaluated once, into the variable's slot
+        if (literal->type == NODE_FUNCTION_CALL || literal->type == NODE_BINOP)
+            return node;
+
+        // Variables assigned to later only have their initial value until then
+        if (var->type == NODE_VARIABLE_DEF && var->variable_def_is_assigned)
+            return node;
+
+        return literal;
     } break;
     case NODE_VARIABLE_DEF:
         return node_strip_to_literal(node->variable_def_value, scope);
@@ -211,6 +268,49 @@ struct Node *node_strip_to_literal(struct Node *node, struct Scope *scope)
 }
 
 
+struct Node *node_strip_member_to_literal(struct Node *node, struct Scope *scope)
+{
+    struct Node *def = scope_find_variable_def(scope, node);
+
+    // Members of lists that are never changed keep their initial value
+    if (!def || def->variable_def_is_assigned || def->variable_def_value->type != NODE_INIT_LIST)
+        return node;
+
+    struct Node *member = scope_find_variable_struct_member(scope, node, -1);
+    struct Node *value = node_init_list_word(def->variable_def_value,
+                                             (def->variable_def_stack_offset - member->variable_stack_offset) / 4);
+
+    if (!value)
+        return node;
+
+    struct Node *literal = node_strip_to_literal(value, scope);
+    return literal->type == NODE_INT ? literal : node;
+}
+
+
+struct Node *node_init_list_word(struct Node *list, size_t word)
+{
+    struct Node *value = 0;
+
+    for (size_t i = 0; i < list->init_list_len && i <= word; ++i)
+    {
+        struct Node *v = list->init_list_values[i];
+
+        if (v->type == NODE_INIT_LIST)
+        {
+            struct Node *nested = node_init_list_word(v, word - i);
+
+            if (nested)
+                value = nested;
+        }
+        else if (i == word)
+            value = v;
+    }
+
+    return value;
+}
+
+
 char *node_str_from_type(NodeDType type)
 {
     switch (type.type)
@@ -306,6 +406,8 @@ char *node_str_from_node_type(int type)
     case NODE_IDOF: return "idof";
     case NODE_INLINE_ASM: return "asm";
     case NODE_IF: return "if statement";
+    case NODE_WHILE: return "while loop";
+    case NODE_FOR: return "for loop";
     }
 
     return 0;
@@ -413,6 +515,23 @@ bool node_find_node(struct Node *node, struct Node *target)
         if (node_find_node(node->if_cond, target) || node_find_node(node->if_body, target))
             return true;
 
+        break;
+    case NODE_WHILE:
+        if (node_find_node(node->while_cond, target) || node_find_node(node->while_body, target))
+            return true;
+
+        break;
+    case NODE_FOR:
+        if (node_find_node(node->for_var, target) || node_find_node(node->for_end, target) ||
+            node_find_node(node->for_body, target))
+            return true;
+
+        for (size_t i = 0; i < node->for_nivs; ++i)
+        {
+            if (node_find_node(node->for_ivs[i], target))
+                return true;
+        }
+
         break;
     default: return false;
     }
@@ -432,17 +551,54 @@ size_t node_sizeof_dtype(struct Node *node)
     case NODE_STRUCT:
         return node->struct_members_size * 4;
     case NODE_INIT_LIST:
-        return node->init_list_len * 4;
-    default: return 0;
+    {
+        // Members are 4 bytes apart, nested lists extend past their slot
+        size_t size = 0;
+
+        for (size_t i = 0; i < node->init_list_len; ++i)
+        {
+            size_t end = i * 4 + node_sizeof_dtype(node->init_list_values[i]);
+
+            if (end > size)
+                size = end;
+        }
+
+        return size;
+    }
+    // Anything else (binops, calls, ...) yields a single 4 byte value
+    default: return 4;
     }
 }
 
 
+size_t node_sizeof_struct(struct Node *def, struct Scope *scope)
+{
+    // Same layout as init lists: members 4 bytes apart, nested structs extend past their slot
+    size_t size = 0;
+
+    for (size_t i = 0; i < def->struct_members_size; ++i)
+    {
+        NodeDType type = def->struct_members[i]->member_type;
+        size_t member = 4;
+
+        if (type.type == NODE_STRUCT)
+            member = node_sizeof_struct(scope_find_struct(scope, type.struct_type, -1), scope);
+
+        if (i * 4 + member > size)
+            size = i * 4 + member;
+    }
+
+    return size;
+}
+
 struct Node *node_copy(struct Node *src)
 {
     struct Node *ret = node_alloc(src->type);
     ret->error_line = src->error_line;
 
+    if (src->profile_key)
+        ret->profile_key = util_strcpy(src->profile_key);
+
     switch (src->type)
     {
     case NODE_ASSIGNMENT:
@@ -462,18 +618,33 @@ struct Node *node_copy(struct Node *src)
     case NODE_FUNCTION_CALL:
         ret->function_call_name = util_strcpy(src->function_call_name);
         ret->function_call_return_stack_offset = src->function_call_return_stack_offset;
+        ret->function_call_return_ptr_stack_offset = src->function_call_return_ptr_stack_offset;
         ret->function_call_args = malloc(sizeof(struct Node*) * src->function_call_args_size);
         ret->function_call_args_size = src->function_call_args_size;
 
         for (size_t i = 0; i < src->function_call_args_size; ++i)
             ret->function_call_args[i] = node_copy(src->function_call_args[i]);
 
+        if (src->function_call_inlined)
+            ret->function_call_inlined = node_copy(src->function_call_inlined);
+
         return ret;
 
     case NODE_FUNCTION_DEF:
         ret->function_def_is_decl = src->function_def_is_decl;
+        ret->function_def_is_inline = src->function_def_is_inline;
+        ret->function_def_is_static = src->function_def_is_static;
+        ret->function_def_is_cold = src->function_def_is_cold;
+        ret->function_def_conv = src->function_def_conv;
+        ret->function_def_stack_size = src->function_def_stack_size;
+        ret->function_def_return_ptr_stack_offset = src->function_def_return_ptr_stack_offset;
+        ret->function_def_is_dead = src->function_def_is_dead;
+        ret->function_def_is_stdlib = src->function_def_is_stdlib;
         ret->function_def_name = util_strcpy(src->function_def_name);
 
+        if (src->function_def_file)
+            ret->function_def_file = util_strcpy(src->function_def_file);
+
         if (!src->function_def_is_decl)
             ret->function_def_body = node_copy(src->function_def_body);
 
@@ -549,6 +720,8 @@ struct Node *node_copy(struct Node *src)
     case NODE_VARIABLE_DEF:
         ret->variable_def_name = util_strcpy(src->variable_def_name);
         ret->variable_def_stack_offset = src->variable_def_stack_offset;
+        ret->variable_def_is_assigned = src->variable_def_is_assigned;
+        ret->variable_def_is_dead = src->variable_def_is_dead;
         ret->variable_def_type = node_dtype_copy(src->variable_def_type);
         ret->variable_def_value = node_copy(src->variable_def_value);
 
@@ -557,6 +730,8 @@ struct Node *node_copy(struct Node *src)
     case NODE_BINOP:
         ret->op_l = node_copy(src->op_l);
         ret->op_r = node_copy(src->op_r);
+        ret->op_type = src->op_type;
+        ret->op_stack_offset = src->op_stack_offset;
 
         return ret;
 
@@ -571,13 +746,34 @@ struct Node *node_copy(struct Node *src)
         ret->asm_nargs = src->asm_nargs;
 
         for (size_t i = 0; i < src->asm_nargs; ++i)
-            ret->asm_args[i] = src->asm_args[i];
+            ret->asm_args[i] = node_copy(src->asm_args[i]);
 
         return ret;
 
     case NODE_IF:
         ret->if_cond = node_copy(src->if_cond);
         ret->if_body = node_copy(src->if_body);
+        ret->if_hint = src->if_hint;
+
+        return ret;
+
+    case NODE_WHILE:
+        ret->while_cond = node_copy(src->while_cond);
+        ret->while_body = node_copy(src->while_body);
+
+        return ret;
+
+    case NODE_FOR:
+        ret->for_var = node_copy(src->for_var);
+        ret->for_end = node_copy(src->for_end);
+        ret->for_end_stack_offset = src->for_end_stack_offset;
+        ret->for_body = node_copy(src->for_body);
+
+        ret->for_ivs = malloc(sizeof(struct Node*) * src->for_nivs);
+        ret->for_nivs = src->for_nivs;
+
+        for (size_t i = 0; i < src->for_nivs; ++i)
+            ret->for_ivs[i] = node_copy(src->for_ivs[i]);
 
         return ret;
     }
@@ -605,3 +801,13 @@ int node_stack_offset(struct Node *var)
     return 0;
 }
 
+
+size_t node_conv_nregs(int conv, int target)
+{
+    // The x86-64 C convention already passes the first six in registers
+    if (target == TARGET_X86_64)
+        return 6;
+
+    return conv == CONV_FASTCALL ? 2 : 0;
+}
+
@@ -6,6 +6,23 @@
 
 struct Scope;
 
+// Calling conventions
+enum
+{
+    // Crust to Crust calls: the first args in registers
+    CONV_FASTCALL,
+    // C compatible, used by extern functions
+    CONV_CDECL
+};
+
+// Branch hints of if conditions wrapped in likely(...) or unlikely(...)
+enum
+{
+    HINT_NONE,
+    HINT_LIKELY,
+    HINT_UNLIKELY
+};
+
 typedef struct
 {
     int type;
@@ -33,7 +50,9 @@ struct Node
         NODE_BINOP,
         NODE_IDOF,
         NODE_INLINE_ASM,
-        NODE_IF
+        NODE_IF,
+        NODE_WHILE,
+        NODE_FOR
     } type;
 
     // Compound
@@ -49,6 +68,8 @@ struct Node
 
     // Function def
     char *function_def_name;
+    // Source the function is defined in, for the line tables of -g
+    char *function_def_file;
     struct Node *function_def_body;
     NodeDType function_def_return_type;
 
@@ -56,6 +77,24 @@ struct Node
     size_t function_def_params_size;
 
     bool function_def_is_decl;
+    // Declared with the inline keyword: inlined regardless of size
+    bool function_def_is_inline;
+    // Declared with the static keyword: not exported from its unit
+    bool function_def_is_static;
+    // Declared with the cold keyword: rarely called, so kept away from hot
+    // code and paths calling it are unlikely
+    bool function_def_is_cold;
+    int function_def_conv;
+    // Bytes of locals below %ebp, reserved once in the prologue
+    size_t function_def_stack_size;
+    // Struct returning functions get a pointer to the caller's result in
+    // %eax and spill it here
+    int function_def_return_ptr_stack_offset;
+    // Not reachable from the unit's exported functions. Still checked, but not emitted.
+    bool function_def_is_dead;
+    // Built from the stdlib into an -flto unit: the user doesn't own it, so
+    // isn't warned about it
+    bool function_def_is_stdlib;
 
     // Return
     struct Node *return_value;
@@ -65,6 +104,11 @@ struct Node
     char *variable_def_name;
     NodeDType variable_def_type;
     int variable_def_stack_offset;
+    // Assigned to after its definition, or a member of it or passed by
+    // reference if it's a struct, so its value can't be propagated
+    bool variable_def_is_assigned;
+    // Never read and its value has no side effects, so it isn't stored
+    bool variable_def_is_dead;
 
     // Variable
     char *variable_name;
@@ -78,6 +122,11 @@ struct Node
     struct Node **function_call_args;
     size_t function_call_args_size;
     int function_call_return_stack_offset;
+    // Nonzero if the struct result goes through the pointer spilled here
+    // instead, so a returned call writes straight into our own caller's result
+    int function_call_return_ptr_stack_offset;
+    // Callee body with the args substituted in, generated instead of the call
+    struct Node *function_call_inlined;
 
     // Assignment
     struct Node *assignment_dst, *assignment_src;
@@ -117,6 +166,24 @@ struct Node
     // If
     struct Node *if_cond;
     struct Node *if_body;
+    int if_hint;
+
+    // While
+    struct Node *while_cond;
+    struct Node *while_body;
+
+    // For, over for_var's start up to but not including for_end
+    struct Node *for_var;
+    struct Node *for_end;
+    // Slot for_end is kept in while the loop runs, unless it's an int
+    int for_end_stack_offset;
+    struct Node *for_body;
+    // Variable defs of for_var * k, strength reduced to adding k every iteration
+    struct Node **for_ivs;
+    size_t for_nivs;
+
+    // Counter of function defs and ifs with -fprofile-generate/-use, see profile.h
+    char *profile_key;
 
     // Error values
     size_t error_line;
@@ -129,6 +196,9 @@ void node_free_strings(struct Node *node);
 void node_free_dtypes(struct Node *node);
 
 struct Node *node_strip_to_literal(struct Node *node, struct Scope *scope);
+struct Node *node_strip_member_to_literal(struct Node *node, struct Scope *scope);
+// Value last stored into the word of an init list, like asm_gen_add_to_stack stores them
+struct Node *node_init_list_word(struct Node *list, size_t word);
 
 char *node_str_from_type(NodeDType type);
 NodeDType node_type_from_str(char *str);
@@ -148,11 +218,16 @@ bool node_cmp(struct Node *n1, struct Node *n2);
 bool node_find_node(struct Node *node, struct Node *target);
 
 size_t node_sizeof_dtype(struct Node *node);
+// Bytes a value of struct def takes, nested structs included
+size_t node_sizeof_struct(struct Node *def, struct Scope *scope);
 
 struct Node *node_copy(struct Node *src);
 NodeDType node_dtype_copy(NodeDType src);
 
 int node_stack_offset(struct Node *var);
 
+// Number of args a function with convention conv takes in registers on target
+size_t node_conv_nregs(int conv, int target);
+
 #endif
 
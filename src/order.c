@@ -0,0 +1,416 @@
+#include "order.h"
+#include "profile.h"
+#include "util.h"
+
+#include <stdio.h>
+#include <string.h>
+
+struct Order g_order = { 0 };
+
+
+size_t order_find(char *name)
+{
+    for (size_t i = 0; i < g_order.nfuncs; ++i)
+    {
+        if (strcmp(g_order.funcs[i].name, name) == 0)
+            return i;
+    }
+
+    g_order.funcs = realloc(g_order.funcs, sizeof(struct OrderFunc) * ++g_order.nfuncs);
+    g_order.funcs[g_order.nfuncs - 1] = (struct OrderFunc){ util_strcpy(name), 0, 0 };
+
+    return g_order.nfuncs - 1;
+}
+
+
+void order_add_edge(size_t caller, size_t callee, size_t weight)
+{
+    for (size_t i = 0; i < g_order.nedges; ++i)
+    {
+        if (g_order.edges[i].caller == caller && g_order.edges[i].callee == callee)
+        {
+            g_order.edges[i].weight += weight;
+            return;
+        }
+    }
+
+    g_order.edges = realloc(g_order.edges, sizeof(struct OrderEdge) * ++g_order.nedges);
+    g_order.edges[g_order.nedges - 1] = (struct OrderEdge){ caller, callee, weight };
+}
+
+
+void order_add_unit(struct Node *root)
+{
+    for (size_t i = 0; i < root->compound_size; ++i)
+    {
+        struct Node *def = root->compound_nodes[i];
+
+        if (def->type != NODE_FUNCTION_DEF || def->function_def_is_decl || def->function_def_is_dead)
+            continue;
+
+        size_t func = order_find(def->function_def_name);
+        g_order.funcs[func].size = order_estimate_size(def->function_def_body) * ORDER_NODE_BYTES + 1;
+
+        size_t count;
+
+        if (!g_order.perf && def->profile_key && profile_find(def->profile_key, &count))
+        {
+            g_order.funcs[func].samples += count;
+            order_add_calls(func, def->function_def_body, count);
+        }
+    }
+}
+
+
+void order_add_calls(size_t caller, struct Node *node, size_t count)
+{
+    switch (node->type)
+    {
+    case NODE_COMPOUND:
+        for (size_t i = 0; i < node->compound_size; ++i)
+            order_add_calls(caller, node->compound_nodes[i], count);
+        break;
+
+    case NODE_FUNCTION_CALL:
+        // Calls in inlined bodies are made from here
+        if (node->function_call_inlined)
+        {
+            order_add_calls(caller, node->function_call_inlined, count);
+            break;
+        }
+
+        if (count)
+            order_add_edge(caller, order_find(node->function_call_name), count);
+
+        for (size_t i = 0; i < node->function_call_args_size; ++i)
+            order_add_calls(caller, node->function_call_args[i], count);
+        break;
+
+    case NODE_IF:
+    {
+        order_add_calls(caller, node->if_cond, count);
+
+        char *key = 0;
+        size_t taken = count;
+
+        if (node->profile_key)
+        {
+            key = calloc(strlen(node->profile_key) + 3, sizeof(char));
+            sprintf(key, "%s:t", node->profile_key);
+        }
+
+        if (key && !profile_find(key, &taken))
+            taken = count;
+
+        free(key);
+        order_add_calls(caller, node->if_body, taken);
+    } break;
+
+    case NODE_WHILE:
+        order_add_calls(caller, node->while_cond, count);
+        order_add_calls(caller, node->while_body, count);
+        break;
+
+    case NODE_FOR:
+        order_add_calls(caller, node->for_body, count);
+        break;
+
+    case NODE_VARIABLE_DEF:
+        order_add_calls(caller, node->variable_def_value, count);
+        break;
+
+    case NODE_ASSIGNMENT:
+        order_add_calls(caller, node->assignment_src, count);
+        break;
+
+    case NODE_RETURN:
+        order_add_calls(caller, node->return_value, count);
+        break;
+
+    case NODE_BINOP:
+        order_add_calls(caller, node->op_l, count);
+        order_add_calls(caller, node->op_r, count);
+        break;
+
+    default: break;
+    }
+}
+
+
+size_t order_estimate_size(struct Node *node)
+{
+    size_t size = 1;
+
+    switch (node->type)
+    {
+    case NODE_COMPOUND:
+        for (size_t i = 0; i < node->compound_size; ++i)
+            size += order_estimate_size(node->compound_nodes[i]);
+        break;
+
+    case NODE_FUNCTION_CALL:
+        if (node->function_call_inlined)
+            return order_estimate_size(node->function_call_inlined);
+
+        for (size_t i = 0; i < node->function_call_args_size; ++i)
+            size += order_estimate_size(node->function_call_args[i]) + 1;
+        break;
+
+    case NODE_IF:
+        size += order_estimate_size(node->if_cond) + order_estimate_size(node->if_body);
+        break;
+
+    case NODE_WHILE:
+        size += order_estimate_size(node->while_cond) + order_estimate_size(node->while_body);
+        break;
+
+    case NODE_FOR:
+        size += order_estimate_size(node->for_var) + order_estimate_size(node->for_body);
+        break;
+
+    case NODE_VARIABLE_DEF:
+        size += order_estimate_size(node->variable_def_value);
+        break;
+
+    case NODE_ASSIGNMENT:
+        size += order_estimate_size(node->assignment_src);
+        break;
+
+    case NODE_RETURN:
+        size += order_estimate_size(node->return_value);
+        break;
+
+    case NODE_BINOP:
+        size += order_estimate_size(node->op_l) + order_estimate_size(node->op_r);
+        break;
+
+    case NODE_INLINE_ASM:
+        size += node->asm_nargs;
+        break;
+
+    default: break;
+    }
+
+    return size;
+}
+
+
+void order_load_perf(char *path)
+{
+    size_t nlines;
+    char **lines = util_read_file_lines(path, &nlines);
+
+    if (!lines)
+        return;
+
+    g_order.perf = true;
+
+    // Frames of a sample are indented under its header, leaf first
+    size_t prev = 0;
+    bool leaf = false;
+
+    for (size_t i = 0; i < nlines; ++i)
+    {
+        char *line = lines[i];
+
+        if (line[0] != ' ' && line[0] != '\t')
+        {
+            leaf = line[0] != '\n';
+            prev = (size_t)-1;
+        }
+        else
+        {
+            char *name = order_perf_symbol(line);
+
+            if (!name)
+                prev = (size_t)-1;
+            else
+            {
+                size_t func = order_find(name);
+
+                if (leaf)
+                    ++g_order.funcs[func].samples;
+                else if (prev != (size_t)-1 && prev != func)
+                    order_add_edge(func, prev, 1);
+
+                prev = func;
+                free(name);
+            }
+
+            leaf = false;
+        }
+
+        free(line);
+    }
+
+    free(lines);
+}
+
+
+char *order_perf_symbol(char *frame)
+{
+    char sym[256];
+
+    // "    401000 main+0x10 (/path/a.out)"
+    if (sscanf(frame, "%*s %255s", sym) != 1 || sym[0] == '[' || sym[0] == '(')
+        return 0;
+
+    char *offset = strstr(sym, "+0x");
+
+    if (offset)
+        *offset = '\0';
+
+    return util_strcpy(sym);
+}
+
+
+void order_write(char *path)
+{
+    if (!g_order.perf)
+        order_split_weights();
+
+    struct OrderCluster *clusters = calloc(g_order.nfuncs, sizeof(struct OrderCluster));
+    size_t *owner = malloc(sizeof(size_t) * g_order.nfuncs);
+    size_t *sorted = malloc(sizeof(size_t) * g_order.nfuncs);
+
+    for (size_t i = 0; i < g_order.nfuncs; ++i)
+    {
+        clusters[i].funcs = malloc(sizeof(size_t));
+        clusters[i].funcs[0] = i;
+        clusters[i].nfuncs = 1;
+        clusters[i].size = g_order.funcs[i].size;
+        clusters[i].samples = g_order.funcs[i].samples;
+
+        owner[i] = i;
+        sorted[i] = i;
+    }
+
+    qsort(sorted, g_order.nfuncs, sizeof(size_t), order_cmp_samples);
+
+    for (size_t i = 0; i < g_order.nfuncs; ++i)
+    {
+        size_t func = sorted[i];
+
+        if (!g_order.funcs[func].samples || !g_order.funcs[func].size)
+            continue;
+
+        struct OrderEdge *best = 0;
+
+        for (size_t j = 0; j < g_order.nedges; ++j)
+        {
+            struct OrderEdge *e = &g_order.edges[j];
+
+            if (e->callee == func && e->caller != func && g_order.funcs[e->caller].size &&
+                e->weight && (!best || e->weight > best->weight))
+                best = e;
+        }
+
+        if (!best)
+            continue;
+
+        struct OrderCluster *into = &clusters[owner[best->caller]];
+        struct OrderCluster *from = &clusters[owner[func]];
+
+        if (into == from || into->size + from->size > ORDER_CLUSTER_MAX)
+            continue;
+
+        // The callee's cluster goes right after its caller's
+        into->funcs = realloc(into->funcs, sizeof(size_t) * (into->nfuncs + from->nfuncs));
+
+        for (size_t j = 0; j < from->nfuncs; ++j)
+        {
+            into->funcs[into->nfuncs++] = from->funcs[j];
+            owner[from->funcs[j]] = owner[best->caller];
+        }
+
+        into->size += from->size;
+        into->samples += from->samples;
+
+        from->nfuncs = 0;
+        from->size = 0;
+        from->samples = 0;
+    }
+
+    qsort(clusters, g_order.nfuncs, sizeof(struct OrderCluster), order_cmp_density);
+
+    FILE *out = fopen(path, "w");
+
+    for (size_t i = 0; i < g_order.nfuncs; ++i)
+    {
+        for (size_t j = 0; j < clusters[i].nfuncs && out; ++j)
+        {
+            struct OrderFunc *f = &g_order.funcs[clusters[i].funcs[j]];
+
+            // Callers without samples of their own still lead their callees
+            if (clusters[i].samples && f->size)
+                fprintf(out, "%s\n", f->name);
+        }
+
+        free(clusters[i].funcs);
+    }
+
+    if (out)
+        fclose(out);
+
+    free(clusters);
+    free(owner);
+    free(sorted);
+}
+
+
+void order_split_weights()
+{
+    for (size_t callee = 0; callee < g_order.nfuncs; ++callee)
+    {
+        size_t total = 0;
+
+        for (size_t i = 0; i < g_order.nedges; ++i)
+        {
+            if (g_order.edges[i].callee == callee)
+                total += g_order.edges[i].weight;
+        }
+
+        for (size_t i = 0; i < g_order.nedges && total; ++i)
+        {
+            if (g_order.edges[i].callee == callee)
+                g_order.edges[i].weight = g_order.funcs[callee].samples * g_order.edges[i].weight / total;
+        }
+    }
+}
+
+
+int order_cmp_samples(const void *a, const void *b)
+{
+    size_t sa = g_order.funcs[*(const size_t*)a].samples;
+    size_t sb = g_order.funcs[*(const size_t*)b].samples;
+
+    return (sa < sb) - (sa > sb);
+}
+
+
+int order_cmp_density(const void *a, const void *b)
+{
+    const struct OrderCluster *ca = a, *cb = b;
+
+    // Empty clusters were merged into others
+    if (!ca->size || !cb->size)
+        return (ca->size == 0) - (cb->size == 0);
+
+    size_t da = ca->samples * cb->size;
+    size_t db = cb->samples * ca->size;
+
+    return (da < db) - (da > db);
+}
+
+
+void order_free()
+{
+    for (size_t i = 0; i < g_order.nfuncs; ++i)
+        free(g_order.funcs[i].name);
+
+    free(g_order.funcs);
+    free(g_order.edges);
+
+    g_order = (struct Order){ 0 };
+}
+
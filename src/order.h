@@ -0,0 +1,80 @@
+#ifndef ORDER_H
+#define ORDER_H
+
+#include "node.h"
+
+#include <stdlib.h>
+#include <stdbool.h>
+
+#define ORDER_FILE "crust.order"
+
+// Clusters are kept within a page so callers and callees share it
+#define ORDER_CLUSTER_MAX 4096
+// Rough average of the bytes generated for a node
+#define ORDER_NODE_BYTES 4
+
+// Function ordering by call-chain clustering. Functions are taken from
+// the most to the least sampled, and each is appended to the cluster of
+// its heaviest caller unless that would outgrow a page. Clusters are then
+// laid out densest first: samples per estimated byte.
+//
+// Samples and call weights come from `perf script` output of a program
+// recorded with call graphs, or else from the counter profile: entry
+// counts, with each callee's entries split over its call sites by how
+// often the block holding the call ran.
+struct OrderFunc
+{
+    char *name;
+    // Estimated from its nodes, 0 if it isn't compiled in this run
+    size_t size;
+    size_t samples;
+};
+
+struct OrderEdge
+{
+    size_t caller, callee;
+    size_t weight;
+};
+
+struct OrderCluster
+{
+    size_t *funcs;
+    size_t nfuncs;
+    size_t size, samples;
+};
+
+struct Order
+{
+    struct OrderFunc *funcs;
+    size_t nfuncs;
+
+    struct OrderEdge *edges;
+    size_t nedges;
+
+    // Weights are sample counts instead of block counts to be split
+    bool perf;
+};
+
+extern struct Order g_order;
+
+size_t order_find(char *name);
+void order_add_edge(size_t caller, size_t callee, size_t weight);
+
+// Sizes, and without perf data samples and calls, of root's functions
+void order_add_unit(struct Node *root);
+void order_add_calls(size_t caller, struct Node *node, size_t count);
+size_t order_estimate_size(struct Node *node);
+
+void order_load_perf(char *path);
+char *order_perf_symbol(char *frame);
+
+// Clusters the functions and writes those of sampled clusters, one per line
+void order_write(char *path);
+void order_split_weights();
+int order_cmp_samples(const void *a, const void *b);
+int order_cmp_density(const void *a, const void *b);
+
+void order_free();
+
+#endif
+
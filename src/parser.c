@@ -2,6 +2,13 @@
 #include "util.h"
 #include "errors.h"
 #include "crust.h"
+#include "frame.h"
+#include "inline.h"
+#include "loop.h"
+#include "sra.h"
+#include "cse.h"
+#include "dce.h"
+#include "profile.h"
 
 #include <stdio.h>
 #include <string.h>
@@ -10,11 +17,7 @@
 struct Parser *parser_alloc(struct Token **tokens, size_t ntokens, struct Args *args)
 {
     struct Parser *parser = malloc(sizeof(struct Parser));
-    parser->tokens = tokens;
-    parser->ntokens = ntokens;
-
-    parser->curr_idx = 0;
-    parser->curr_tok = parser->tokens[parser->curr_idx];
+    parser_set_tokens(parser, tokens, ntokens);
 
     parser->scope = scope_alloc();
     scope_push_layer(parser->scope);
@@ -23,13 +26,24 @@ struct Parser *parser_alloc(struct Token **tokens, size_t ntokens, struct Args *
     parser->lc = 0;
 
     parser->args = args;
-
-    parser->prev_node = 0;
+    parser->file = 0;
 
     return parser;
 }
 
 
+void parser_set_tokens(struct Parser *parser, struct Token **tokens, size_t ntokens)
+{
+    parser->tokens = tokens;
+    parser->ntokens = ntokens;
+
+    parser->curr_idx = 0;
+    parser->curr_tok = parser->tokens[parser->curr_idx];
+
+    parser->prev_node = 0;
+}
+
+
 void parser_free(struct Parser *parser)
 {
     scope_free(parser->scope);
@@ -132,7 +146,11 @@ struct Node *parser_parse_str(struct Parser *parser)
 
 struct Node *parser_parse_id(struct Parser *parser)
 {
-    if (strcmp(parser->curr_tok->value, "fn") == 0)
+    if (strcmp(parser->curr_tok->value, "fn") == 0 ||
+        strcmp(parser->curr_tok->value, "inline") == 0 ||
+        strcmp(parser->curr_tok->value, "static") == 0 ||
+        strcmp(parser->curr_tok->value, "cold") == 0 ||
+        strcmp(parser->curr_tok->value, "extern") == 0)
         return parser_parse_function_def(parser);
     else if (strcmp(parser->curr_tok->value, "return") == 0)
         return parser_parse_return(parser);
@@ -148,6 +166,10 @@ struct Node *parser_parse_id(struct Parser *parser)
         return parser_parse_inline_asm(parser);
     else if (strcmp(parser->curr_tok->value, "if") == 0)
         return parser_parse_if_statement(parser);
+    else if (strcmp(parser->curr_tok->value, "while") == 0)
+        return parser_parse_while(parser);
+    else if (strcmp(parser->curr_tok->value, "for") == 0)
+        return parser_parse_for(parser);
     else
         return parser_parse_variable(parser);
 }
@@ -157,21 +179,54 @@ struct Node *parser_parse_function_def(struct Parser *parser)
 {
     struct Node *node = node_alloc(NODE_FUNCTION_DEF);
     node->error_line = parser->curr_tok->line_num;
+
+    // Modifiers, in any order
+    while (true)
+    {
+        if (strcmp(parser->curr_tok->value, "static") == 0)
+            node->function_def_is_static = true;
+        else if (strcmp(parser->curr_tok->value, "cold") == 0)
+            node->function_def_is_cold = true;
+        else if (strcmp(parser->curr_tok->value, "inline") == 0)
+            node->function_def_is_inline = true;
+        else if (strcmp(parser->curr_tok->value, "extern") == 0)
+            node->function_def_conv = CONV_CDECL;
+        else
+            break;
+
+        parser_eat(parser, TOKEN_ID);
+    }
+
     parser_eat(parser, TOKEN_ID); // fn
 
     node->function_def_name = util_strcpy(parser->curr_tok->value);
     parser_eat(parser, TOKEN_ID); // function name
 
+    if (parser->file)
+        node->function_def_file = util_strcpy(parser->file);
+
     size_t prev_size = parser->stack_size;
     parser->stack_size = 4;
+
+    // The first slot of extern functions keeps %ebx for their C callers
+    if (node->function_def_conv == CONV_CDECL)
+        parser->stack_size += parser_word_size(parser);
+
     scope_push_layer(parser->scope);
 
-    node->function_def_params = parser_parse_function_def_params(parser, &node->function_def_params_size);
+    node->function_def_params = parser_parse_function_def_params(parser, node);
 
     parser_eat(parser, TOKEN_ARROW);
 
     node->function_def_return_type = parser_parse_dtype(parser);
 
+    if (node->function_def_return_type.type == NODE_STRUCT)
+    {
+        size_t word = parser_word_size(parser);
+        node->function_def_return_ptr_stack_offset = -(int)(parser->stack_size + word - 4);
+        parser->stack_size += word;
+    }
+
     scope_add_function_def(parser->scope, node);
 
     if (parser->curr_tok->type == TOKEN_SEMI)
@@ -195,6 +250,19 @@ struct Node *parser_parse_function_def(struct Parser *parser)
         parser_eat(parser, TOKEN_RBRACE);
     }
 
+    if (!node->function_def_is_decl && (parser->args->profile_generate || parser->args->profile_use))
+        profile_assign(node);
+
+    if (!node->function_def_is_decl && parser->args->optimize)
+    {
+        dce_function(parser, node);
+        sra_function(parser, node);
+        cse_function(parser, node);
+    }
+
+    if (!node->function_def_is_decl)
+        frame_layout(node, parser->scope, parser->stack_size, parser->args->optimize > 0);
+
     scope_pop_layer(parser->scope);
     parser->stack_size = prev_size;
 
@@ -202,21 +270,33 @@ struct Node *parser_parse_function_def(struct Parser *parser)
 }
 
 
-struct Node **parser_parse_function_def_params(struct Parser *parser, size_t *nparams)
+struct Node **parser_parse_function_def_params(struct Parser *parser, struct Node *func)
 {
     struct Node **params = 0;
+    size_t *nparams = &func->function_def_params_size;
     *nparams = 0;
 
     parser_eat(parser, TOKEN_LPAREN);
 
-    size_t offset = 8;
+    size_t word = parser_word_size(parser);
+    size_t nregs = node_conv_nregs(func->function_def_conv, parser->args->target);
 
     while (parser->curr_tok->type != TOKEN_RPAREN)
     {
         struct Node *param = node_alloc(NODE_VARIABLE);
         param->error_line = parser->curr_tok->line_num;
-        param->variable_stack_offset = offset;
-        offset += 4;
+
+        if (*nparams < nregs)
+        {
+            // Register args are spilled to a slot of their own like a local
+            param->variable_stack_offset = -(int)(parser->stack_size + word - 4);
+            parser->stack_size += word;
+        }
+        else
+        {
+            // Pushed args are above the saved frame pointer and return address
+            param->variable_stack_offset = 2 * word + word * (*nparams - nregs);
+        }
 
         param->variable_name = util_strcpy(parser->curr_tok->value);
         parser_eat(parser, TOKEN_ID);
@@ -275,7 +355,13 @@ struct Node *parser_parse_variable_def(struct Parser *parser)
     node->variable_def_value = parser_parse_expr(parser, false);
 
     node->variable_def_stack_offset = -parser->stack_size;
-    parser->stack_size += node_sizeof_dtype(node_strip_to_literal(node->variable_def_value, parser->scope));
+
+    // Struct values copied from elsewhere need as much room as an init list
+    if (node->variable_def_type.type == NODE_STRUCT)
+        parser->stack_size += node_sizeof_struct(scope_find_struct(parser->scope,
+                              node->variable_def_type.struct_type, node->error_line), parser->scope);
+    else
+        parser->stack_size += node_sizeof_dtype(node_strip_to_literal(node->variable_def_value, parser->scope));
 
     scope_add_variable_def(parser->scope, node);
 
@@ -375,30 +461,40 @@ struct Node *parser_parse_function_call(struct Parser *parser)
 
         node->function_call_args[node->function_call_args_size - 1] = expr;
 
+        // Struct args are passed by reference, the callee may change them
+        if (expr->type == NODE_VARIABLE && node_type_from_node(expr, parser->scope).type == NODE_STRUCT)
+            parser_mark_assigned(parser, expr);
+
         if (parser->curr_tok->type != TOKEN_RPAREN)
             parser_eat(parser, TOKEN_COMMA);
     }
 
     parser_eat(parser, TOKEN_RPAREN);
 
-    node->function_call_return_stack_offset = -parser->stack_size;
-
     struct Node *func_def = scope_find_function(parser->scope, node->function_call_name, -1);
-    size_t size = 4;
 
+    // Errors out if the returned struct doesn't exist
     if (func_def && func_def->function_def_return_type.struct_type)
-    {
-        size = node_sizeof_dtype(
-            scope_find_struct(parser->scope, func_def->function_def_return_type.struct_type, func_def->error_line)
-        );
-    }
+        scope_find_struct(parser->scope, func_def->function_def_return_type.struct_type, func_def->error_line);
 
-    parser->stack_size += size;
+    struct Node *body_def = scope_find_function_def(parser->scope, node->function_call_name, -1);
+
+    if (body_def)
+        node->function_call_inlined = inline_expand(parser, node, body_def);
 
     return node;
 }
 
 
+void parser_mark_assigned(struct Parser *parser, struct Node *var)
+{
+    struct Node *def = scope_find_variable_def(parser->scope, var);
+
+    if (def)
+        def->variable_def_is_assigned = true;
+}
+
+
 struct Node *parser_parse_assignment(struct Parser *parser)
 {
     struct Node *node = node_alloc(NODE_ASSIGNMENT);
@@ -407,6 +503,9 @@ struct Node *parser_parse_assignment(struct Parser *parser)
     node->assignment_dst = parser->prev_node;
     parser_eat(parser, TOKEN_EQUALS);
 
+    if (node->assignment_dst->type == NODE_VARIABLE)
+        parser_mark_assigned(parser, node->assignment_dst);
+
     node->assignment_src = parser_parse_expr(parser, false);
 
     return node;
@@ -497,7 +596,11 @@ struct Node *parser_parse_include(struct Parser *parser)
     size_t ntokens;
     struct Token **tokens = crust_tokenize(node->include_path, &ntokens);
     struct Parser *p = parser_alloc(tokens, ntokens, parser->args);
+    p->file = node->include_path;
+    // Inlined bodies bring the include's strings into this file
+    p->lc = parser->lc;
     node->include_root = parser_parse_compound(p);
+    parser->lc = p->lc;
     scope_combine(parser->scope, p->scope);
 
     if (!node->include_scope)
@@ -522,8 +625,6 @@ struct Node *parser_parse_binop(struct Parser *parser)
 {
     struct Node *node = node_alloc(NODE_BINOP);
     node->error_line = parser->curr_tok->line_num;
-    node->op_stack_offset = -parser->stack_size;
-    parser->stack_size += 8;
 
     node->op_type = parser->curr_tok->binop_type;
     parser_advance(parser, 1);
@@ -560,19 +661,7 @@ struct Node *parser_parse_idof(struct Parser *parser)
     if (type.type != NODE_STRING)
         errors_parser_idof_wrong_type(literal);
 
-    if (literal->type == NODE_STRING)
-    {
-        struct Node *string = node_alloc(NODE_STRING);
-        string->string_value = util_strcpy(literal->string_asm_id);
-        string->string_asm_id = parser_next_lc(parser);
-        string->error_line = parser->curr_tok->line_num;
-
-        node->idof_new_expr = string;
-    }
-    else
-    {
-        node->idof_new_expr = node_copy(literal);
-    }
+    node->idof_new_expr = parser_idof_new_expr(parser, literal, parser->curr_tok->line_num);
 
     if (literal->type != NODE_STRING && parser->args->warnings[WARNING_REDUNDANT_IDOF])
         errors_warn_redundant_idof(node);
@@ -605,9 +694,11 @@ struct Node *parser_parse_inline_asm(struct Parser *parser)
 struct Node *parser_parse_if_statement(struct Parser *parser)
 {
     struct Node *node = node_alloc(NODE_IF);
+    node->error_line = parser->curr_tok->line_num;
     parser_eat(parser, TOKEN_ID);
 
     node->if_cond = parser_parse_expr(parser, false);
+    node->if_hint = parser_strip_hint(&node->if_cond);
 
     parser_eat(parser, TOKEN_LBRACE);
     node->if_body = parser_parse_compound(parser);
@@ -617,6 +708,112 @@ struct Node *parser_parse_if_statement(struct Parser *parser)
 }
 
 
+int parser_strip_hint(struct Node **cond)
+{
+    struct Node *call = *cond;
+
+    if (call->type != NODE_FUNCTION_CALL || call->function_call_args_size != 1)
+        return HINT_NONE;
+
+    int hint;
+
+    if (strcmp(call->function_call_name, "likely") == 0)
+        hint = HINT_LIKELY;
+    else if (strcmp(call->function_call_name, "unlikely") == 0)
+        hint = HINT_UNLIKELY;
+    else
+        return HINT_NONE;
+
+    *cond = call->function_call_args[0];
+    call->function_call_args_size = 0;
+    node_free(call);
+
+    return hint;
+}
+
+
+struct Node *parser_parse_while(struct Parser *parser)
+{
+    struct Node *node = node_alloc(NODE_WHILE);
+    node->error_line = parser->curr_tok->line_num;
+    parser_eat(parser, TOKEN_ID);
+
+    node->while_cond = parser_parse_expr(parser, false);
+    // Loop bodies already follow the test, a hint doesn't change their layout
+    parser_strip_hint(&node->while_cond);
+
+    scope_push_block(parser->scope);
+
+    parser_eat(parser, TOKEN_LBRACE);
+    node->while_body = parser_parse_compound(parser);
+    parser_eat(parser, TOKEN_RBRACE);
+
+    scope_pop_layer(parser->scope);
+
+    return node;
+}
+
+
+struct Node *parser_parse_for(struct Parser *parser)
+{
+    struct Node *node = node_alloc(NODE_FOR);
+    node->error_line = parser->curr_tok->line_num;
+    parser_eat(parser, TOKEN_ID); // for
+
+    struct Node *var = node_alloc(NODE_VARIABLE_DEF);
+    var->error_line = parser->curr_tok->line_num;
+    var->variable_def_name = util_strcpy(parser->curr_tok->value);
+    var->variable_def_type = (NodeDType){ NODE_INT, 0 };
+    // Stepped at the end of every iteration
+    var->variable_def_is_assigned = true;
+    parser_eat(parser, TOKEN_ID);
+
+    parser_eat(parser, TOKEN_ID); // in
+
+    var->variable_def_value = parser_parse_expr(parser, false);
+    parser_eat(parser, TOKEN_RANGE);
+    node->for_end = parser_parse_expr(parser, false);
+
+    node->for_var = var;
+    var->variable_def_stack_offset = -parser->stack_size;
+    parser->stack_size += 4;
+
+    if (node->for_end->type != NODE_INT)
+    {
+        node->for_end_stack_offset = -parser->stack_size;
+        parser->stack_size += 4;
+    }
+
+    scope_push_block(parser->scope);
+    scope_add_variable_def(parser->scope, var);
+
+    parser_eat(parser, TOKEN_LBRACE);
+    node->for_body = parser_parse_compound(parser);
+    parser_eat(parser, TOKEN_RBRACE);
+
+    if (parser->args->optimize)
+        loop_strength_reduce(parser, node);
+
+    scope_pop_layer(parser->scope);
+
+    return node;
+}
+
+
+struct Node *parser_idof_new_expr(struct Parser *parser, struct Node *literal, size_t line)
+{
+    if (literal->type != NODE_STRING)
+        return node_copy(literal);
+
+    struct Node *string = node_alloc(NODE_STRING);
+    string->string_value = util_strcpy(literal->string_asm_id);
+    string->string_asm_id = parser_next_lc(parser);
+    string->error_line = line;
+
+    return string;
+}
+
+
 NodeDType parser_parse_dtype(struct Parser *parser)
 {
     char *name = util_strcpy(parser->curr_tok->value);
@@ -631,6 +828,12 @@ NodeDType parser_parse_dtype(struct Parser *parser)
 }
 
 
+size_t parser_word_size(struct Parser *parser)
+{
+    return parser->args->target == TARGET_X86_64 ? 8 : 4;
+}
+
+
 char *parser_next_lc(struct Parser *parser)
 {
     char *label = util_int_to_str(parser->lc);
@@ -19,15 +19,22 @@ struct Parser
     struct Scope *scope;
 
     size_t stack_size;
+    // Number of the next .LC string label. Include parsers continue from
+    // ours, so labels are unique in the unit and its strings can share a section.
     size_t lc;
 
     struct Args *args;
 
     struct Node *prev_node;
+
+    // Path of the source being parsed, 0 if it isn't known
+    char *file;
 };
 
 struct Parser *parser_alloc(struct Token **tokens, size_t ntokens, struct Args *args);
 void parser_free(struct Parser *parser);
+// Continues parsing another file into the same scope
+void parser_set_tokens(struct Parser *parser, struct Token **tokens, size_t ntokens);
 
 void parser_eat(struct Parser *parser, int type);
 void parser_advance(struct Parser *parser, int i);
@@ -40,7 +47,8 @@ struct Node *parser_parse_str(struct Parser *parser);
 struct Node *parser_parse_id(struct Parser *parser);
 
 struct Node *parser_parse_function_def(struct Parser *parser);
-struct Node **parser_parse_function_def_params(struct Parser *parser, size_t *nparams);
+// Also sets the params' stack offsets, which depend on func's calling convention
+struct Node **parser_parse_function_def_params(struct Parser *parser, struct Node *func);
 struct Node *parser_parse_return(struct Parser *parser);
 
 struct Node *parser_parse_variable_def(struct Parser *parser);
@@ -50,6 +58,8 @@ struct Node *parser_parse_variable_struct_member(struct Parser *parser, struct N
 struct Node *parser_parse_function_call(struct Parser *parser);
 
 struct Node *parser_parse_assignment(struct Parser *parser);
+// Stops the initial value of var's def from being propagated
+void parser_mark_assigned(struct Parser *parser, struct Node *var);
 
 struct Node *parser_parse_struct(struct Parser *parser);
 
@@ -60,14 +70,23 @@ struct Node *parser_parse_include(struct Parser *parser);
 struct Node *parser_parse_binop(struct Parser *parser);
 
 struct Node *parser_parse_idof(struct Parser *parser);
+// String holding the label of a string literal, or a copy of anything else
+struct Node *parser_idof_new_expr(struct Parser *parser, struct Node *literal, size_t line);
 
 struct Node *parser_parse_inline_asm(struct Parser *parser);
 
 struct Node *parser_parse_if_statement(struct Parser *parser);
+// Unwraps likely(c) and unlikely(c) to c, returning the hint
+int parser_strip_hint(struct Node **cond);
+struct Node *parser_parse_while(struct Parser *parser);
+// for i in a..b, i is only visible in the loop
+struct Node *parser_parse_for(struct Parser *parser);
 
 NodeDType parser_parse_dtype(struct Parser *parser);
 
 char *parser_next_lc(struct Parser *parser);
+// Size of pointers and pushed args on the target
+size_t parser_word_size(struct Parser *parser);
 
 #endif
 
@@ -0,0 +1,927 @@
+#include "peephole.h"
+#include "util.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+
+const struct Reg g_regs[PEEPHOLE_NREGS] = {
+    { "%eax", REG_EAX, true }, { "%ax", REG_EAX, false }, { "%al", REG_EAX, false }, { "%ah", REG_EAX, false },
+    { "%ebx", REG_EBX, true }, { "%bx", REG_EBX, false }, { "%bl", REG_EBX, false }, { "%bh", REG_EBX, false },
+    { "%ecx", REG_ECX, true }, { "%cx", REG_ECX, false }, { "%cl", REG_ECX, false }, { "%ch", REG_ECX, false },
+    { "%edx", REG_EDX, true }, { "%dx", REG_EDX, false }, { "%dl", REG_EDX, false }, { "%dh", REG_EDX, false },
+    { "%esi", REG_ESI, true }, { "%si", REG_ESI, false },
+    { "%edi", REG_EDI, true }, { "%di", REG_EDI, false },
+    { "%esp", REG_ESP, true },
+    { "%ebp", REG_EBP, true }
+};
+
+struct Insn *insn_alloc(int type, char *text)
+{
+    struct Insn *insn = malloc(sizeof(struct Insn));
+    insn->type = type;
+    insn->text = text;
+
+    insn->op = 0;
+    insn->nargs = 0;
+
+    for (size_t i = 0; i < INSN_MAX_ARGS; ++i)
+        insn->args[i] = 0;
+
+    insn->removed = false;
+
+    return insn;
+}
+
+
+void insn_free(struct Insn *insn)
+{
+    free(insn->text);
+    free(insn->op);
+
+    for (size_t i = 0; i < insn->nargs; ++i)
+        free(insn->args[i]);
+
+    free(insn);
+}
+
+
+void insn_set_arg(struct Insn *insn, size_t i, const char *arg)
+{
+    free(insn->args[i]);
+    insn->args[i] = util_strcpy((char*)arg);
+}
+
+
+char *insn_trim(const char *begin, const char *end)
+{
+    while (begin < end && isspace(*begin))
+        ++begin;
+
+    while (end > begin && isspace(end[-1]))
+        --end;
+
+    char *s = malloc(sizeof(char) * (end - begin + 1));
+    memcpy(s, begin, end - begin);
+    s[end - begin] = '\0';
+
+    return s;
+}
+
+
+struct Insn *insn_parse_op(char *line)
+{
+    struct Insn *insn = insn_alloc(INSN_OP, line);
+
+    char *p = line;
+
+    while (*p && !isspace(*p))
+        ++p;
+
+    insn->op = insn_trim(line, p);
+
+    int depth = 0;
+    char *arg_begin = p;
+
+    for (;; ++p)
+    {
+        if (*p == '(')
+            ++depth;
+        else if (*p == ')')
+            --depth;
+
+        if ((*p == ',' && depth == 0) || *p == '\0')
+        {
+            char *arg = insn_trim(arg_begin, p);
+
+            if (arg[0] == '\0' || insn->nargs == INSN_MAX_ARGS)
+            {
+                free(arg);
+
+                // Not something the optimizer can describe
+                if (insn->nargs == INSN_MAX_ARGS)
+                    insn->type = INSN_OPAQUE;
+            }
+            else
+            {
+                insn->args[insn->nargs++] = arg;
+            }
+
+            if (*p == '\0')
+                break;
+
+            arg_begin = p + 1;
+        }
+    }
+
+    return insn;
+}
+
+
+struct InsnList *insn_list_parse(const char *text)
+{
+    struct InsnList *list = malloc(sizeof(struct InsnList));
+    list->insns = 0;
+    list->ninsns = 0;
+
+    bool inline_asm = false;
+    const char *begin = text;
+
+    while (*begin)
+    {
+        const char *end = strchr(begin, '\n');
+
+        if (!end)
+            end = begin + strlen(begin);
+
+        char *line = insn_trim(begin, end);
+        begin = *end ? end + 1 : end;
+
+        if (line[0] == '\0')
+        {
+            free(line);
+            continue;
+        }
+
+        struct Insn *insn;
+        size_t len = strlen(line);
+
+        if (strcmp(line, "#APP") == 0)
+            inline_asm = true;
+
+        if (inline_asm)
+            insn = insn_alloc(INSN_OPAQUE, line);
+        else if (line[0] == '#')
+            insn = insn_alloc(INSN_COMMENT, line);
+        else if (line[len - 1] == ':' && !strpbrk(line, " \t"))
+        {
+            line[len - 1] = '\0';
+            insn = insn_alloc(INSN_LABEL, line);
+        }
+        else if (line[0] == '.')
+            insn = insn_alloc(INSN_DIRECTIVE, line);
+        else
+            insn = insn_parse_op(line);
+
+        if (strcmp(line, "#NO_APP") == 0)
+            inline_asm = false;
+
+        list->insns = realloc(list->insns, sizeof(struct Insn*) * ++list->ninsns);
+        list->insns[list->ninsns - 1] = insn;
+    }
+
+    return list;
+}
+
+
+char *insn_list_str(struct InsnList *list)
+{
+    char *s = calloc(1, sizeof(char));
+
+    for (size_t i = 0; i < list->ninsns; ++i)
+    {
+        struct Insn *insn = list->insns[i];
+
+        if (insn->removed)
+            continue;
+
+        if (insn->type == INSN_OP)
+        {
+            util_strcat(&s, insn->op);
+
+            for (size_t j = 0; j < insn->nargs; ++j)
+            {
+                util_strcat(&s, j == 0 ? " " : ", ");
+                util_strcat(&s, insn->args[j]);
+            }
+        }
+        else
+        {
+            util_strcat(&s, insn->text);
+
+            if (insn->type == INSN_LABEL)
+                util_strcat(&s, ":");
+        }
+
+        util_strcat(&s, "\n");
+    }
+
+    return s;
+}
+
+
+void insn_list_free(struct InsnList *list)
+{
+    for (size_t i = 0; i < list->ninsns; ++i)
+        insn_free(list->insns[i]);
+
+    free(list->insns);
+    free(list);
+}
+
+
+bool peephole_op_is(const char *op, const char *base)
+{
+    size_t len = strlen(base);
+
+    if (strncmp(op, base, len) != 0)
+        return false;
+
+    return op[len] == '\0' || (strchr("bwlq", op[len]) && op[len + 1] == '\0');
+}
+
+
+// Directives that start a new section end whatever the optimizer knows,
+// everything else (.loc, .p2align, ...) doesn't affect it.
+bool peephole_is_boundary(struct Insn *insn)
+{
+    if (insn->type == INSN_LABEL || insn->type == INSN_OPAQUE)
+        return true;
+
+    if (insn->type != INSN_DIRECTIVE)
+        return false;
+
+    const char *section_dirs[] = { ".section", ".text", ".data", ".bss",
+                                   ".pushsection", ".popsection", ".previous" };
+
+    for (size_t i = 0; i < sizeof(section_dirs) / sizeof(section_dirs[0]); ++i)
+    {
+        size_t len = strlen(section_dirs[i]);
+
+        if (strncmp(insn->text, section_dirs[i], len) == 0 &&
+            (insn->text[len] == '\0' || isspace(insn->text[len])))
+            return true;
+    }
+
+    return false;
+}
+
+
+bool peephole_reg(const char *name, unsigned *reg, bool *full)
+{
+    for (size_t i = 0; i < PEEPHOLE_NREGS; ++i)
+    {
+        if (strcmp(g_regs[i].name, name) == 0)
+        {
+            *reg = g_regs[i].reg;
+            *full = g_regs[i].full;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+
+bool peephole_operand(const char *arg, struct Operand *o)
+{
+    o->regs = 0;
+    o->full = false;
+    o->slot = false;
+    o->offset = 0;
+    o->imm = 0;
+
+    if (arg[0] == '$')
+    {
+        char *end;
+        o->kind = OPND_IMM;
+        o->imm = strtol(&arg[1], &end, 0);
+        return true;
+    }
+
+    if (arg[0] == '%')
+    {
+        o->kind = OPND_REG;
+        return peephole_reg(arg, &o->regs, &o->full);
+    }
+
+    o->kind = OPND_MEM;
+    const char *paren = strchr(arg, '(');
+
+    if (!paren)
+        return true;
+
+    char *inside = insn_trim(paren + 1, arg + strlen(arg) - 1);
+    char *save = 0;
+
+    for (char *tok = strtok_r(inside, ",", &save); tok; tok = strtok_r(0, ",", &save))
+    {
+        while (isspace(*tok))
+            ++tok;
+
+        if (tok[0] != '%')
+            continue;
+
+        unsigned reg;
+        bool full;
+
+        if (!peephole_reg(tok, &reg, &full))
+        {
+            free(inside);
+            return false;
+        }
+
+        o->regs |= reg;
+    }
+
+    if (strcmp(inside, "%ebp") == 0)
+    {
+        char *end;
+        o->offset = strtol(arg, &end, 10);
+        o->slot = end == paren;
+    }
+
+    free(inside);
+    return true;
+}
+
+
+void peephole_effect_read(struct Effect *e, struct Operand *o)
+{
+    e->reads |= o->regs;
+}
+
+
+void peephole_effect_write(struct Effect *e, struct Operand *o)
+{
+    if (o->kind == OPND_REG)
+    {
+        e->writes |= o->regs;
+
+        // Partial writes keep the rest of the register alive
+        if (!o->full)
+            e->reads |= o->regs;
+    }
+    else if (o->kind == OPND_MEM)
+    {
+        e->reads |= o->regs;
+        e->mem_write = true;
+
+        if (o->slot)
+        {
+            e->mem_write_slot = true;
+            e->mem_write_offset = o->offset;
+        }
+    }
+}
+
+
+bool peephole_effect(struct Insn *insn, struct Effect *e)
+{
+    e->reads = 0;
+    e->writes = 0;
+    e->mem_write = false;
+    e->mem_write_slot = false;
+    e->mem_write_offset = 0;
+    e->barrier = false;
+    e->branch = false;
+    e->jump = false;
+
+    if (insn->type != INSN_OP)
+        return false;
+
+    struct Operand o[INSN_MAX_ARGS];
+
+    for (size_t i = 0; i < insn->nargs; ++i)
+    {
+        if (!peephole_operand(insn->args[i], &o[i]))
+            return false;
+    }
+
+    const char *op = insn->op;
+    size_t n = insn->nargs;
+
+    if (n == 2 && (peephole_op_is(op, "mov") || peephole_op_is(op, "lea") ||
+        strncmp(op, "movz", 4) == 0 || strncmp(op, "movs", 4) == 0))
+    {
+        peephole_effect_read(e, &o[0]);
+        peephole_effect_write(e, &o[1]);
+        return true;
+    }
+
+    if (n == 2 && (peephole_op_is(op, "add") || peephole_op_is(op, "sub") ||
+        peephole_op_is(op, "and") || peephole_op_is(op, "or") ||
+        peephole_op_is(op, "xor") || peephole_op_is(op, "adc") ||
+        peephole_op_is(op, "sbb") || peephole_op_is(op, "shl") ||
+        peephole_op_is(op, "shr") || peephole_op_is(op, "sar") ||
+        peephole_op_is(op, "sal") || peephole_op_is(op, "imul") ||
+        strncmp(op, "cmov", 4) == 0))
+    {
+        peephole_effect_read(e, &o[0]);
+        peephole_effect_read(e, &o[1]);
+        peephole_effect_write(e, &o[1]);
+        return true;
+    }
+
+    if (n == 3 && peephole_op_is(op, "imul"))
+    {
+        peephole_effect_read(e, &o[1]);
+        peephole_effect_write(e, &o[2]);
+        return true;
+    }
+
+    if ((n == 1 || n == 2) && (peephole_op_is(op, "cmp") || peephole_op_is(op, "test")))
+    {
+        for (size_t i = 0; i < n; ++i)
+            peephole_effect_read(e, &o[i]);
+
+        return true;
+    }
+
+    if (n == 1 && (peephole_op_is(op, "neg") || peephole_op_is(op, "not") ||
+        peephole_op_is(op, "inc") || peephole_op_is(op, "dec") ||
+        peephole_op_is(op, "shl") || peephole_op_is(op, "shr") ||
+        peephole_op_is(op, "sar") || peephole_op_is(op, "sal")))
+    {
+        peephole_effect_read(e, &o[0]);
+        peephole_effect_write(e, &o[0]);
+        return true;
+    }
+
+    if (n == 1 && strncmp(op, "set", 3) == 0)
+    {
+        peephole_effect_write(e, &o[0]);
+        return true;
+    }
+
+    if (n == 0 && (strcmp(op, "cltd") == 0 || strcmp(op, "cdq") == 0))
+    {
+        e->reads |= REG_EAX;
+        e->writes |= REG_EDX;
+        return true;
+    }
+
+    if (n == 1 && (peephole_op_is(op, "idiv") || peephole_op_is(op, "div") ||
+        peephole_op_is(op, "imul") || peephole_op_is(op, "mul")))
+    {
+        peephole_effect_read(e, &o[0]);
+        e->reads |= REG_EAX | REG_EDX;
+        e->writes |= REG_EAX | REG_EDX;
+        return true;
+    }
+
+    if (n == 1 && peephole_op_is(op, "push"))
+    {
+        // Pushes write below %esp, never into a live frame slot
+        peephole_effect_read(e, &o[0]);
+        e->reads |= REG_ESP;
+        e->writes |= REG_ESP;
+        return true;
+    }
+
+    if (n == 1 && peephole_op_is(op, "pop"))
+    {
+        peephole_effect_write(e, &o[0]);
+        e->reads |= REG_ESP;
+        e->writes |= REG_ESP;
+        return true;
+    }
+
+    if (n == 1 && op[0] == 'j')
+    {
+        e->branch = true;
+        e->jump = strcmp(op, "jmp") == 0;
+        peephole_effect_read(e, &o[0]);
+        return true;
+    }
+
+    if (n == 0 && strcmp(op, "nop") == 0)
+        return true;
+
+    // call, ret, leave, int, ...
+    e->barrier = true;
+    e->reads = REG_ALL;
+    e->writes = REG_ALL;
+    e->jump = strcmp(op, "ret") == 0;
+
+    return true;
+}
+
+
+size_t peephole_optimize(char **text, size_t start)
+{
+    struct InsnList *list = insn_list_parse(&(*text)[start]);
+
+    size_t removed = 0;
+    size_t n;
+
+    while ((n = peephole_pass(list)) > 0)
+        removed += n;
+
+    char *s = insn_list_str(list);
+    (*text)[start] = '\0';
+    util_strcat(text, s);
+
+    free(s);
+    insn_list_free(list);
+
+    return removed;
+}
+
+
+size_t peephole_pass(struct InsnList *list)
+{
+    size_t removed = 0;
+
+    removed += peephole_forward_stores(list);
+    removed += peephole_dead_moves(list);
+    removed += peephole_merge_stack_adjust(list);
+    removed += peephole_jump_to_next(list);
+    removed += peephole_unreachable(list);
+
+    return removed;
+}
+
+
+void peephole_bindings_kill_reg(struct Binding *b, size_t *nb, unsigned regs)
+{
+    for (size_t i = 0; i < *nb;)
+    {
+        if (b[i].reg & regs)
+        {
+            free(b[i].name);
+            b[i] = b[--*nb];
+        }
+        else
+        {
+            ++i;
+        }
+    }
+}
+
+
+void peephole_bindings_kill_slot(struct Binding *b, size_t *nb, int offset, int size)
+{
+    for (size_t i = 0; i < *nb;)
+    {
+        // Bindings are 4 byte values
+        if (offset < b[i].offset + 4 && b[i].offset < offset + size)
+        {
+            free(b[i].name);
+            b[i] = b[--*nb];
+        }
+        else
+        {
+            ++i;
+        }
+    }
+}
+
+
+struct Binding *peephole_bindings_add(struct Binding *b, size_t *nb, int offset, unsigned reg, char *name)
+{
+    b = realloc(b, sizeof(struct Binding) * ++*nb);
+    b[*nb - 1] = (struct Binding){ offset, reg, util_strcpy(name) };
+    return b;
+}
+
+
+int peephole_access_size(const char *op)
+{
+    switch (op[strlen(op) - 1])
+    {
+    case 'b': return 1;
+    case 'w': return 2;
+    case 'l': return 4;
+    default: return 8;
+    }
+}
+
+
+// Tracks which register holds the value of which x(%ebp) slot, and removes
+// stores of a value already in its slot and loads of a value already in a
+// register.
+size_t peephole_forward_stores(struct InsnList *list)
+{
+    size_t removed = 0;
+
+    struct Binding *b = 0;
+    size_t nb = 0;
+
+    for (size_t i = 0; i < list->ninsns; ++i)
+    {
+        struct Insn *insn = list->insns[i];
+
+        if (insn->removed || insn->type == INSN_COMMENT)
+            continue;
+
+        if (peephole_is_boundary(insn))
+        {
+            peephole_bindings_kill_reg(b, &nb, REG_ALL);
+            continue;
+        }
+
+        if (insn->type == INSN_DIRECTIVE)
+            continue;
+
+        struct Effect e;
+
+        if (!peephole_effect(insn, &e) || e.barrier || e.jump)
+        {
+            peephole_bindings_kill_reg(b, &nb, REG_ALL);
+            continue;
+        }
+
+        if (strcmp(insn->op, "movl") == 0)
+        {
+            struct Operand src, dst;
+            peephole_operand(insn->args[0], &src);
+            peephole_operand(insn->args[1], &dst);
+
+            // Store
+            if (src.kind == OPND_REG && (src.regs & REG_GENERAL) && dst.kind == OPND_MEM && dst.slot)
+            {
+                bool redundant = false;
+
+                for (size_t j = 0; j < nb; ++j)
+                {
+                    if (b[j].offset == dst.offset && b[j].reg == src.regs)
+                        redundant = true;
+                }
+
+                if (redundant)
+                {
+                    insn->removed = true;
+                    ++removed;
+                    continue;
+                }
+
+                peephole_bindings_kill_slot(b, &nb, dst.offset, 4);
+                b = peephole_bindings_add(b, &nb, dst.offset, src.regs, insn->args[0]);
+                continue;
+            }
+
+            // Load
+            if (src.kind == OPND_MEM && src.slot && dst.kind == OPND_REG && (dst.regs & REG_GENERAL))
+            {
+                struct Binding *hit = 0;
+
+                for (size_t j = 0; j < nb; ++j)
+                {
+                    if (b[j].offset == src.offset)
+                    {
+                        hit = &b[j];
+
+                        if (b[j].reg == dst.regs)
+                            break;
+                    }
+                }
+
+                if (hit && hit->reg == dst.regs)
+                {
+                    insn->removed = true;
+                    ++removed;
+                    continue;
+                }
+
+                if (hit)
+                    insn_set_arg(insn, 0, hit->name);
+
+                peephole_bindings_kill_reg(b, &nb, dst.regs);
+                b = peephole_bindings_add(b, &nb, src.offset, dst.regs, insn->args[1]);
+                continue;
+            }
+        }
+
+        // Compares read a bound slot from its register
+        if (strcmp(insn->op, "cmpl") == 0)
+        {
+            for (size_t a = 0; a < insn->nargs; ++a)
+            {
+                struct Operand o;
+                peephole_operand(insn->args[a], &o);
+
+                for (size_t j = 0; o.kind == OPND_MEM && o.slot && j < nb; ++j)
+                {
+                    if (b[j].offset == o.offset)
+                    {
+                        insn_set_arg(insn, a, b[j].name);
+                        break;
+                    }
+                }
+            }
+        }
+
+        peephole_bindings_kill_reg(b, &nb, e.writes);
+
+        if (e.writes & REG_EBP)
+            peephole_bindings_kill_reg(b, &nb, REG_ALL);
+
+        if (e.mem_write)
+        {
+            if (e.mem_write_slot)
+                peephole_bindings_kill_slot(b, &nb, e.mem_write_offset, peephole_access_size(insn->op));
+            else
+                peephole_bindings_kill_reg(b, &nb, REG_ALL);
+        }
+    }
+
+    peephole_bindings_kill_reg(b, &nb, REG_ALL);
+    free(b);
+
+    return removed;
+}
+
+
+// Removes register moves whose result is overwritten before it's read.
+// Registers are assumed live across labels, branches and calls.
+size_t peephole_dead_moves(struct InsnList *list)
+{
+    size_t removed = 0;
+    unsigned live = REG_ALL;
+
+    for (size_t i = list->ninsns; i-- > 0;)
+    {
+        struct Insn *insn = list->insns[i];
+
+        if (insn->removed || insn->type == INSN_COMMENT)
+            continue;
+
+        if (peephole_is_boundary(insn))
+        {
+            live = REG_ALL;
+            continue;
+        }
+
+        if (insn->type == INSN_DIRECTIVE)
+            continue;
+
+        struct Effect e;
+
+        if (!peephole_effect(insn, &e) || e.barrier || e.branch)
+        {
+            live = REG_ALL;
+            continue;
+        }
+
+        bool move = insn->nargs == 2 && (peephole_op_is(insn->op, "mov") ||
+                    peephole_op_is(insn->op, "lea") || strncmp(insn->op, "movz", 4) == 0 ||
+                    strncmp(insn->op, "movs", 4) == 0);
+
+        if (move)
+        {
+            struct Operand dst;
+            peephole_operand(insn->args[1], &dst);
+
+            bool self = strcmp(insn->args[0], insn->args[1]) == 0 && !peephole_op_is(insn->op, "lea");
+
+            if (dst.kind == OPND_REG && dst.full && (dst.regs & REG_GENERAL) &&
+                (self || !(live & dst.regs)))
+            {
+                insn->removed = true;
+                ++removed;
+                continue;
+            }
+        }
+
+        live = (live & ~e.writes) | e.reads;
+    }
+
+    return removed;
+}
+
+
+// subl $a, %esp ... subl $b, %esp becomes subl $a+b, %esp when nothing in
+// between touches %esp. Allocating early is always safe.
+size_t peephole_merge_stack_adjust(struct InsnList *list)
+{
+    size_t removed = 0;
+    struct Insn *prev = 0;
+
+    for (size_t i = 0; i < list->ninsns; ++i)
+    {
+        struct Insn *insn = list->insns[i];
+
+        if (insn->removed || insn->type == INSN_COMMENT)
+            continue;
+
+        if (peephole_is_boundary(insn))
+        {
+            prev = 0;
+            continue;
+        }
+
+        if (insn->type == INSN_DIRECTIVE)
+            continue;
+
+        struct Effect e;
+
+        if (!peephole_effect(insn, &e) || e.barrier || e.branch)
+        {
+            prev = 0;
+            continue;
+        }
+
+        if (strcmp(insn->op, "subl") == 0 && insn->args[0][0] == '$' &&
+            strcmp(insn->args[1], "%esp") == 0)
+        {
+            if (prev)
+            {
+                struct Operand a, b;
+                peephole_operand(prev->args[0], &a);
+                peephole_operand(insn->args[0], &b);
+
+                char buf[16];
+                sprintf(buf, "$%d", a.imm + b.imm);
+                insn_set_arg(prev, 0, buf);
+
+                insn->removed = true;
+                ++removed;
+            }
+            else
+            {
+                prev = insn;
+            }
+
+            continue;
+        }
+
+        if ((e.reads | e.writes) & REG_ESP)
+            prev = 0;
+    }
+
+    return removed;
+}
+
+
+struct Insn *peephole_next(struct InsnList *list, size_t i)
+{
+    for (size_t j = i + 1; j < list->ninsns; ++j)
+    {
+        struct Insn *insn = list->insns[j];
+
+        if (insn->removed || insn->type == INSN_COMMENT)
+            continue;
+
+        if (insn->type == INSN_DIRECTIVE && !peephole_is_boundary(insn))
+            continue;
+
+        return insn;
+    }
+
+    return 0;
+}
+
+
+size_t peephole_jump_to_next(struct InsnList *list)
+{
+    size_t removed = 0;
+
+    for (size_t i = 0; i < list->ninsns; ++i)
+    {
+        struct Insn *insn = list->insns[i];
+
+        if (insn->removed || insn->type != INSN_OP || insn->op[0] != 'j' || insn->nargs != 1)
+            continue;
+
+        struct Insn *next = peephole_next(list, i);
+
+        if (next && next->type == INSN_LABEL && strcmp(next->text, insn->args[0]) == 0)
+        {
+            insn->removed = true;
+            ++removed;
+        }
+    }
+
+    return removed;
+}
+
+
+// Removes instructions after jmp/ret up to the next label.
+size_t peephole_unreachable(struct InsnList *list)
+{
+    size_t removed = 0;
+    bool dead = false;
+
+    for (size_t i = 0; i < list->ninsns; ++i)
+    {
+        struct Insn *insn = list->insns[i];
+
+        if (insn->removed || insn->type == INSN_COMMENT)
+            continue;
+
+        if (peephole_is_boundary(insn))
+        {
+            dead = false;
+            continue;
+        }
+
+        if (insn->type != INSN_OP)
+            continue;
+
+        if (dead)
+        {
+            insn->removed = true;
+            ++removed;
+            continue;
+        }
+
+        struct Effect e;
+
+        if (peephole_effect(insn, &e) && e.jump)
+            dead = true;
+    }
+
+    return removed;
+}
+
@@ -0,0 +1,149 @@
+#ifndef PEEPHOLE_H
+#define PEEPHOLE_H
+
+#include <stdlib.h>
+#include <stdbool.h>
+
+#define INSN_MAX_ARGS 3
+
+enum
+{
+    REG_EAX = 1 << 0,
+    REG_EBX = 1 << 1,
+    REG_ECX = 1 << 2,
+    REG_EDX = 1 << 3,
+    REG_ESI = 1 << 4,
+    REG_EDI = 1 << 5,
+    REG_ESP = 1 << 6,
+    REG_EBP = 1 << 7,
+    REG_ALL = 0xff,
+    // Registers whose contents the optimizer is allowed to track
+    REG_GENERAL = REG_EAX | REG_EBX | REG_ECX | REG_EDX | REG_ESI | REG_EDI
+};
+
+struct Insn
+{
+    enum
+    {
+        INSN_OP,
+        INSN_LABEL,
+        INSN_DIRECTIVE,
+        INSN_COMMENT,
+        // Inline asm; never looked into or moved
+        INSN_OPAQUE
+    } type;
+
+    // Original line, or label name without the ':'
+    char *text;
+
+    char *op;
+    char *args[INSN_MAX_ARGS];
+    size_t nargs;
+
+    bool removed;
+};
+
+struct InsnList
+{
+    struct Insn **insns;
+    size_t ninsns;
+};
+
+struct Operand
+{
+    enum
+    {
+        OPND_IMM,
+        OPND_REG,
+        OPND_MEM
+    } kind;
+
+    // Register for OPND_REG, address registers for OPND_MEM
+    unsigned regs;
+    bool full;
+
+    // x(%ebp) with a constant x
+    bool slot;
+    int offset;
+
+    int imm;
+};
+
+struct Effect
+{
+    unsigned reads, writes;
+
+    bool mem_write;
+    // Memory written is a known x(%ebp) slot
+    bool mem_write_slot;
+    int mem_write_offset;
+
+    bool barrier;
+    bool branch;
+    bool jump;
+};
+
+struct Binding
+{
+    int offset;
+    unsigned reg;
+    char *name;
+};
+
+#define PEEPHOLE_NREGS 22
+
+// Names of the registers and their partial views
+struct Reg
+{
+    const char *name;
+    unsigned reg;
+    // Writing the register overwrites all of it
+    bool full;
+};
+
+extern const struct Reg g_regs[PEEPHOLE_NREGS];
+
+struct InsnList *insn_list_parse(const char *text);
+char *insn_list_str(struct InsnList *list);
+void insn_list_free(struct InsnList *list);
+
+struct Insn *insn_alloc(int type, char *text);
+void insn_free(struct Insn *insn);
+void insn_set_arg(struct Insn *insn, size_t i, const char *arg);
+
+char *insn_trim(const char *begin, const char *end);
+struct Insn *insn_parse_op(char *line);
+
+bool peephole_op_is(const char *op, const char *base);
+// Labels, inline asm and section changes
+bool peephole_is_boundary(struct Insn *insn);
+bool peephole_reg(const char *name, unsigned *reg, bool *full);
+bool peephole_operand(const char *arg, struct Operand *o);
+
+void peephole_effect_read(struct Effect *e, struct Operand *o);
+void peephole_effect_write(struct Effect *e, struct Operand *o);
+// Returns false for instructions the optimizer doesn't understand.
+bool peephole_effect(struct Insn *insn, struct Effect *e);
+
+// Bytes accessed by an instruction's memory operand, from its suffix
+int peephole_access_size(const char *op);
+// Next instruction that isn't removed, a comment or a plain directive
+struct Insn *peephole_next(struct InsnList *list, size_t i);
+
+void peephole_bindings_kill_reg(struct Binding *b, size_t *nb, unsigned regs);
+void peephole_bindings_kill_slot(struct Binding *b, size_t *nb, int offset, int size);
+struct Binding *peephole_bindings_add(struct Binding *b, size_t *nb, int offset, unsigned reg, char *name);
+
+// Optimizes the assembly in *text starting at index start, which must be the
+// beginning of a function. Returns the number of eliminated instructions.
+size_t peephole_optimize(char **text, size_t start);
+size_t peephole_pass(struct InsnList *list);
+
+size_t peephole_forward_stores(struct InsnList *list);
+size_t peephole_dead_moves(struct InsnList *list);
+size_t peephole_merge_stack_adjust(struct InsnList *list);
+size_t peephole_jump_to_next(struct InsnList *list);
+size_t peephole_unreachable(struct InsnList *list);
+
+#endif
+
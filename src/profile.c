@@ -0,0 +1,181 @@
+#include "profile.h"
+#include "asm.h"
+#include "errors.h"
+#include "util.h"
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+struct Profile g_profile = { 0 };
+
+
+void profile_assign(struct Node *func)
+{
+    size_t nifs = 0;
+    profile_assign_ifs(func->function_def_body, 0, &nifs);
+
+    const char *template = "%s:%zu";
+    func->profile_key = calloc(strlen(template) + strlen(func->function_def_name) + MAX_INT_LEN + 1, sizeof(char));
+    sprintf(func->profile_key, template, func->function_def_name, nifs);
+
+    nifs = 0;
+    profile_assign_ifs(func->function_def_body, func->profile_key, &nifs);
+}
+
+
+void profile_assign_ifs(struct Node *node, char *prefix, size_t *nifs)
+{
+    switch (node->type)
+    {
+    case NODE_COMPOUND:
+        for (size_t i = 0; i < node->compound_size; ++i)
+            profile_assign_ifs(node->compound_nodes[i], prefix, nifs);
+        break;
+
+    case NODE_IF:
+        if (!node->profile_key)
+        {
+            ++*nifs;
+
+            if (prefix)
+            {
+                node->profile_key = calloc(strlen(prefix) + MAX_INT_LEN + 2, sizeof(char));
+                sprintf(node->profile_key, "%s:%zu", prefix, *nifs);
+            }
+        }
+
+        profile_assign_ifs(node->if_body, prefix, nifs);
+        break;
+
+    case NODE_WHILE:
+        profile_assign_ifs(node->while_body, prefix, nifs);
+        break;
+
+    case NODE_FOR:
+        profile_assign_ifs(node->for_body, prefix, nifs);
+        break;
+
+    default: break;
+    }
+}
+
+
+void profile_load(char *path)
+{
+    FILE *fp = fopen(path, "rb");
+    uint32_t len;
+
+    if (!fp || fread(&len, sizeof(len), 1, fp) != 1)
+    {
+        errors_warn_missing_profile(path);
+
+        if (fp)
+            fclose(fp);
+
+        return;
+    }
+
+    char *keys = malloc(sizeof(char) * (len + 1));
+    keys[len] = '\0';
+
+    if (fread(keys, sizeof(char), len, fp) != len)
+        len = 0;
+
+    for (size_t i = 0; i < len; i += strlen(&keys[i]) + 1)
+    {
+        uint32_t count;
+
+        if (fread(&count, sizeof(count), 1, fp) != 1)
+            break;
+
+        profile_add(&keys[i], count);
+    }
+
+    free(keys);
+    fclose(fp);
+}
+
+
+void profile_add(char *key, size_t count)
+{
+    size_t i = 0;
+
+    while (i < g_profile.nkeys && strcmp(g_profile.keys[i], key) != 0)
+        ++i;
+
+    if (i == g_profile.nkeys)
+    {
+        ++g_profile.nkeys;
+        g_profile.keys = realloc(g_profile.keys, sizeof(char*) * g_profile.nkeys);
+        g_profile.counts = realloc(g_profile.counts, sizeof(size_t) * g_profile.nkeys);
+
+        g_profile.keys[i] = util_strcpy(key);
+        g_profile.counts[i] = 0;
+    }
+
+    g_profile.counts[i] += count;
+
+    // Entry counters are the ones with only the function's own part
+    if (strchr(key, ':') == strrchr(key, ':') && g_profile.counts[i] > g_profile.max_entry)
+        g_profile.max_entry = g_profile.counts[i];
+}
+
+
+void profile_free()
+{
+    for (size_t i = 0; i < g_profile.nkeys; ++i)
+        free(g_profile.keys[i]);
+
+    free(g_profile.keys);
+    free(g_profile.counts);
+
+    g_profile = (struct Profile){ 0 };
+}
+
+
+bool profile_find(char *key, size_t *count)
+{
+    for (size_t i = 0; i < g_profile.nkeys; ++i)
+    {
+        if (strcmp(g_profile.keys[i], key) == 0)
+        {
+            *count = g_profile.counts[i];
+            return true;
+        }
+    }
+
+    return false;
+}
+
+
+int profile_function_heat(struct Node *func)
+{
+    size_t count;
+
+    if (!func->profile_key || !profile_find(func->profile_key, &count))
+        return PROFILE_UNKNOWN;
+
+    if (!count)
+        return PROFILE_COLD;
+
+    return count * PROFILE_HOT_FRACTION >= g_profile.max_entry ? PROFILE_HOT : PROFILE_UNKNOWN;
+}
+
+
+bool profile_check_cold_if(struct Node *node)
+{
+    size_t tested, taken;
+
+    if (!node->profile_key || !profile_find(node->profile_key, &tested))
+        return false;
+
+    char *key = calloc(strlen(node->profile_key) + 3, sizeof(char));
+    sprintf(key, "%s:t", node->profile_key);
+
+    bool found = profile_find(key, &taken);
+    free(key);
+
+    return found && (!tested || taken * PROFILE_COLD_FRACTION <= tested);
+}
+
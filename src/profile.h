@@ -0,0 +1,65 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include "node.h"
+
+#include <stdlib.h>
+#include <stdbool.h>
+
+#define PROFILE_FILE "crust.prof"
+
+// Functions entered at least a tenth as often as the most entered one are hot
+#define PROFILE_HOT_FRACTION 10
+// If bodies run at most a tenth of the times their condition is tested are cold
+#define PROFILE_COLD_FRACTION 10
+// Hot callees are inlined up to this many times the usual size limit
+#define PROFILE_INLINE_SCALE 4
+
+enum
+{
+    PROFILE_UNKNOWN,
+    PROFILE_COLD,
+    PROFILE_HOT
+};
+
+// Profile guided optimization. Counters are named after the function they
+// are in and the position of their if in it, so editing a function only
+// invalidates its own counts:
+//   f:N       times f was entered, N being the number of ifs in f
+//   f:N:i     times the ith if of f was tested
+//   f:N:i:t   times its body ran
+// Inlined and unrolled bodies keep the names of the code they're copied
+// from, and counters sharing a name are added up.
+//
+// The file is the crust_prof_keys and crust_prof sections of the program:
+// the 4 byte length of the names, the names each NUL terminated, then a 4
+// byte count for each name. The linker concatenates both sections in the
+// same object order, so names and counts stay in step.
+struct Profile
+{
+    char **keys;
+    size_t *counts;
+    size_t nkeys;
+
+    // Entries of the most entered function
+    size_t max_entry;
+};
+
+extern struct Profile g_profile;
+
+// Names func and its ifs. Runs once its body is parsed, before other passes
+// can change it, and skips ifs of inlined bodies which are already named.
+void profile_assign(struct Node *func);
+void profile_assign_ifs(struct Node *node, char *prefix, size_t *nifs);
+
+void profile_load(char *path);
+void profile_add(char *key, size_t count);
+void profile_free();
+
+bool profile_find(char *key, size_t *count);
+int profile_function_heat(struct Node *func);
+// Rarely or never run bodies are moved behind their function's code
+bool profile_check_cold_if(struct Node *node);
+
+#endif
+
@@ -143,6 +143,23 @@ struct Node *scope_find_variable_struct_member(struct Scope *scope, struct Node
 }
 
 
+struct Node *scope_find_variable_def(struct Scope *scope, struct Node *var)
+{
+    for (size_t layer = 0; layer < scope->nlayers; ++layer)
+    {
+        for (size_t i = 0; i < scope->layers[layer]->variable_defs_size; ++i)
+        {
+            struct Node *def = scope->layers[layer]->variable_defs[i];
+
+            if (strcmp(def->variable_def_name, var->variable_name) == 0)
+                return def;
+        }
+    }
+
+    return 0;
+}
+
+
 struct Node *scope_find_function(struct Scope *scope, char *name, int err_line)
 {
     for (size_t i = 0; i < scope->function_defs_size; ++i)
@@ -223,6 +240,16 @@ void scope_push_layer(struct Scope *scope)
 }
 
 
+void scope_push_block(struct Scope *scope)
+{
+    struct ScopeLayer *func = scope->curr_layer;
+    scope_push_layer(scope);
+
+    scope->curr_layer->params = func->params;
+    scope->curr_layer->nparams = func->nparams;
+}
+
+
 void scope_combine(struct Scope *s1, struct Scope *s2)
 {
     s1->function_defs = realloc(s1->function_defs,
@@ -35,6 +35,8 @@ void scope_add_struct_def(struct Scope *scope, struct Node *node);
 // Pass -1 for error_line to suppress errors if target is not found
 struct Node *scope_find_variable(struct Scope *scope, struct Node *var, int err_line);
 struct Node *scope_find_variable_struct_member(struct Scope *scope, struct Node *var, int err_line);
+// Def of the variable var or its members belong to, 0 for params
+struct Node *scope_find_variable_def(struct Scope *scope, struct Node *var);
 struct Node *scope_find_function(struct Scope *scope, char *name, int err_line);
 struct Node *scope_find_function_def(struct Scope *scope, char *name, int err_line);
 struct Node *scope_find_function_decl(struct Scope *scope, char *name, int err_line);
@@ -42,6 +44,8 @@ struct Node *scope_find_struct(struct Scope *scope, char *name, int err_line);
 
 void scope_pop_layer(struct Scope *scope);
 void scope_push_layer(struct Scope *scope);
+// Layer for the variables of a block inside a function, which still sees the function's params
+void scope_push_block(struct Scope *scope);
 
 // Copies all defs from s2 to s1
 void scope_combine(struct Scope *s1, struct Scope *s2);
@@ -0,0 +1,320 @@
+#include "sra.h"
+#include "scope.h"
+#include "stats.h"
+#include "util.h"
+
+#include <stdio.h>
+#include <string.h>
+
+
+void sra_function(struct Parser *parser, struct Node *func)
+{
+    sra_stmt(parser, func, func->function_def_body);
+}
+
+
+void sra_stmt(struct Parser *parser, struct Node *func, struct Node *node)
+{
+    switch (node->type)
+    {
+    case NODE_COMPOUND:
+        for (size_t i = 0; i < node->compound_size; ++i)
+        {
+            struct Node *stmt = node->compound_nodes[i];
+
+            if (stmt->type == NODE_VARIABLE_DEF && stmt->variable_def_type.type == NODE_STRUCT &&
+                stmt->variable_def_value->type == NODE_INIT_LIST)
+                sra_split(parser, func, node, i);
+            else
+                sra_stmt(parser, func, stmt);
+        }
+        break;
+
+    case NODE_IF:
+        sra_stmt(parser, func, node->if_body);
+        break;
+
+    case NODE_WHILE:
+        sra_stmt(parser, func, node->while_body);
+        break;
+
+    case NODE_FOR:
+        sra_stmt(parser, func, node->for_body);
+        break;
+
+    default: break;
+    }
+}
+
+
+void sra_split(struct Parser *parser, struct Node *func, struct Node *compound, size_t i)
+{
+    struct Node *def = compound->compound_nodes[i];
+    size_t nwords = node_sizeof_dtype(def->variable_def_value) / 4;
+
+    struct Sra sra = {
+        .def = def,
+        .nwords = nwords,
+        .names = calloc(nwords, sizeof(char*)),
+        .values = calloc(nwords, sizeof(struct Node*)),
+        .reads = calloc(nwords, sizeof(size_t)),
+        .writes = calloc(nwords, sizeof(size_t))
+    };
+
+    // Its uses can only follow it in its own block
+    bool split = sra_flatten(parser, &sra, def->variable_def_value, def->variable_def_name, 0);
+
+    for (size_t j = i + 1; split && j < compound->compound_size; ++j)
+        split = sra_visit(&sra, compound->compound_nodes[j], false);
+
+    if (split && sra_check_words(&sra))
+    {
+        struct Node *scalars = node_alloc(NODE_COMPOUND);
+        scalars->compound_nodes = 0;
+        scalars->compound_size = 0;
+
+        for (size_t w = 0; w < nwords; ++w)
+        {
+            if (!sra.reads[w])
+                continue;
+
+            struct Node *var = node_alloc(NODE_VARIABLE_DEF);
+            var->error_line = def->error_line;
+            var->variable_def_name = util_strcpy(sra.names[w]);
+            var->variable_def_type = (NodeDType){ NODE_INT, 0 };
+            var->variable_def_value = node_copy(sra.values[w]);
+            var->variable_def_stack_offset = def->variable_def_stack_offset - 4 * (int)w;
+            var->variable_def_is_assigned = sra.writes[w] > 0;
+
+            scalars->compound_nodes = realloc(scalars->compound_nodes, sizeof(struct Node*) * ++scalars->compound_size);
+            scalars->compound_nodes[scalars->compound_size - 1] = var;
+        }
+
+        for (size_t j = i + 1; j < compound->compound_size; ++j)
+            sra_visit(&sra, compound->compound_nodes[j], true);
+
+        stats_add_sra(func->function_def_name, def->variable_def_name, scalars->compound_size, nwords);
+
+        compound->compound_nodes[i] = scalars;
+        node_free(def);
+    }
+
+    for (size_t w = 0; w < nwords; ++w)
+        free(sra.names[w]);
+
+    free(sra.names);
+    free(sra.values);
+    free(sra.reads);
+    free(sra.writes);
+}
+
+
+bool sra_flatten(struct Parser *parser, struct Sra *sra, struct Node *list, char *prefix, size_t first)
+{
+    struct Node *def = scope_find_struct(parser->scope, list->init_list_type.struct_type, -1);
+
+    if (!def || list->init_list_len > def->struct_members_size)
+        return false;
+
+    for (size_t i = 0; i < list->init_list_len; ++i)
+    {
+        struct Node *value = list->init_list_values[i];
+        struct Node *member = def->struct_members[i];
+        size_t w = first + i;
+
+        char *name = calloc(strlen(prefix) + strlen(member->member_name) + 2, sizeof(char));
+        sprintf(name, "%s.%s", prefix, member->member_name);
+
+        if (value->type == NODE_INIT_LIST)
+        {
+            bool ok = sra_flatten(parser, sra, value, name, w);
+            free(name);
+
+            if (!ok)
+                return false;
+
+            continue;
+        }
+
+        // Nested structs that aren't last share slots with the members after them
+        if (w >= sra->nwords || sra->values[w] || member->member_type.type == NODE_STRUCT)
+        {
+            free(name);
+            return false;
+        }
+
+        sra->names[w] = name;
+        sra->values[w] = value;
+    }
+
+    return true;
+}
+
+
+bool sra_visit(struct Sra *sra, struct Node *node, bool rewrite)
+{
+    switch (node->type)
+    {
+    case NODE_VARIABLE:
+        return sra_visit_var(sra, node, sra->reads, rewrite);
+
+    case NODE_ASSIGNMENT:
+    {
+        struct Node *dst = node->assignment_dst;
+        bool ok;
+
+        if (dst->type == NODE_VARIABLE && strcmp(dst->variable_name, sra->def->variable_def_name) == 0)
+            ok = sra_visit_var(sra, dst, sra->writes, rewrite);
+        else
+            ok = sra_visit(sra, dst, rewrite);
+
+        return ok && sra_visit(sra, node->assignment_src, rewrite);
+    }
+
+    case NODE_VARIABLE_DEF:
+        if (strcmp(node->variable_def_name, sra->def->variable_def_name) == 0)
+            return false;
+
+        return sra_visit(sra, node->variable_def_value, rewrite);
+
+    case NODE_COMPOUND:
+        for (size_t i = 0; i < node->compound_size; ++i)
+        {
+            if (!sra_visit(sra, node->compound_nodes[i], rewrite))
+                return false;
+        }
+
+        return true;
+
+    case NODE_INIT_LIST:
+        for (size_t i = 0; i < node->init_list_len; ++i)
+        {
+            if (!sra_visit(sra, node->init_list_values[i], rewrite))
+                return false;
+        }
+
+        return true;
+
+    case NODE_RETURN:
+        return sra_visit(sra, node->return_value, rewrite);
+
+    case NODE_FUNCTION_CALL:
+        for (size_t i = 0; i < node->function_call_args_size; ++i)
+        {
+            if (!sra_visit(sra, node->function_call_args[i], rewrite))
+                return false;
+        }
+
+        // Inlined bodies hold copies of the args
+        return !node->function_call_inlined || sra_visit(sra, node->function_call_inlined, rewrite);
+
+    case NODE_BINOP:
+        return sra_visit(sra, node->op_l, rewrite) && sra_visit(sra, node->op_r, rewrite);
+
+    case NODE_INLINE_ASM:
+        for (size_t i = 0; i < node->asm_nargs; ++i)
+        {
+            if (!sra_visit(sra, node->asm_args[i], rewrite))
+                return false;
+        }
+
+        return true;
+
+    case NODE_IDOF:
+        return sra_visit(sra, node->idof_original_expr, rewrite) && sra_visit(sra, node->idof_new_expr, rewrite);
+
+    case NODE_IF:
+        return sra_visit(sra, node->if_cond, rewrite) && sra_visit(sra, node->if_body, rewrite);
+
+    case NODE_WHILE:
+        return sra_visit(sra, node->while_cond, rewrite) && sra_visit(sra, node->while_body, rewrite);
+
+    case NODE_FOR:
+        if (!sra_visit(sra, node->for_var, rewrite) || !sra_visit(sra, node->for_end, rewrite))
+            return false;
+
+        for (size_t i = 0; i < node->for_nivs; ++i)
+        {
+            if (!sra_visit(sra, node->for_ivs[i], rewrite))
+                return false;
+        }
+
+        return sra_visit(sra, node->for_body, rewrite);
+
+    default: return true;
+    }
+}
+
+
+bool sra_visit_var(struct Sra *sra, struct Node *var, size_t *counts, bool rewrite)
+{
+    if (strcmp(var->variable_name, sra->def->variable_def_name) != 0)
+        return true;
+
+    // Used as a whole, passed by reference or copied
+    if (!var->variable_struct_member)
+        return false;
+
+    struct Node *member = var->variable_struct_member;
+
+    while (member->variable_struct_member)
+        member = member->variable_struct_member;
+
+    if (member->variable_type.type != NODE_INT)
+        return false;
+
+    size_t w = (sra->def->variable_def_stack_offset - member->variable_stack_offset) / 4;
+
+    if (w >= sra->nwords || !sra->values[w])
+        return false;
+
+    if (!rewrite)
+    {
+        ++counts[w];
+        return true;
+    }
+
+    node_free(var->variable_struct_member);
+    var->variable_struct_member = 0;
+
+    free(var->variable_name);
+    var->variable_name = util_strcpy(sra->names[w]);
+
+    free(var->variable_type.struct_type);
+    var->variable_type = (NodeDType){ NODE_INT, 0 };
+
+    var->variable_stack_offset = sra->def->variable_def_stack_offset - 4 * (int)w;
+    var->variable_is_param = false;
+
+    return true;
+}
+
+
+bool sra_check_words(struct Sra *sra)
+{
+    size_t nread = 0;
+
+    for (size_t w = 0; w < sra->nwords; ++w)
+    {
+        if (!sra->values[w])
+            return false;
+
+        // Stores nothing reads are left to the struct
+        if (sra->writes[w] && !sra->reads[w])
+            return false;
+
+        if (!sra->reads[w] && !sra_check_pure(sra->values[w]))
+            return false;
+
+        if (sra->reads[w])
+            ++nread;
+    }
+
+    return nread > 0;
+}
+
+
+bool sra_check_pure(struct Node *node)
+{
+    return node->type == NODE_INT || node->type == NODE_STRING || node->type == NODE_VARIABLE;
+}
@@ -0,0 +1,41 @@
+#ifndef SRA_H
+#define SRA_H
+
+#include "node.h"
+#include "parser.h"
+
+#include <stdbool.h>
+
+// Scalar replacement of aggregates. A local struct built from an init list
+// whose members are only read and assigned one at a time is split into an
+// int variable per member, kept in the member's slot. Each member can then be
+// propagated on its own, and members that are never read aren't stored.
+// Runs once a function's body is parsed, before its frame is laid out.
+struct Sra
+{
+    struct Node *def;
+    size_t nwords;
+
+    // Indexed by the member's word in the struct
+    char **names;
+    struct Node **values;
+    size_t *reads, *writes;
+};
+
+void sra_function(struct Parser *parser, struct Node *func);
+void sra_stmt(struct Parser *parser, struct Node *func, struct Node *node);
+// Splits the def at compound's index i if it doesn't escape the statements after it
+void sra_split(struct Parser *parser, struct Node *func, struct Node *compound, size_t i);
+
+// Returns false for layouts where members share a slot or take more than one
+bool sra_flatten(struct Parser *parser, struct Sra *sra, struct Node *list, char *prefix, size_t first);
+// Counts the member uses in node, or replaces them with their scalar if rewrite is set.
+// Returns false if the struct escapes: used as a whole, by a struct member or shadowed.
+bool sra_visit(struct Sra *sra, struct Node *node, bool rewrite);
+bool sra_visit_var(struct Sra *sra, struct Node *var, size_t *counts, bool rewrite);
+
+bool sra_check_words(struct Sra *sra);
+// Unread members are dropped, so their values must not have side effects
+bool sra_check_pure(struct Node *node);
+
+#endif
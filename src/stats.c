@@ -0,0 +1,163 @@
+#include "stats.h"
+#include "util.h"
+
+#include <stdio.h>
+#include <string.h>
+
+struct Stats g_stats = { 0 };
+
+void stats_add_frame(char *name, size_t before, size_t after)
+{
+    g_stats.frames = realloc(g_stats.frames, sizeof(struct StatsFrame) * ++g_stats.nframes);
+    g_stats.frames[g_stats.nframes - 1] = (struct StatsFrame){ util_strcpy(name), before, after };
+}
+
+
+void stats_add_tail_call(char *caller, char *callee, bool self)
+{
+    g_stats.tail_calls = realloc(g_stats.tail_calls, sizeof(struct StatsTailCall) * ++g_stats.ntail_calls);
+    g_stats.tail_calls[g_stats.ntail_calls - 1] = (struct StatsTailCall){
+        util_strcpy(caller), util_strcpy(callee), self
+    };
+}
+
+
+void stats_add_inline(char *callee)
+{
+    for (size_t i = 0; i < g_stats.ninlined; ++i)
+    {
+        if (strcmp(g_stats.inlined[i].callee, callee) == 0)
+        {
+            ++g_stats.inlined[i].count;
+            return;
+        }
+    }
+
+    g_stats.inlined = realloc(g_stats.inlined, sizeof(struct StatsInline) * ++g_stats.ninlined);
+    g_stats.inlined[g_stats.ninlined - 1] = (struct StatsInline){ util_strcpy(callee), 1 };
+}
+
+
+void stats_add_sra(char *func, char *var, size_t kept, size_t members)
+{
+    g_stats.sra = realloc(g_stats.sra, sizeof(struct StatsSra) * ++g_stats.nsra);
+    g_stats.sra[g_stats.nsra - 1] = (struct StatsSra){ util_strcpy(func), util_strcpy(var), kept, members };
+}
+
+
+void stats_add_cse(char *func, size_t count)
+{
+    g_stats.cse = realloc(g_stats.cse, sizeof(struct StatsCse) * ++g_stats.ncse);
+    g_stats.cse[g_stats.ncse - 1] = (struct StatsCse){ util_strcpy(func), count };
+}
+
+
+void stats_add_dead_function(char *name)
+{
+    g_stats.dead_functions = realloc(g_stats.dead_functions, sizeof(char*) * ++g_stats.ndead_functions);
+    g_stats.dead_functions[g_stats.ndead_functions - 1] = util_strcpy(name);
+}
+
+
+void stats_print()
+{
+    printf("Optimization stats:\n");
+    printf("  Peephole: %zu instructions eliminated\n", g_stats.peephole_removed);
+
+    printf("  Frame sizes:\n");
+
+    for (size_t i = 0; i < g_stats.nframes; ++i)
+    {
+        printf("    %s: %zu -> %zu bytes\n", g_stats.frames[i].name,
+                g_stats.frames[i].before, g_stats.frames[i].after);
+    }
+
+    printf("  Tail calls:\n");
+
+    for (size_t i = 0; i < g_stats.ntail_calls; ++i)
+    {
+        printf("    %s -> %s (%s)\n", g_stats.tail_calls[i].caller, g_stats.tail_calls[i].callee,
+                g_stats.tail_calls[i].self ? "loop" : "jump");
+    }
+
+    printf("  Inlined calls:\n");
+
+    for (size_t i = 0; i < g_stats.ninlined; ++i)
+        printf("    %s: %zu\n", g_stats.inlined[i].callee, g_stats.inlined[i].count);
+
+    printf("  Scalar replaced structs:\n");
+
+    for (size_t i = 0; i < g_stats.nsra; ++i)
+    {
+        printf("    %s: %s, %zu of %zu members kept\n", g_stats.sra[i].func, g_stats.sra[i].var,
+                g_stats.sra[i].kept, g_stats.sra[i].members);
+    }
+
+    printf("  Common subexpressions:\n");
+
+    for (size_t i = 0; i < g_stats.ncse; ++i)
+        printf("    %s: %zu\n", g_stats.cse[i].func, g_stats.cse[i].count);
+
+    printf("  Dead stores: %zu removed\n", g_stats.dead_stores);
+    printf("  Dead functions:\n");
+
+    for (size_t i = 0; i < g_stats.ndead_functions; ++i)
+        printf("    %s\n", g_stats.dead_functions[i]);
+
+    printf("  Cold blocks: %zu moved out of line\n", g_stats.cold_blocks);
+}
+
+
+void stats_free()
+{
+    for (size_t i = 0; i < g_stats.nframes; ++i)
+        free(g_stats.frames[i].name);
+
+    free(g_stats.frames);
+    g_stats.frames = 0;
+    g_stats.nframes = 0;
+
+    for (size_t i = 0; i < g_stats.ntail_calls; ++i)
+    {
+        free(g_stats.tail_calls[i].caller);
+        free(g_stats.tail_calls[i].callee);
+    }
+
+    free(g_stats.tail_calls);
+    g_stats.tail_calls = 0;
+    g_stats.ntail_calls = 0;
+
+    for (size_t i = 0; i < g_stats.ninlined; ++i)
+        free(g_stats.inlined[i].callee);
+
+    free(g_stats.inlined);
+    g_stats.inlined = 0;
+    g_stats.ninlined = 0;
+
+    for (size_t i = 0; i < g_stats.nsra; ++i)
+    {
+        free(g_stats.sra[i].func);
+        free(g_stats.sra[i].var);
+    }
+
+    free(g_stats.sra);
+    g_stats.sra = 0;
+    g_stats.nsra = 0;
+
+    for (size_t i = 0; i < g_stats.ncse; ++i)
+        free(g_stats.cse[i].func);
+
+    free(g_stats.cse);
+    g_stats.cse = 0;
+    g_stats.ncse = 0;
+
+    for (size_t i = 0; i < g_stats.ndead_functions; ++i)
+        free(g_stats.dead_functions[i]);
+
+    free(g_stats.dead_functions);
+    g_stats.dead_functions = 0;
+    g_stats.ndead_functions = 0;
+    g_stats.dead_stores = 0;
+    g_stats.cold_blocks = 0;
+}
+
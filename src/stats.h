@@ -0,0 +1,75 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdlib.h>
+#include <stdbool.h>
+
+// Optimization counters, accumulated over every file compiled in one run
+// and printed with --stats.
+struct Stats
+{
+    size_t peephole_removed;
+    // Locals never read, whose stores were dropped
+    size_t dead_stores;
+    // If bodies the profile found rarely run, moved behind the function's code
+    size_t cold_blocks;
+
+    // Frame sizes before and after temporary slot reuse
+    struct StatsFrame
+    {
+        char *name;
+        size_t before, after;
+    } *frames;
+    size_t nframes;
+
+    struct StatsTailCall
+    {
+        char *caller, *callee;
+        // Turned into a loop instead of a jump to another function
+        bool self;
+    } *tail_calls;
+    size_t ntail_calls;
+
+    // Call sites replaced by the callee's body
+    struct StatsInline
+    {
+        char *callee;
+        size_t count;
+    } *inlined;
+    size_t ninlined;
+
+    // Local structs split into a variable per member
+    struct StatsSra
+    {
+        char *func, *var;
+        size_t kept, members;
+    } *sra;
+    size_t nsra;
+
+    // Expressions computed once into a temporary
+    struct StatsCse
+    {
+        char *func;
+        size_t count;
+    } *cse;
+    size_t ncse;
+
+    // Functions main can't reach, left out of the executable
+    char **dead_functions;
+    size_t ndead_functions;
+};
+
+extern struct Stats g_stats;
+
+void stats_add_frame(char *name, size_t before, size_t after);
+void stats_add_tail_call(char *caller, char *callee, bool self);
+void stats_add_inline(char *callee);
+void stats_add_sra(char *func, char *var, size_t kept, size_t members);
+void stats_add_cse(char *func, size_t count);
+void stats_add_dead_function(char *name);
+
+void stats_print();
+void stats_free();
+
+#endif
+
@@ -38,6 +38,7 @@ char *token_str_from_type(int type)
     case TOKEN_COLON: return ":";
     case TOKEN_STRING: return "string";
     case TOKEN_PERIOD: return ".";
+    case TOKEN_RANGE: return "..";
     case TOKEN_BINOP: return "binop";
     case TOKEN_EOF: return "EOF";
     }
@@ -20,6 +20,7 @@ struct Token
         TOKEN_COLON,
         TOKEN_STRING,
         TOKEN_PERIOD,
+        TOKEN_RANGE,
         TOKEN_BINOP,
         TOKEN_EOF
     } type;
@@ -33,7 +34,14 @@ struct Token
         OP_MINUS,
         OP_MUL,
         OP_DIV,
-        OP_CMP
+        OP_MOD,
+        // Comparisons, OP_CMP is ==
+        OP_CMP,
+        OP_NE,
+        OP_LT,
+        OP_LE,
+        OP_GT,
+        OP_GE
     } binop_type;
 };
 
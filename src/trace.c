@@ -0,0 +1,200 @@
+#include "trace.h"
+#include "errors.h"
+#include "util.h"
+
+#include <stdio.h>
+#include <string.h>
+
+struct Trace g_trace = { 0 };
+
+
+void trace_report(char *path)
+{
+    FILE *fp = fopen(path, "rb");
+    uint32_t len;
+
+    if (!fp || fread(&len, sizeof(len), 1, fp) != 1)
+    {
+        errors_warn_missing_trace(path);
+
+        if (fp)
+            fclose(fp);
+
+        return;
+    }
+
+    char *names = malloc(sizeof(char) * (len + 1));
+    names[len] = '\0';
+
+    if (fread(names, sizeof(char), len, fp) != len)
+        len = 0;
+
+    for (size_t i = 0; i < len; i += strlen(&names[i]) + 1)
+    {
+        uint32_t addr;
+
+        if (fread(&addr, sizeof(addr), 1, fp) != 1)
+            break;
+
+        g_trace.funcs = realloc(g_trace.funcs, sizeof(struct TraceFunc) * ++g_trace.nfuncs);
+        g_trace.funcs[g_trace.nfuncs - 1] = (struct TraceFunc){ util_strcpy(&names[i]), addr, 0, 0, 0, 0 };
+    }
+
+    free(names);
+
+    uint32_t count = 0;
+    uint8_t *records = malloc(TRACE_RECORDS * TRACE_RECORD_SIZE);
+
+    if (fread(&count, sizeof(count), 1, fp) != 1 ||
+        fread(records, TRACE_RECORD_SIZE, TRACE_RECORDS, fp) != TRACE_RECORDS)
+        count = 0;
+
+    fclose(fp);
+
+    trace_replay(records, count);
+    free(records);
+
+    size_t *sorted = malloc(sizeof(size_t) * g_trace.nfuncs);
+
+    for (size_t i = 0; i < g_trace.nfuncs; ++i)
+        sorted[i] = i;
+
+    qsort(sorted, g_trace.nfuncs, sizeof(size_t), trace_cmp_total);
+
+    printf("Trace of %u events%s:\n", count, count > TRACE_RECORDS ? ", oldest overwritten" : "");
+    printf("  Functions: calls, total cycles, self cycles\n");
+
+    for (size_t i = 0; i < g_trace.nfuncs; ++i)
+    {
+        struct TraceFunc *f = &g_trace.funcs[sorted[i]];
+
+        if (f->calls)
+            printf("    %s: %zu, %lu, %lu\n", f->name, f->calls, (unsigned long)f->total, (unsigned long)f->self);
+    }
+
+    printf("  Calls: calls, total cycles\n");
+
+    for (size_t i = 0; i < g_trace.nfuncs; ++i)
+    {
+        for (size_t j = 0; j < g_trace.nedges; ++j)
+        {
+            struct TraceEdge *e = &g_trace.edges[j];
+
+            if (e->caller == sorted[i])
+            {
+                printf("    %s -> %s: %zu, %lu\n", g_trace.funcs[e->caller].name,
+                        g_trace.funcs[e->callee].name, e->calls, (unsigned long)e->total);
+            }
+        }
+    }
+
+    free(sorted);
+    trace_free();
+}
+
+
+void trace_replay(uint8_t *records, uint32_t count)
+{
+    struct Frame
+    {
+        size_t func;
+        uint64_t start;
+        uint64_t callees;
+    } *stack = 0;
+    size_t depth = 0;
+
+    for (uint32_t n = count > TRACE_RECORDS ? count - TRACE_RECORDS : 0; n < count; ++n)
+    {
+        uint8_t *r = &records[(n % TRACE_RECORDS) * TRACE_RECORD_SIZE];
+
+        uint64_t tsc;
+        uint32_t addr, kind;
+        memcpy(&tsc, r, sizeof(tsc));
+        memcpy(&addr, r + 8, sizeof(addr));
+        memcpy(&kind, r + 12, sizeof(kind));
+
+        size_t func = trace_find(addr);
+
+        if (func == (size_t)-1)
+            continue;
+
+        if (kind == TRACE_ENTER)
+        {
+            stack = realloc(stack, sizeof(struct Frame) * ++depth);
+            stack[depth - 1] = (struct Frame){ func, tsc, 0 };
+            ++g_trace.funcs[func].depth;
+            continue;
+        }
+
+        if (!depth || stack[depth - 1].func != func)
+            continue;
+
+        struct Frame *frame = &stack[--depth];
+        struct TraceFunc *f = &g_trace.funcs[func];
+        uint64_t cycles = tsc - frame->start;
+
+        ++f->calls;
+        f->self += cycles - frame->callees;
+
+        if (--f->depth == 0)
+            f->total += cycles;
+
+        if (depth)
+        {
+            stack[depth - 1].callees += cycles;
+            trace_add_edge(stack[depth - 1].func, func, cycles);
+        }
+    }
+
+    free(stack);
+}
+
+
+size_t trace_find(uint32_t addr)
+{
+    for (size_t i = 0; i < g_trace.nfuncs; ++i)
+    {
+        if (g_trace.funcs[i].addr == addr)
+            return i;
+    }
+
+    return (size_t)-1;
+}
+
+
+void trace_add_edge(size_t caller, size_t callee, uint64_t cycles)
+{
+    for (size_t i = 0; i < g_trace.nedges; ++i)
+    {
+        if (g_trace.edges[i].caller == caller && g_trace.edges[i].callee == callee)
+        {
+            ++g_trace.edges[i].calls;
+            g_trace.edges[i].total += cycles;
+            return;
+        }
+    }
+
+    g_trace.edges = realloc(g_trace.edges, sizeof(struct TraceEdge) * ++g_trace.nedges);
+    g_trace.edges[g_trace.nedges - 1] = (struct TraceEdge){ caller, callee, 1, cycles };
+}
+
+
+int trace_cmp_total(const void *a, const void *b)
+{
+    uint64_t ta = g_trace.funcs[*(const size_t*)a].total;
+    uint64_t tb = g_trace.funcs[*(const size_t*)b].total;
+
+    return (ta < tb) - (ta > tb);
+}
+
+
+void trace_free()
+{
+    for (size_t i = 0; i < g_trace.nfuncs; ++i)
+        free(g_trace.funcs[i].name);
+
+    free(g_trace.funcs);
+    free(g_trace.edges);
+
+    g_trace = (struct Trace){ 0 };
+}
@@ -0,0 +1,70 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdlib.h>
+#include <stdint.h>
+
+#define TRACE_FILE "crust.trace"
+
+// Events kept, a power of 2. Older ones are overwritten.
+#define TRACE_RECORDS 65536
+#define TRACE_RECORD_SIZE 16
+
+enum
+{
+    TRACE_ENTER,
+    TRACE_EXIT
+};
+
+// -finstrument-functions. Functions call crust_trace_enter once their frame
+// is set up and crust_trace_exit before their epilogue, with their address
+// pushed. Both hooks are in the unit with _start, keep every register and
+// store an event in a ring buffer:
+//   8 byte rdtsc timestamp, 4 byte function address, 4 byte TRACE_ENTER/EXIT
+//
+// The file is written once main returns: the 4 byte length of the names,
+// the names each NUL terminated, a 4 byte address for each name, the 4 byte
+// number of events ever recorded, then the buffer. Event n is at
+// n % TRACE_RECORDS. Like the profile's, names and addresses come from two
+// sections the linker concatenates in the same object order.
+struct TraceFunc
+{
+    char *name;
+    uint32_t addr;
+
+    size_t calls;
+    // Cycles from entry to exit, and those not spent in callees
+    uint64_t total, self;
+    // Calls of it still running, recursive calls only count once in total
+    size_t depth;
+};
+
+struct TraceEdge
+{
+    size_t caller, callee;
+    size_t calls;
+    uint64_t total;
+};
+
+struct Trace
+{
+    struct TraceFunc *funcs;
+    size_t nfuncs;
+
+    struct TraceEdge *edges;
+    size_t nedges;
+};
+
+extern struct Trace g_trace;
+
+// Prints calls and cycles of each function and of each caller to callee edge
+void trace_report(char *path);
+// Events from before the buffer wrapped are missing, so exits of calls
+// entered before them are ignored
+void trace_replay(uint8_t *records, uint32_t count);
+size_t trace_find(uint32_t addr);
+void trace_add_edge(size_t caller, size_t callee, uint64_t cycles);
+int trace_cmp_total(const void *a, const void *b);
+void trace_free();
+
+#endif